@@ -0,0 +1,135 @@
+// Measures how long Document::Apply takes per keystroke on a large script, next to a full scan and parse of it.
+
+#include "Document.h"
+#include "Source.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <lyra/lyra.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace {
+std::string GenerateSource(std::size_t target_bytes)
+{
+  std::string source{};
+  source.reserve(target_bytes + 512);
+  for (std::size_t i = 0; source.size() < target_bytes; ++i) {
+    source += fmt::format("fun step_{}(value, scale) {{\n", i);
+    source += fmt::format("  var offset = value * scale + {};\n", i % 1000);
+    source += "  if (offset >= 100 and value != nil) { return \"large\"; }\n";
+    source += "  while (offset > 0) { offset = offset - scale; }\n";
+    source += "  return offset;\n}\n";
+    source += fmt::format("print step_{0}({0}, 2);\n", i);
+  }
+  return source;
+}
+
+// Whether `edit` applied to a document of `before` leaves it with the tokens a fresh scan of the edited text gives.
+bool RescansLikeFreshScan(std::string before, const TextEdit &edit, const ErrorReporter::ErrorFn &report_error)
+{
+  Document edited{ std::move(before), report_error };
+  edited.Apply(edit);
+  Document fresh{ std::string{ edited.Text() }, report_error };
+
+  const auto &tokens = edited.Tokens();
+  const auto &expected = fresh.Tokens();
+  if (tokens.Size() != expected.Size()) { return false; }
+  for (std::size_t i = 0; i < tokens.Size(); ++i) {
+    if (tokens.Type(i) != expected.Type(i) || tokens.Offset(i) != expected.Offset(i)
+        || tokens.Lexeme(i) != expected.Lexeme(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+  std::size_t megabytes{ 16 };
+  int edits{ 200 };
+
+  // clang-format off
+  auto cli
+    = lyra::cli()
+    | lyra::opt( megabytes, "megabytes" )
+        ["--size"]
+        ("Size of the generated script.")
+    | lyra::opt( edits, "edits" )
+        ["--edits"]
+        ("Number of keystrokes to apply.");
+  // clang-format on
+
+  auto result = cli.parse({ argc, argv });
+  if (!result) {
+    std::cerr << fmt::format("Error parsing command line: {}", result.message()) << std::endl;// nolint
+    return EXIT_FAILURE;
+  }
+
+  // Half-typed code is full of errors; only their cost matters here.
+  auto ignore = [](int, std::string_view, std::string_view) {};
+
+  // Edits that join a number literal across more than one earlier token.
+  struct Check
+  {
+    std::string before;
+    TextEdit edit;
+  };
+  const Check checks[]{
+    { "print 1.;", { 8, 0, "5" } },
+    { "print 1.x5;", { 8, 1, "" } },
+    { "print 0x", { 8, 0, "1" } },
+  };
+  for (const auto &check : checks) {
+    if (!RescansLikeFreshScan(check.before, check.edit, ignore)) {
+      std::cerr << fmt::format("Rescan of \"{}\" differs from a fresh scan", check.before) << std::endl;// nolint
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  Document document{ GenerateSource(megabytes * 1024 * 1024), ignore };
+  std::chrono::duration<double> full = std::chrono::steady_clock::now() - start;
+
+  // Keystrokes at random places: type a character, then delete it again.
+  std::mt19937 random{ 42 };
+  std::chrono::duration<double> total{};
+  std::chrono::duration<double> worst{};
+  std::size_t rescanned{ 0 };
+  std::size_t reparsed{ 0 };
+  std::size_t offset{ 0 };
+  for (int i = 0; i < edits; ++i) {
+    TextEdit edit{ offset, 1, "" };
+    if (i % 2 == 0) {
+      offset = std::uniform_int_distribution<std::size_t>{ 0, document.Text().size() }(random);
+      edit = { offset, 0, "x" };
+    }
+
+    auto edit_start = std::chrono::steady_clock::now();
+    auto stats = document.Apply(edit);
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - edit_start;
+    total += took;
+    worst = std::max(worst, took);
+    rescanned += stats.tokens_rescanned;
+    reparsed += stats.declarations_reparsed;
+  }
+
+  auto count = static_cast<double>(std::max(edits, 1));
+  fmt::print("full scan and parse of {:.1f} MiB, {} declarations: {:.3f} s\n",
+    static_cast<double>(document.Text().size()) / (1024.0 * 1024.0),
+    document.Statements().size(),
+    full.count());
+  fmt::print("{} edits: {:.3f} ms mean, {:.3f} ms worst; {:.1f} tokens rescanned, {:.1f} declarations re-parsed each\n",
+    edits,
+    total.count() * 1000.0 / count,
+    worst.count() * 1000.0,
+    static_cast<double>(rescanned) / count,
+    static_cast<double>(reparsed) / count);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+// Measures the Optimizer on a generated script of the kind code generators emit: constant subexpressions, branches
+// on constants, statements after a `return` and helpers nothing calls. Reports how much smaller the flat tree gets,
+// what the pass costs, and how long the tree-walker takes to run the program with and without it.
+
+#include "AstArena.h"
+#include "AstInterpreter.h"
+#include "ErrorReporter.h"
+#include "FlatAst.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "Resolver.h"
+#include "Scanner.h"
+#include "Source.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <lyra/lyra.hpp>
+#include <memory>
+#include <string>
+
+namespace {
+std::string GenerateScript(std::size_t functions, std::size_t rounds)
+{
+  std::string source{};
+  for (std::size_t i = 0; i < functions; ++i) {
+    source += fmt::format(
+      "fun unused_{0}(x) {{ return x * {0}; }}\n"
+      "fun generated_{0}(a) {{\n"
+      "  var scale = 4 * 1024 + {0};\n"
+      "  var label = \"generated\" + \"_\" + \"{0}\";\n"
+      "  fun helper(x) {{ return x + scale; }}\n"
+      "  if (false) {{ print label; }} else {{ }}\n"
+      "  while (false) {{ a = a + 1; }}\n"
+      "  return (a * scale) / (2 * 2) + (60 * 60 - {0}) * (1 < 2 and 3 or 4);\n"
+      "  print label;\n"
+      "}}\n",
+      i);
+  }
+  source += fmt::format("var total = 0;\nvar round = 0;\nwhile (round < {}) {{\n", rounds);
+  for (std::size_t i = 0; i < functions; ++i) { source += fmt::format("  total = total + generated_{}(round);\n", i); }
+  source += "  round = round + 1;\n}\n";
+  return source;
+}
+
+struct Program
+{
+  std::shared_ptr<const FlatAst> ast;
+  std::size_t removed{ 0 };
+  std::chrono::duration<double> optimize{};
+};
+
+Program Build(const Source &source, const ErrorReporterPtr &reporter, bool optimize)
+{
+  Scanner scanner{ source.Text(), reporter, source.Base() };
+  auto tokens = scanner.ScanTokens();
+  AstArena arena{};
+  Parser parser{ tokens, arena, reporter };
+  auto statements = parser.Parse();
+  Resolver resolver{ reporter };
+  resolver.Resolve(statements);
+
+  Program program{};
+  if (optimize) {
+    auto start = std::chrono::steady_clock::now();
+    Optimizer optimizer{ arena };
+    optimizer.WholeProgram(true);
+    optimizer.Optimize(statements);
+    program.optimize = std::chrono::steady_clock::now() - start;
+    program.removed = optimizer.Removed();
+  }
+  program.ast = std::make_shared<const FlatAst>(source.Text(), source.Base(), statements);
+  return program;
+}
+
+std::chrono::duration<double> TimeRun(const Program &program, const ErrorReporterPtr &reporter, int iterations)
+{
+  auto best = std::chrono::duration<double>::max();
+  for (int i = 0; i < std::max(iterations, 1); ++i) {
+    AstInterpreter interpreter{ reporter };
+    auto start = std::chrono::steady_clock::now();
+    interpreter.Interpret(program.ast);
+    best = std::min<std::chrono::duration<double>>(best, std::chrono::steady_clock::now() - start);
+  }
+  return best;
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+  std::size_t functions{ 2000 };
+  std::size_t rounds{ 200 };
+  int iterations{ 3 };
+
+  // clang-format off
+  auto cli
+    = lyra::cli()
+    | lyra::opt( functions, "functions" )
+        ["--functions"]
+        ("Generated functions in the script.")
+    | lyra::opt( rounds, "rounds" )
+        ["--rounds"]
+        ("Times the script calls each of them.")
+    | lyra::opt( iterations, "iterations" )
+        ["--iterations"]
+        ("Number of timed runs; the fastest one is reported.");
+  // clang-format on
+
+  auto result = cli.parse({ argc, argv });
+  if (!result) {
+    std::cerr << fmt::format("Error parsing command line: {}", result.message()) << std::endl;// nolint
+    return EXIT_FAILURE;
+  }
+
+  SourceMap sources{};
+  auto reporter = std::make_shared<ErrorReporter>(sources);
+  const auto &source = sources.Add(GenerateScript(functions, rounds));
+  auto plain = Build(source, reporter, false);
+  auto optimized = Build(source, reporter, true);
+
+  fmt::print("{} flat nodes, {} after optimizing: {} removed as dead code, pass took {:.3f} s\n",
+    plain.ast->Nodes().size(),
+    optimized.ast->Nodes().size(),
+    optimized.removed,
+    optimized.optimize.count());
+  auto before = TimeRun(plain, reporter, iterations);
+  auto after = TimeRun(optimized, reporter, iterations);
+  fmt::print("run: {:.3f} s, optimized {:.3f} s ({:.2f}x)\n", before.count(), after.count(), before / after);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+// Measures Parser throughput on long generated expressions: long operator chains, and deep nesting of parentheses,
+// calls and prefix operators; and on a library of small functions, parsed sequentially and split across threads. Only
+// parsing is timed; the tokens are scanned once up front.
+
+#include "AstArena.h"
+#include "ErrorReporter.h"
+#include "Parser.h"
+#include "Scanner.h"
+#include "Source.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <lyra/lyra.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace {
+// Statements whose initializers are chains of `operators` binary operators of every precedence level.
+std::string GenerateChains(std::size_t target_bytes, std::size_t operators)
+{
+  constexpr std::string_view kOperators[] = { " + ", " * ", " - ", " / ", " < ", " == ", " and ", " or ", " >= " };
+  std::string source{};
+  source.reserve(target_bytes + 512);
+  for (std::size_t i = 0; source.size() < target_bytes; ++i) {
+    source += fmt::format("var chain_{} = value", i);
+    for (std::size_t j = 0; j < operators; ++j) {
+      source += kOperators[(i + j) % std::size(kOperators)];
+      source += j % 3 == 0 ? fmt::format("{}", j) : "value";
+    }
+    source += ";\n";
+  }
+  return source;
+}
+
+// One expression nested `depth` levels deep, cycling through a grouping, a call argument and a prefix operator.
+std::string GenerateNesting(std::size_t depth)
+{
+  std::string source{ "print " };
+  for (std::size_t i = 0; i < depth; ++i) {
+    constexpr std::string_view kOpen[] = { "(", "f(1, ", "-" };
+    source += kOpen[i % std::size(kOpen)];
+  }
+  source += "1";
+  for (std::size_t i = depth; i > 0; --i) {
+    constexpr std::string_view kClose[] = { ")", ")", "" };
+    source += kClose[(i - 1) % std::size(kClose)];
+  }
+  source += ";\n";
+  return source;
+}
+
+// A library script: `target_bytes` worth of small top-level functions.
+std::string GenerateLibrary(std::size_t target_bytes)
+{
+  std::string source{};
+  source.reserve(target_bytes + 512);
+  for (std::size_t i = 0; source.size() < target_bytes; ++i) {
+    source += fmt::format(
+      "fun lib_{0}(a, b) {{\n  var c = a * b + {0};\n  while (c > b) {{ c = c - a; }}\n  return c == b or a;\n}}\n", i);
+  }
+  return source;
+}
+
+struct Timing
+{
+  std::chrono::duration<double> best{ std::chrono::duration<double>::max() };
+  std::size_t tokens{ 0 };
+  std::size_t statements{ 0 };
+};
+
+Timing TimeParse(const Source &source, const ErrorReporterPtr &reporter, int iterations, unsigned threads = 1)
+{
+  Scanner scanner{ source.Text(), reporter, source.Base() };
+  auto tokens = scanner.ScanTokens();
+
+  Timing timing{};
+  timing.tokens = tokens.Size();
+  for (int i = 0; i < std::max(iterations, 1); ++i) {
+    AstArena arena{};
+    auto start = std::chrono::steady_clock::now();
+    Parser parser{ tokens, arena, reporter };
+    auto statements = threads > 1 ? parser.ParseParallel(threads) : parser.Parse();
+    timing.best = std::min<std::chrono::duration<double>>(timing.best, std::chrono::steady_clock::now() - start);
+    timing.statements = statements.size();
+  }
+  return timing;
+}
+
+void Print(std::string_view name, const Source &source, const Timing &timing)
+{
+  fmt::print("{}: {:.1f} MiB, {} tokens, {} statements parsed in {:.3f} s: {:.1f} MiB/s, {:.1f} ns per token\n",
+    name,
+    static_cast<double>(source.Text().size()) / (1024.0 * 1024.0),
+    timing.tokens,
+    timing.statements,
+    timing.best.count(),
+    static_cast<double>(source.Text().size()) / (1024.0 * 1024.0) / timing.best.count(),
+    timing.best.count() * 1e9 / static_cast<double>(timing.tokens));
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+  std::size_t megabytes{ 16 };
+  std::size_t operators{ 200 };
+  std::size_t depth{ 1'000'000 };
+  unsigned threads{ std::max(std::thread::hardware_concurrency(), 1U) };
+  int iterations{ 5 };
+
+  // clang-format off
+  auto cli
+    = lyra::cli()
+    | lyra::opt( megabytes, "megabytes" )
+        ["--size"]
+        ("Size of the generated operator chains.")
+    | lyra::opt( operators, "operators" )
+        ["--operators"]
+        ("Operators in each chain.")
+    | lyra::opt( depth, "depth" )
+        ["--depth"]
+        ("Nesting depth of the nested expression.")
+    | lyra::opt( threads, "threads" )
+        ["--threads"]
+        ("Threads for the parallel parse of the function library.")
+    | lyra::opt( iterations, "iterations" )
+        ["--iterations"]
+        ("Number of timed runs; the fastest one is reported.");
+  // clang-format on
+
+  auto result = cli.parse({ argc, argv });
+  if (!result) {
+    std::cerr << fmt::format("Error parsing command line: {}", result.message()) << std::endl;// nolint
+    return EXIT_FAILURE;
+  }
+
+  SourceMap sources{};
+  auto reporter = std::make_shared<ErrorReporter>(sources);
+  const auto &chains = sources.Add(GenerateChains(megabytes * 1024 * 1024, operators));
+  Print("chains", chains, TimeParse(chains, reporter, iterations));
+  const auto &nesting = sources.Add(GenerateNesting(depth));
+  Print(fmt::format("nesting {} deep", depth), nesting, TimeParse(nesting, reporter, iterations));
+  const auto &library = sources.Add(GenerateLibrary(megabytes * 1024 * 1024));
+  Print("library", library, TimeParse(library, reporter, iterations));
+  Print(fmt::format("library on {} threads", threads), library, TimeParse(library, reporter, iterations, threads));
+  return EXIT_SUCCESS;
+}
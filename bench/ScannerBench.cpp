@@ -0,0 +1,108 @@
+// Measures Scanner throughput on a large synthetic script, or on the script given on the command line.
+
+#include "ErrorReporter.h"
+#include "ScanKernels.h"
+#include "Scanner.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <lyra/lyra.hpp>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace {
+// Roughly what machine-generated scripts look like: declarations, arithmetic, string literals, calls and comments.
+std::string GenerateSource(std::size_t target_bytes)
+{
+  std::string source{};
+  source.reserve(target_bytes + 512);
+  for (std::size_t i = 0; source.size() < target_bytes; ++i) {
+    source += fmt::format("// helper number {}\n", i);
+    source += fmt::format("fun helper_{}(value, scale) {{\n", i);
+    source += fmt::format("  var offset_{} = value * scale + {}.{};\n", i, i % 1000, i % 7);
+    source += "  /* adjust for the\n     configured bias */\n";
+    source += fmt::format("  if (offset_{0} >= 100 and value != nil) {{ return \"large {0}\"; }}\n", i);
+    source += fmt::format("  return offset_{} - 1;\n}}\n", i);
+    source += fmt::format("var result_{0} = helper_{0}({0}, 2);\n\n", i);
+  }
+  return source;
+}
+}// namespace
+
+int main(int argc, char **argv)
+{
+  std::string script{};
+  std::size_t megabytes{ 64 };
+  int iterations{ 5 };
+  unsigned threads{ 1 };
+
+  // clang-format off
+  auto cli
+    = lyra::cli()
+    | lyra::opt( megabytes, "megabytes" )
+        ["--size"]
+        ("Size of the generated script when no script is given.")
+    | lyra::opt( threads, "threads" )
+        ["--threads"]
+        ("Scan with ScanTokensParallel on this many threads.")
+    | lyra::opt( iterations, "iterations" )
+        ["--iterations"]
+        ("Number of timed runs; the fastest one is reported.")
+    | lyra::arg( script, "script" )
+        ("Script to scan instead of a generated one.");
+  // clang-format on
+
+  auto result = cli.parse({ argc, argv });
+  if (!result) {
+    std::cerr << fmt::format("Error parsing command line: {}", result.message()) << std::endl;// nolint
+    return EXIT_FAILURE;
+  }
+
+  std::string source{};
+  if (script.empty()) {
+    source = GenerateSource(megabytes * 1024 * 1024);
+  } else {
+    std::ifstream file{ script };
+    if (!file) {
+      std::cerr << fmt::format("File not found: {}", script) << std::endl;// nolint
+      return EXIT_FAILURE;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    source = std::move(buffer).str();
+  }
+
+  SourceMap sources{};
+  const auto &text = sources.Add(std::move(source));
+  auto reporter = std::make_shared<ErrorReporter>(sources);
+  auto best = std::chrono::duration<double>::max();
+  std::size_t token_count{ 0 };
+  std::size_t token_bytes{ 0 };
+  for (int i = 0; i < std::max(iterations, 1); ++i) {
+    auto start = std::chrono::steady_clock::now();
+    Scanner scanner{ text.Text(), reporter, text.Base() };
+    auto tokens = threads > 1 ? scanner.ScanTokensParallel(threads) : scanner.ScanTokens();
+    best = std::min<std::chrono::duration<double>>(best, std::chrono::steady_clock::now() - start);
+    token_count = tokens.Size();
+    token_bytes = tokens.MemoryUsage();
+  }
+
+  auto megabytes_scanned = static_cast<double>(text.Text().size()) / (1024.0 * 1024.0);
+  fmt::print("scanned {:.1f} MiB into {} tokens in {:.3f} s with {} kernels on {} thread(s): {:.1f} MiB/s\n",
+    megabytes_scanned,
+    token_count,
+    best.count(),
+    scan::KernelName(),
+    std::max(threads, 1U),
+    megabytes_scanned / best.count());
+  fmt::print("token storage: {:.1f} MiB, {:.1f} bytes per token\n",
+    static_cast<double>(token_bytes) / (1024.0 * 1024.0),
+    static_cast<double>(token_bytes) / static_cast<double>(token_count));
+  return EXIT_SUCCESS;
+}
@@ -1,11 +1,14 @@
 #ifndef LOX_AST_H
 #define LOX_AST_H
 
-#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <variant>
-#include <vector>
+#include "AstArena.h"
 #include "Common.h"
 #include "Token.h"
+#include "Value.h"
 
 namespace expr {
 struct Assign;
@@ -18,12 +21,13 @@ struct Unary;
 struct Variable;
 } // namespace expr
 using Expr = std::variant<expr::Assign, expr::Binary, expr::Call, expr::Grouping, expr::Literal, expr::Logical, expr::Unary, expr::Variable>;
-using ExprPtr = std::shared_ptr<Expr>;
+using ExprPtr = Expr *;
 
 namespace expr {
 struct Assign {
     Token name;
     ExprPtr value;
+    Slot slot{};
 };
 
 struct Binary {
@@ -35,7 +39,7 @@ struct Binary {
 struct Call {
     ExprPtr callee;
     Token paren;
-    std::vector<ExprPtr> arguments;
+    std::span<ExprPtr> arguments;
 };
 
 struct Grouping {
@@ -43,7 +47,7 @@ struct Grouping {
 };
 
 struct Literal {
-    LiteralT value;
+    Value value;
 };
 
 struct Logical {
@@ -59,13 +63,30 @@ struct Unary {
 
 struct Variable {
     Token name;
+    Slot slot{};
 };
 
 } // namespace expr
+namespace expr {
+// Whether a node holds a reference to an object outside the arena, which has to be released with it. Every other
+// node is trivially destructible and is never destroyed.
+constexpr bool OwnsObjects(const auto &) { return false; }
+static_assert(std::is_trivially_destructible_v<Assign>);
+static_assert(std::is_trivially_destructible_v<Binary>);
+static_assert(std::is_trivially_destructible_v<Call>);
+static_assert(std::is_trivially_destructible_v<Grouping>);
+inline bool OwnsObjects(const Literal &node) { return node.value.IsObj(); }
+static_assert(std::is_trivially_destructible_v<Logical>);
+static_assert(std::is_trivially_destructible_v<Unary>);
+static_assert(std::is_trivially_destructible_v<Variable>);
+} // namespace expr
+
 template <typename ExprType, typename... Args>
-auto MakeExpr(Args&&... args) -> ExprPtr
+auto MakeExpr(AstArena &arena, Args&&... args) -> ExprPtr
 {
-    return std::make_shared<Expr>(ExprType{std::forward<Args>(args)...});
+    auto *node = arena.New<Expr>(ExprType{std::forward<Args>(args)...});
+    if (expr::OwnsObjects(std::get<ExprType>(*node))) { arena.DestroyWithArena(node); }
+    return node;
 }
 
 namespace stmt {
@@ -80,7 +101,7 @@ struct Empty;
 struct Block;
 } // namespace stmt
 using Stmt = std::variant<stmt::Expression, stmt::Function, stmt::If, stmt::Print, stmt::Return, stmt::Var, stmt::While, stmt::Empty, stmt::Block>;
-using StmtPtr = std::shared_ptr<Stmt>;
+using StmtPtr = Stmt *;
 
 namespace stmt {
 struct Expression {
@@ -89,8 +110,9 @@ struct Expression {
 
 struct Function {
     Token name;
-    std::vector<Token> params;
-    std::vector<Stmt> body;
+    std::span<Token> params;
+    std::span<Stmt> body;
+    const LazyBody *lazy;
 };
 
 struct If {
@@ -100,6 +122,7 @@ struct If {
 };
 
 struct Print {
+    Token keyword;
     ExprPtr expression;
 };
 
@@ -122,14 +145,31 @@ struct Empty {
 };
 
 struct Block {
-    std::vector<Stmt> statements;
+    std::span<Stmt> statements;
 };
 
 } // namespace stmt
+namespace stmt {
+// Whether a node holds a reference to an object outside the arena, which has to be released with it. Every other
+// node is trivially destructible and is never destroyed.
+constexpr bool OwnsObjects(const auto &) { return false; }
+static_assert(std::is_trivially_destructible_v<Expression>);
+static_assert(std::is_trivially_destructible_v<Function>);
+static_assert(std::is_trivially_destructible_v<If>);
+static_assert(std::is_trivially_destructible_v<Print>);
+static_assert(std::is_trivially_destructible_v<Return>);
+static_assert(std::is_trivially_destructible_v<Var>);
+static_assert(std::is_trivially_destructible_v<While>);
+static_assert(std::is_trivially_destructible_v<Empty>);
+static_assert(std::is_trivially_destructible_v<Block>);
+} // namespace stmt
+
 template <typename StmtType, typename... Args>
-auto MakeStmt(Args&&... args) -> StmtPtr
+auto MakeStmt(AstArena &arena, Args&&... args) -> StmtPtr
 {
-    return std::make_shared<Stmt>(StmtType{std::forward<Args>(args)...});
+    auto *node = arena.New<Stmt>(StmtType{std::forward<Args>(args)...});
+    if (stmt::OwnsObjects(std::get<StmtType>(*node))) { arena.DestroyWithArena(node); }
+    return node;
 }
 
 #endif // LOX_AST_H
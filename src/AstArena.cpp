@@ -0,0 +1,68 @@
+#include "AstArena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+AstArena::~AstArena()
+{
+  for (auto *destructor = destructors_; destructor != nullptr; destructor = destructor->next) {
+    destructor->destroy(destructor->object);
+  }
+  while (block_ != nullptr) { ::operator delete(std::exchange(block_, block_->previous)); }
+}
+
+std::uintptr_t AstArena::Grow(std::size_t size, std::size_t align)
+{
+  // Blocks double up to the cap, so small programs stay small and big ones make one allocation per megabyte; a
+  // request bigger than the cap gets a block of its own size.
+  block_size_ = std::min(std::max(block_size_ * 2, kFirstBlockSize), kMaxBlockSize);
+  auto needed = sizeof(Block) + align + size;
+  auto block_size = std::max(block_size_, needed);
+
+  auto *block = static_cast<Block *>(::operator new(block_size));
+  block->previous = block_;
+  block_ = block;
+  reserved_ += block_size;
+  ++blocks_;
+
+  auto begin = reinterpret_cast<std::uintptr_t>(block) + sizeof(Block);
+  end_ = reinterpret_cast<std::uintptr_t>(block) + block_size;
+  return (begin + align - 1) & ~(align - 1);
+}
+
+void AstArena::Absorb(AstArena &other)
+{
+  if (other.block_ != nullptr) {
+    // The other blocks go below the current one, which allocation carries on in.
+    auto *oldest = other.block_;
+    while (oldest->previous != nullptr) { oldest = oldest->previous; }
+    if (block_ != nullptr) {
+      oldest->previous = block_->previous;
+      block_->previous = other.block_;
+    } else {
+      block_ = other.block_;
+      next_ = other.next_;
+      end_ = other.end_;
+      block_size_ = other.block_size_;
+    }
+  }
+  if (other.destructors_ != nullptr) {
+    auto *last = other.destructors_;
+    while (last->next != nullptr) { last = last->next; }
+    last->next = destructors_;
+    destructors_ = other.destructors_;
+  }
+  reserved_ += other.reserved_;
+  blocks_ += other.blocks_;
+
+  other.block_ = nullptr;
+  other.next_ = 0;
+  other.end_ = 0;
+  other.block_size_ = 0;
+  other.reserved_ = 0;
+  other.blocks_ = 0;
+  other.destructors_ = nullptr;
+}
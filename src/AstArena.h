@@ -0,0 +1,91 @@
+#ifndef LOX_AST_ARENA_H
+#define LOX_AST_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+
+// Bump allocator that owns the AST nodes of one program. Nodes are carved out of blocks that double in size up to
+// kMaxBlockSize, so parsing makes a handful of allocations per megabyte of nodes, and nothing is freed a node at a
+// time: destroying the arena releases every block at once. Nodes are not destroyed either, except for the few handed
+// to DestroyWithArena because they hold a reference to something outside the arena.
+class AstArena
+{
+public:
+  AstArena() = default;
+  ~AstArena();
+
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+
+  template<typename T, typename... Args> [[nodiscard]] T *New(Args &&...args)
+  {
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // Copies `items` into the arena; an empty span doesn't allocate.
+  template<typename T> [[nodiscard]] std::span<T> Copy(std::span<const T> items)
+  {
+    if (items.empty()) { return {}; }
+    auto *first = static_cast<T *>(Allocate(items.size_bytes(), alignof(T)));
+    std::uninitialized_copy(items.begin(), items.end(), first);
+    return { first, items.size() };
+  }
+  template<typename T> [[nodiscard]] std::span<T> Copy(std::initializer_list<T> items)
+  {
+    return Copy(std::span<const T>{ items.begin(), items.size() });
+  }
+
+  // Runs the destructor of `object`, which must live in this arena, when the arena goes.
+  template<typename T> void DestroyWithArena(T *object)
+  {
+    destructors_ = New<Destructor>(object, [](void *p) { std::destroy_at(static_cast<T *>(p)); }, destructors_);
+  }
+
+  // Takes over the blocks and registered destructors of `other`, which is left empty, so its nodes live as long as this
+  // arena does. Lets nodes be parsed into separate arenas on several threads and end up owned by one.
+  void Absorb(AstArena &other);
+
+  // Bytes taken from the system so far, and in how many blocks.
+  [[nodiscard]] std::size_t Reserved() const { return reserved_; }
+  [[nodiscard]] std::size_t Blocks() const { return blocks_; }
+
+private:
+  struct Block
+  {
+    Block *previous;
+  };
+  struct Destructor
+  {
+    void *object;
+    void (*destroy)(void *);
+    Destructor *next;
+  };
+
+  static constexpr std::size_t kFirstBlockSize = 4 << 10;
+  static constexpr std::size_t kMaxBlockSize = 1 << 20;
+
+  Block *block_{ nullptr };
+  std::uintptr_t next_{ 0 };
+  std::uintptr_t end_{ 0 };
+  std::size_t block_size_{ 0 };
+  std::size_t reserved_{ 0 };
+  std::size_t blocks_{ 0 };
+  Destructor *destructors_{ nullptr };
+
+  void *Allocate(std::size_t size, std::size_t align)
+  {
+    auto at = (next_ + align - 1) & ~(align - 1);
+    if (at + size > end_) { at = Grow(size, align); }
+    next_ = at + size;
+    return reinterpret_cast<void *>(at);
+  }
+  // Starts a new block big enough for `size` bytes at `align` and returns where they go.
+  std::uintptr_t Grow(std::size_t size, std::size_t align);
+};
+
+#endif// LOX_AST_ARENA_H
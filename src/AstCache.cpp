@@ -0,0 +1,346 @@
+#include "AstCache.h"
+#include "FlatAst.h"
+#include "Source.h"
+#include "SymbolTable.h"
+#include "Token.h"
+#include "Value.h"
+#include "fmt/core.h"
+#include "magic_enum/magic_enum.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LOX_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Names the sources the binary was built from, so that entries left by another build of the optimizer or interpreter
+// are not taken for this one's. Generated by the build; a build without one only recognises entries from others
+// without one.
+#if __has_include("BuildId.h")
+#include "BuildId.h"
+#endif
+#ifndef LOX_BUILD_ID
+#define LOX_BUILD_ID "unknown"
+#endif
+
+namespace {
+// Bumped whenever the same nodes come to mean something else, or the file layout below changes.
+constexpr std::uint32_t kFormatVersion = 4;
+constexpr std::array<char, 8> kMagic{ 'L', 'O', 'X', 'A', 'S', 'T', '\0', '\0' };
+
+struct Section
+{
+  std::uint64_t offset;
+  std::uint64_t count;
+};
+
+// A name or a string constant: `length` bytes at `offset` in the strings section.
+struct StringRecord
+{
+  std::uint32_t offset;
+  std::uint32_t length;
+};
+
+enum class ConstantKind : std::uint32_t { NIL, BOOL, INT, DOUBLE, STRING };
+
+struct ConstantRecord
+{
+  ConstantKind kind;
+  // A string's length; `bits` is then its offset in the strings section.
+  std::uint32_t length;
+  std::uint64_t bits;
+};
+
+// The file starts with this header; every section it points to is aligned to 8 bytes.
+struct Header
+{
+  std::array<char, 8> magic;
+  std::uint32_t format;
+  std::uint32_t node_size;
+  std::uint64_t layout;
+  std::uint64_t build;
+  std::uint64_t text_hash;
+  std::uint64_t text_size;
+  std::uint64_t inline_budget;
+  // Hash of everything after the header. The sections are used as they are, so an entry that was damaged on disk must
+  // not be.
+  std::uint64_t checksum;
+  flat::NodeList roots;
+  Section nodes;
+  Section tokens;
+  Section symbols;
+  Section constants;
+  Section strings;
+};
+
+// The node layout, extended with the token types: token records hold them as raw numbers.
+constexpr std::uint64_t LayoutHash()
+{
+  auto hash = flat::kLayoutHash;
+  auto add = [&hash](std::uint64_t byte) { hash = (hash ^ byte) * 0x100000001b3; };
+  for (const auto &[type, name] : magic_enum::enum_entries<TokenType>()) {
+    add(magic_enum::enum_integer(type));
+    for (auto c : name) { add(static_cast<unsigned char>(c)); }
+  }
+  return hash;
+}
+
+constexpr std::uint64_t kLayout = LayoutHash();
+
+// A cache entry in memory, along with the parts of its program that had to be made for this process.
+struct Image
+{
+  Image() = default;
+  Image(const Image &) = delete;
+  Image &operator=(const Image &) = delete;
+  ~Image()
+  {
+#ifdef LOX_HAVE_MMAP
+    if (mapping != nullptr) { munmap(mapping, size); }
+#endif
+  }
+
+  void *mapping{ nullptr };
+  // Where the entry was read into when it could not be mapped.
+  std::unique_ptr<std::uint64_t[]> buffer;
+  const std::byte *data{ nullptr };
+  std::size_t size{ 0 };
+  std::vector<SymbolId> symbols;
+  std::vector<Value> constants;
+};
+
+std::uint64_t Mix(std::uint64_t value)
+{
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+  return value ^ (value >> 31);
+}
+
+// Hash of `text`, eight bytes at a time.
+std::uint64_t HashText(std::string_view text)
+{
+  auto hash = Mix(text.size());
+  std::size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= text.size(); i += sizeof(std::uint64_t)) {
+    std::uint64_t word{};
+    std::memcpy(&word, text.data() + i, sizeof(word));
+    hash = Mix(hash ^ word);
+  }
+  std::uint64_t tail{ 0 };
+  std::memcpy(&tail, text.data() + i, text.size() - i);
+  return Mix(hash ^ tail);
+}
+
+// Entries for the same script made with different inline budgets live side by side.
+std::filesystem::path PathFor(const std::filesystem::path &directory, std::string_view text, std::size_t inline_budget)
+{
+  return directory / fmt::format("{:016x}-{}.ast", HashText(text), inline_budget);
+}
+
+std::unique_ptr<Image> Read(const std::filesystem::path &path)
+{
+  auto image = std::make_unique<Image>();
+#ifdef LOX_HAVE_MMAP
+  if (auto fd = open(path.c_str(), O_RDONLY); fd != -1) {
+    struct stat info{};
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+      mapping = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) { return nullptr; }
+    image->mapping = mapping;
+    image->data = static_cast<const std::byte *>(mapping);
+    image->size = static_cast<std::size_t>(info.st_size);
+    return image;
+  }
+  return nullptr;
+#else
+  std::ifstream file{ path, std::ios::binary | std::ios::ate };
+  if (!file) { return nullptr; }
+  image->size = static_cast<std::size_t>(file.tellg());
+  image->buffer.reset(new std::uint64_t[(image->size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t)]);
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char *>(image->buffer.get()), static_cast<std::streamsize>(image->size))) {
+    return nullptr;
+  }
+  image->data = reinterpret_cast<const std::byte *>(image->buffer.get());
+  return image;
+#endif
+}
+
+// The items of `section`, if they lie within the image.
+template<typename T> std::optional<std::span<const T>> Items(const Image &image, Section section)
+{
+  if (section.offset % alignof(std::uint64_t) != 0 || section.offset > image.size
+      || section.count > (image.size - section.offset) / sizeof(T)) {
+    return std::nullopt;
+  }
+  return std::span<const T>{ reinterpret_cast<const T *>(image.data + section.offset), section.count };
+}
+
+// Appends `items` to `file` on an 8-byte boundary.
+template<typename T> Section Append(std::vector<std::byte> &file, std::span<const T> items)
+{
+  file.resize((file.size() + alignof(std::uint64_t) - 1) & ~(alignof(std::uint64_t) - 1));
+  Section section{ file.size(), items.size() };
+  const auto *bytes = reinterpret_cast<const std::byte *>(items.data());
+  file.insert(file.end(), bytes, bytes + items.size_bytes());
+  return section;
+}
+}// namespace
+
+std::shared_ptr<const FlatAst> AstCache::Load(const Source &source, std::size_t inline_budget) const
+{
+  auto text = source.Text();
+  auto image = Read(PathFor(directory_, text, inline_budget));
+  if (!image || image->size < sizeof(Header)) { return nullptr; }
+
+  Header header{};
+  std::memcpy(&header, image->data, sizeof(header));
+  if (header.magic != kMagic || header.format != kFormatVersion || header.node_size != sizeof(flat::Node)
+      || header.layout != kLayout || header.build != HashText(LOX_BUILD_ID) || header.text_hash != HashText(text)
+      || header.text_size != text.size() || header.inline_budget != inline_budget) {
+    return nullptr;
+  }
+
+  std::string_view body{ reinterpret_cast<const char *>(image->data) + sizeof(Header), image->size - sizeof(Header) };
+  if (HashText(body) != header.checksum) { return nullptr; }
+
+  auto nodes = Items<flat::Node>(*image, header.nodes);
+  auto tokens = Items<flat::TokenRecord>(*image, header.tokens);
+  auto symbols = Items<StringRecord>(*image, header.symbols);
+  auto constants = Items<ConstantRecord>(*image, header.constants);
+  auto strings = Items<char>(*image, header.strings);
+  if (!nodes || !tokens || !symbols || !constants || !strings || header.roots.first > nodes->size()) { return nullptr; }
+  std::string_view blob{ strings->data(), strings->size() };
+
+  auto string = [&blob](std::uint64_t offset, std::uint32_t length) -> std::optional<std::string_view> {
+    if (offset > blob.size() || length > blob.size() - offset) { return std::nullopt; }
+    return blob.substr(offset, length);
+  };
+  image->symbols.reserve(symbols->size());
+  for (const auto &symbol : *symbols) {
+    auto name = string(symbol.offset, symbol.length);
+    if (!name) { return nullptr; }
+    image->symbols.push_back(SymbolTable::Global().Intern(*name));
+  }
+  image->constants.reserve(constants->size());
+  for (const auto &constant : *constants) {
+    switch (constant.kind) {
+    case ConstantKind::NIL:
+      image->constants.emplace_back(Nil{});
+      break;
+    case ConstantKind::BOOL:
+      image->constants.emplace_back(constant.bits != 0);
+      break;
+    case ConstantKind::INT:
+      image->constants.emplace_back(static_cast<int>(static_cast<std::uint32_t>(constant.bits)));
+      break;
+    case ConstantKind::DOUBLE:
+      image->constants.emplace_back(std::bit_cast<double>(constant.bits));
+      break;
+    case ConstantKind::STRING: {
+      auto value = string(constant.bits, constant.length);
+      if (!value) { return nullptr; }
+      image->constants.push_back(Value::String(std::string{ *value }));
+      break;
+    }
+    default:
+      return nullptr;
+    }
+  }
+
+  flat::Tables tables{ *nodes, header.roots, image->constants, *tokens, image->symbols, {} };
+  return std::make_shared<const FlatAst>(text, source.Base(), tables, std::shared_ptr<const Image>{ std::move(image) });
+}
+
+void AstCache::Store(const Source &source, const FlatAst &ast, std::size_t inline_budget) const
+{
+  const auto &tables = ast.Tables();
+  if (!tables.lazy_bodies.empty()) { return; }
+
+  std::string strings{};
+  auto add_string = [&strings](std::string_view text) {
+    StringRecord record{ static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(text.size()) };
+    strings += text;
+    return record;
+  };
+  std::vector<StringRecord> symbols{};
+  symbols.reserve(tables.symbols.size());
+  for (auto symbol : tables.symbols) { symbols.push_back(add_string(SymbolTable::Global().Name(symbol))); }
+  std::vector<ConstantRecord> constants{};
+  constants.reserve(tables.constants.size());
+  for (const auto &value : tables.constants) {
+    if (value.IsNil()) {
+      constants.push_back({ ConstantKind::NIL, 0, 0 });
+    } else if (value.IsBool()) {
+      constants.push_back({ ConstantKind::BOOL, 0, value.AsBool() ? 1U : 0U });
+    } else if (value.IsInt()) {
+      constants.push_back({ ConstantKind::INT, 0, static_cast<std::uint32_t>(value.AsInt()) });
+    } else if (value.IsDouble()) {
+      constants.push_back({ ConstantKind::DOUBLE, 0, std::bit_cast<std::uint64_t>(value.AsDouble()) });
+    } else if (value.IsString()) {
+      auto record = add_string(value.AsString());
+      constants.push_back({ ConstantKind::STRING, record.length, record.offset });
+    } else {
+      return;
+    }
+  }
+
+  Header header{};
+  header.magic = kMagic;
+  header.format = kFormatVersion;
+  header.node_size = sizeof(flat::Node);
+  header.layout = kLayout;
+  header.build = HashText(LOX_BUILD_ID);
+  header.text_hash = HashText(source.Text());
+  header.text_size = source.Text().size();
+  header.inline_budget = inline_budget;
+  header.roots = tables.roots;
+
+  std::vector<std::byte> file(sizeof(Header));
+  header.nodes = Append(file, tables.nodes);
+  header.tokens = Append(file, tables.tokens);
+  header.symbols = Append(file, std::span<const StringRecord>{ symbols });
+  header.constants = Append(file, std::span<const ConstantRecord>{ constants });
+  header.strings = Append(file, std::span<const char>{ strings });
+  header.checksum = HashText({ reinterpret_cast<const char *>(file.data()) + sizeof(Header), file.size() - sizeof(Header) });
+  std::memcpy(file.data(), &header, sizeof(header));
+
+  // Written under a name of its own and then renamed, so that runs reading the entry at the same time see all of it
+  // or none of it.
+  std::error_code error{};
+  std::filesystem::create_directories(directory_, error);
+  auto path = PathFor(directory_, source.Text(), inline_budget);
+  auto temporary = path;
+  temporary += fmt::format(".{:08x}.tmp", std::random_device{}());
+  {
+    std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+    if (!out.write(reinterpret_cast<const char *>(file.data()), static_cast<std::streamsize>(file.size()))) {
+      out.close();
+      std::filesystem::remove(temporary, error);
+      return;
+    }
+  }
+  std::filesystem::rename(temporary, path, error);
+  if (error) { std::filesystem::remove(temporary, error); }
+}
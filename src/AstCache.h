@@ -0,0 +1,34 @@
+#ifndef LOX_AST_CACHE_H
+#define LOX_AST_CACHE_H
+
+#include "FlatAst.h"
+#include "Source.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <utility>
+
+// Scripts that have been run before, kept on disk in flat form so that running them again skips scanning, parsing
+// and resolving. An entry is keyed by a hash of the script's text, by the optimizer settings it was made with, by the
+// flat encoding it was written with and by the build that wrote it. It is mapped into memory and run where it lies:
+// nodes and tokens are used in place, and only the identifiers are interned and the string constants allocated when
+// it is loaded.
+class AstCache
+{
+public:
+  explicit AstCache(std::filesystem::path directory) : directory_{ std::move(directory) } {}
+
+  // The program cached for `source` with calls inlined up to `inline_budget` (see Optimizer::InlineFunctionsUpTo), or
+  // nullptr if this build has none it can use.
+  [[nodiscard]] std::shared_ptr<const FlatAst> Load(const Source &source, std::size_t inline_budget) const;
+  // Caches `ast`, which was flattened from `source` and optimized with `inline_budget`. A program with function bodies
+  // still to be parsed cannot be cached; neither can anything if the cache directory cannot be written, which is not
+  // an error.
+  void Store(const Source &source, const FlatAst &ast, std::size_t inline_budget) const;
+
+private:
+  std::filesystem::path directory_;
+};
+
+#endif// LOX_AST_CACHE_H
@@ -2,74 +2,95 @@
 #include "Ast.h"
 #include "Environment.h"
 #include "Errors.h"
+#include "FlatAst.h"
 #include "LoxFunction.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "Resolver.h"
 #include "Return.h"
 #include "Token.h"
 
+#include <cstddef>
 #include <fmt/core.h>
+#include <functional>
 #include <memory>
+#include <span>
 #include <string>
-#include <variant>
+#include <utility>
 #include <vector>
 
-bool AstInterpreter::IsTruthy(const ObjectT &object)
+void AstInterpreter::CheckNumberOperand(flat::TokenRef op, const Value &operand) const
 {
-  if (std::holds_alternative<Nil>(object)) {
-    return false;
-  } else if (std::holds_alternative<bool>(object)) {
-    return std::get<bool>(object);
-  } else {
-    return true;
-  }
-}
-
-bool AstInterpreter::IsEqual(const ObjectT &left, const ObjectT &right)
-{
-  if (std::holds_alternative<Nil>(left) && std::holds_alternative<Nil>(right)) {
-    return true;
-  } else if (std::holds_alternative<Nil>(left)) {
-    return false;
-  }
-
-  return left == right;
+  if (operand.IsNumber()) { return; }
+  const auto &token = ast_->TokenAt(op);
+  throw RuntimeError(token, fmt::format("Operand must be a number: {}", token.Lexeme()));
 }
 
-void AstInterpreter::CheckNumberOperand(const Token &op, const ObjectT &operand)
+void AstInterpreter::CheckNumberOperands(flat::TokenRef op, const Value &left, const Value &right) const
 {
-  if (std::holds_alternative<double>(operand)) { return; }
-  throw RuntimeError(op, fmt::format("Operand must be a number: {}", op.Lexeme()));
+  if (left.IsNumber() && right.IsNumber()) { return; }
+  throw RuntimeError(ast_->TokenAt(op), fmt::format("Operands must be numbers: {} {}", left, right));
 }
 
-void AstInterpreter::CheckNumberOperands(const Token &op, const ObjectT &left, const ObjectT &right)
+void AstInterpreter::Define(flat::TokenRef name, const Value &value)
 {
-  if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) { return; }
-  throw RuntimeError(op, fmt::format("Operands must be numbers: {} {}", left, right));
+  // Only globals are bound by name; everything the Resolver saw in a local scope gets the next slot.
+  if (environment_ == globals_) {
+    globals_->Define(ast_->TokenAt(name).Symbol(), value);
+  } else {
+    environment_->Define(value);
+  }
 }
 
-ObjectT AstInterpreter::Evaluate(const Expr &expr) { return std::visit(*this, expr); }
+Value AstInterpreter::Evaluate(const flat::Node *expr) { return flat::VisitExpr(expr, *this); }
 
-void AstInterpreter::Execute(const Stmt &stmt) { std::visit(*this, stmt); }
+void AstInterpreter::Execute(const flat::Node *stmt) { flat::VisitStmt(stmt, *this); }
 
-void AstInterpreter::ExecuteBlock(const std::vector<Stmt> &stmts, Environment environment)
+void AstInterpreter::ExecuteBlock(const FlatAst &ast,
+  const flat::Node *owner,
+  flat::NodeList statements,
+  Environment environment)
 {
   auto previous = environment_;
+  const auto *previous_ast = std::exchange(ast_, &ast);
   try {
     environment_ = std::make_shared<Environment>(std::move(environment));
-    for (const auto &stmt : stmts) { Execute(stmt); }
+    for (std::size_t i = 0; i < statements.count; ++i) { Execute(flat::Item(owner, statements, i)); }
   } catch (...) {
     environment_ = std::move(previous);
+    ast_ = previous_ast;
     throw;
   }
   environment_ = std::move(previous);
+  ast_ = previous_ast;
+}
+
+std::shared_ptr<const FlatAst> AstInterpreter::ParseLazyFunction(const LazyBody &lazy) const
+{
+  // Flattening copies out everything evaluation needs, so the nodes can go once the function is flat.
+  AstArena arena{};
+  auto errors = error_reporter_->ErrorCount();
+  Parser parser{ *lazy.tokens, arena, error_reporter_ };
+  auto function = parser.ParseLazyFunction(lazy);
+  if (!function) { throw function.Error(); }
+
+  std::vector<Stmt> statements{ std::move(*function) };
+  Resolver resolver{ error_reporter_ };
+  resolver.Resolve(statements);
+  if (error_reporter_->ErrorCount() != errors) { throw ParseError{}; }
+  Optimizer optimizer{ arena };
+  optimizer.InlineCallsTo(inline_functions_);
+  optimizer.Optimize(statements);
+  return std::make_shared<const FlatAst>(lazy.tokens->Text(), lazy.tokens->Base(), statements);
 }
 
-auto AstInterpreter::operator()(const expr::Unary &unary) -> ObjectT
+auto AstInterpreter::operator()(const flat::expr::Unary &unary, const flat::Node *node) -> Value
 {
-  auto right = Evaluate(*unary.right);
-  switch (unary.op.Type()) {
+  auto right = Evaluate(flat::Child(node, unary.right));
+  switch (unary.op.type) {
   case TokenType::MINUS:
     CheckNumberOperand(unary.op, right);
-    return -std::get<double>(right);
+    return Negate(right);
   case TokenType::BANG:
     return !IsTruthy(right);
   default:
@@ -77,40 +98,41 @@ auto AstInterpreter::operator()(const expr::Unary &unary) -> ObjectT
   }
 }
 
-auto AstInterpreter::operator()(const expr::Binary &binary) -> ObjectT
+auto AstInterpreter::operator()(const flat::expr::Binary &binary, const flat::Node *node) -> Value
 {
-  auto left = Evaluate(*binary.left);
-  auto right = Evaluate(*binary.right);
+  auto left = Evaluate(flat::Child(node, binary.left));
+  auto right = Evaluate(flat::Child(node, binary.right));
 
-  switch (binary.op.Type()) {
+  switch (binary.op.type) {
   case TokenType::MINUS:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) - std::get<double>(right);
+    return Subtract(left, right);
   case TokenType::SLASH:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) / std::get<double>(right);
+    return Divide(left, right);
   case TokenType::STAR:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) * std::get<double>(right);
+    return Multiply(left, right);
   case TokenType::PLUS:
-    if (std::holds_alternative<double>(left) && std::holds_alternative<double>(right)) {
-      return std::get<double>(left) + std::get<double>(right);
-    } else if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
-      return std::get<std::string>(left) + std::get<std::string>(right);
+    if (left.IsNumber() && right.IsNumber()) {
+      return Add(left, right);
+    } else if (left.IsString() && right.IsString()) {
+      return Value::String(left.AsString() + right.AsString());
     }
-    throw RuntimeError(binary.op, fmt::format("Operands must be two numbers or two strings: {} {}", left, right));
+    throw RuntimeError(
+      ast_->TokenAt(binary.op), fmt::format("Operands must be two numbers or two strings: {} {}", left, right));
   case TokenType::GREATER:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) > std::get<double>(right);
+    return CompareNumbers(left, right, std::greater{});
   case TokenType::GREATER_EQUAL:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) >= std::get<double>(right);
+    return CompareNumbers(left, right, std::greater_equal{});
   case TokenType::LESS:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) < std::get<double>(right);
+    return CompareNumbers(left, right, std::less{});
   case TokenType::LESS_EQUAL:
     CheckNumberOperands(binary.op, left, right);
-    return std::get<double>(left) <= std::get<double>(right);
+    return CompareNumbers(left, right, std::less_equal{});
   case TokenType::BANG_EQUAL:
     return !IsEqual(left, right);
   case TokenType::EQUAL_EQUAL:
@@ -120,122 +142,136 @@ auto AstInterpreter::operator()(const expr::Binary &binary) -> ObjectT
   }
 }
 
-auto AstInterpreter::operator()(const expr::Literal &literal) -> ObjectT
+auto AstInterpreter::operator()(const flat::expr::Literal &literal, [[maybe_unused]] const flat::Node *node) -> Value
 {
-  return std::visit(
-    [](auto &&arg) -> ObjectT {
-      using T = std::decay_t<decltype(arg)>;
-      if constexpr (std::is_same_v<T, Nil>) {
-        return ObjectT{ std::monostate{} };
-      } else {
-        return ObjectT{ arg };
-      }
-    },
-    literal.value);
+  return ast_->ConstantAt(literal.value);
 }
 
-auto AstInterpreter::operator()(const expr::Grouping &grouping) -> ObjectT { return Evaluate(*grouping.expression); }
+auto AstInterpreter::operator()(const flat::expr::Grouping &grouping, const flat::Node *node) -> Value
+{
+  return Evaluate(flat::Child(node, grouping.expression));
+}
 
-auto AstInterpreter::operator()(const expr::Variable &variable) -> ObjectT { return environment_->Get(variable.name); }
+auto AstInterpreter::operator()(const flat::expr::Variable &variable, [[maybe_unused]] const flat::Node *node) -> Value
+{
+  if (variable.slot.IsGlobal()) { return globals_->Get(ast_->TokenAt(variable.name)); }
+  return environment_->GetAt(variable.slot);
+}
 
-auto AstInterpreter::operator()(const expr::Assign &assign) -> ObjectT
+auto AstInterpreter::operator()(const flat::expr::Assign &assign, const flat::Node *node) -> Value
 {
-  auto value = Evaluate(*assign.value);
-  environment_->Assign(assign.name, value);
+  auto value = Evaluate(flat::Child(node, assign.value));
+  if (assign.slot.IsGlobal()) {
+    globals_->Assign(ast_->TokenAt(assign.name), value);
+  } else {
+    environment_->AssignAt(assign.slot, value);
+  }
   return value;
 }
 
-auto AstInterpreter::operator()(const expr::Logical &logical) -> ObjectT
+auto AstInterpreter::operator()(const flat::expr::Logical &logical, const flat::Node *node) -> Value
 {
-  auto left = Evaluate(*logical.left);
+  auto left = Evaluate(flat::Child(node, logical.left));
 
-  if (logical.op.Type() == TokenType::OR) {
+  if (logical.op.type == TokenType::OR) {
     if (IsTruthy(left)) { return left; }
   } else {
     if (!IsTruthy(left)) { return left; }
   }
 
-  return Evaluate(*logical.right);
+  return Evaluate(flat::Child(node, logical.right));
 }
 
-auto AstInterpreter::operator()(const expr::Call &call) -> ObjectT
+auto AstInterpreter::operator()(const flat::expr::Call &call, const flat::Node *node) -> Value
 {
-  auto callee = Evaluate(*call.callee);
+  auto callee = Evaluate(flat::Child(node, call.callee));
 
-  std::vector<ObjectT> arguments;
-  for (const auto &argument : call.arguments) { arguments.push_back(Evaluate(*argument)); }
-
-  if (!std::holds_alternative<LoxCallablePtr>(callee)) {
-    throw RuntimeError(call.paren, "Can only call functions and classes.");
+  std::vector<Value> arguments;
+  for (std::size_t i = 0; i < call.arguments.count; ++i) {
+    arguments.push_back(Evaluate(flat::Item(node, call.arguments, i)));
   }
 
-  auto function = std::get<LoxCallablePtr>(callee);
+  if (!callee.IsCallable()) { throw RuntimeError(ast_->TokenAt(call.paren), "Can only call functions and classes."); }
+
+  auto *function = callee.AsCallable();
   if (arguments.size() != function->Arity()) {
-    throw RuntimeError(
-      call.paren, fmt::format("Expected {} arguments but got {}.", function->Arity(), arguments.size()));
+    throw RuntimeError(ast_->TokenAt(call.paren),
+      fmt::format("Expected {} arguments but got {}.", function->Arity(), arguments.size()));
   }
   return function->Call(this, arguments);
 }
 
-auto AstInterpreter::operator()(const stmt::Print &print) -> void
+auto AstInterpreter::operator()(const flat::stmt::Print &print, const flat::Node *node) -> void
 {
-  auto value = Evaluate(*print.expression);
+  auto value = Evaluate(flat::Child(node, print.expression));
   fmt::print("{}\n", value);
 }
 
-auto AstInterpreter::operator()(const stmt::While &stmt) -> void
+auto AstInterpreter::operator()(const flat::stmt::While &stmt, const flat::Node *node) -> void
 {
-  while (IsTruthy(Evaluate(*stmt.condition))) { Execute(*stmt.body); }
+  const auto *condition = flat::Child(node, stmt.condition);
+  const auto *body = flat::Child(node, stmt.body);
+  while (IsTruthy(Evaluate(condition))) { Execute(body); }
 }
 
-auto AstInterpreter::operator()(const stmt::Expression &expression) -> void { Evaluate(*expression.expression); }
+auto AstInterpreter::operator()(const flat::stmt::Expression &expression, const flat::Node *node) -> void
+{
+  Evaluate(flat::Child(node, expression.expression));
+}
 
-auto AstInterpreter::operator()(const stmt::Function &function) -> void
+auto AstInterpreter::operator()(const flat::stmt::Function &function, const flat::Node *node) -> void
 {
-  auto callable = std::make_shared<LoxFunction>(function, environment_);
-  environment_->Define(function.name.Lexeme(), callable);
+  Define(function.name, Value::Object(new LoxFunction{ ast_->shared_from_this(), node, environment_ }));
 }
 
-auto AstInterpreter::operator()(const stmt::Var &var) -> void
+auto AstInterpreter::operator()(const flat::stmt::Var &var, const flat::Node *node) -> void
 {
-  if (var.initializer) {
-    auto value = Evaluate(*var.initializer);
-    environment_->Define(var.name.Lexeme(), value);
+  if (var.initializer != 0) {
+    Define(var.name, Evaluate(flat::Child(node, var.initializer)));
   } else {
-    environment_->Define(var.name.Lexeme(), Nil{});
+    Define(var.name, Nil{});
   }
 }
 
-auto AstInterpreter::operator()(const stmt::If &stmt) -> void
+auto AstInterpreter::operator()(const flat::stmt::If &stmt, const flat::Node *node) -> void
 {
-  if (IsTruthy(Evaluate(*stmt.condition))) {
-    Execute(*stmt.then_branch);
-  } else if (!std::holds_alternative<stmt::Empty>(*stmt.else_branch)) {
-    Execute(*stmt.else_branch);
+  if (IsTruthy(Evaluate(flat::Child(node, stmt.condition)))) {
+    Execute(flat::Child(node, stmt.then_branch));
+  } else {
+    Execute(flat::Child(node, stmt.else_branch));
   }
 }
 
-auto AstInterpreter::operator()([[maybe_unused]] const stmt::Empty &empty) -> void {}
+auto AstInterpreter::operator()([[maybe_unused]] const flat::stmt::Empty &empty,
+  [[maybe_unused]] const flat::Node *node) -> void
+{}
 
-auto AstInterpreter::operator()(const stmt::Block &block) -> void
+auto AstInterpreter::operator()(const flat::stmt::Block &block, const flat::Node *node) -> void
 {
-  ExecuteBlock(block.statements, Environment{ environment_ });
+  ExecuteBlock(*ast_, node, block.statements, Environment{ environment_ });
 }
 
-auto AstInterpreter::operator()(const stmt::Return &stmt) -> void
+auto AstInterpreter::operator()(const flat::stmt::Return &stmt, const flat::Node *node) -> void
 {
-  ObjectT value = Nil{};
-  if (stmt.value) { value = Evaluate(*stmt.value); }
+  Value value = Nil{};
+  if (stmt.value != 0) { value = Evaluate(flat::Child(node, stmt.value)); }
 
   throw Return{ value };
 }
 
 
-void AstInterpreter::Interpret(const std::vector<Stmt> &stmts)
+void AstInterpreter::Interpret(std::shared_ptr<const FlatAst> ast)
 {
+  ast_ = ast.get();
   try {
-    for (const auto &stmt : stmts) { Execute(stmt); }
+    auto roots = ast->Roots();
+    for (std::size_t i = 0; i < roots.count; ++i) { Execute(flat::Item(ast->End(), roots, i)); }
   } catch (const RuntimeError &error) {
-    error_reporter_->ReportRuntime(error.GetToken().Line(), error.what());
+    error_reporter_->ReportRuntime(error.GetToken().Pos(), error.what());
+  } catch ([[maybe_unused]] const ParseError &error) {
+    // Reported where it was found.
+  } catch ([[maybe_unused]] const Return &stmt) {
+    // A return outside any function ends the script, as it does on the VM.
   }
+  ast_ = nullptr;
 }
@@ -3,12 +3,16 @@
 
 #include "Ast.h"
 #include "ClockCallable.h"
-#include "Common.h"
 #include "Environment.h"
 #include "ErrorReporter.h"
+#include "FlatAst.h"
+#include "Optimizer.h"
+#include "SymbolTable.h"
 #include "Token.h"
+#include "Value.h"
 
 #include <memory>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -17,38 +21,47 @@ class AstInterpreter
 public:
   explicit AstInterpreter(ErrorReporterPtr error_reporter) : error_reporter_{ std::move(error_reporter) }
   {
-    globals_->Define("clock", std::make_unique<ClockCallable>());
+    globals_->Define(SymbolTable::Global().Intern("clock"), Value::Object(new ClockCallable{}));
   }
-  void Interpret(const std::vector<Stmt> &stmts);
-  void ExecuteBlock(const std::vector<Stmt> &stmts, Environment environment);
-  auto operator()(const expr::Binary &binary) -> ObjectT;
-  auto operator()(const expr::Grouping &grouping) -> ObjectT;
-  auto operator()(const expr::Unary &unary) -> ObjectT;
-  auto operator()(const expr::Literal &literal) -> ObjectT;
-  auto operator()(const expr::Variable &variable) -> ObjectT;
-  auto operator()(const expr::Assign &assign) -> ObjectT;
-  auto operator()(const expr::Logical &assign) -> ObjectT;
-  auto operator()(const expr::Call &call) -> ObjectT;
-  auto operator()(const stmt::Expression &expression) -> void;
-  auto operator()(const stmt::Function &function) -> void;
-  auto operator()(const stmt::If &block) -> void;
-  auto operator()(const stmt::Print &print) -> void;
-  auto operator()(const stmt::While &print) -> void;
-  auto operator()(const stmt::Var &var) -> void;
-  auto operator()(const stmt::Empty &empty) -> void;
-  auto operator()(const stmt::Block &block) -> void;
-  auto operator()(const stmt::Return &stmt) -> void;
+  // Runs the top-level statements of `ast`. Functions the program defines hold on to it.
+  void Interpret(std::shared_ptr<const FlatAst> ast);
+  // Runs `statements`, a list belonging to `owner` in `ast`, in `environment`.
+  void ExecuteBlock(const FlatAst &ast, const flat::Node *owner, flat::NodeList statements, Environment environment);
+  // Parses and resolves the function `lazy` was made for, which is the one root of the result. Throws ParseError if
+  // that reports any errors.
+  [[nodiscard]] std::shared_ptr<const FlatAst> ParseLazyFunction(const LazyBody &lazy) const;
+  // Calls to `functions`, found by the Optimizer in the program being run, are inlined into bodies parsed later too.
+  void InlineCallsTo(Optimizer::InlineFunctions functions) { inline_functions_ = std::move(functions); }
+  auto operator()(const flat::expr::Binary &binary, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Grouping &grouping, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Unary &unary, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Literal &literal, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Variable &variable, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Assign &assign, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Logical &assign, const flat::Node *node) -> Value;
+  auto operator()(const flat::expr::Call &call, const flat::Node *node) -> Value;
+  auto operator()(const flat::stmt::Expression &expression, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::Function &function, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::If &block, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::Print &print, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::While &print, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::Var &var, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::Empty &empty, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::Block &block, const flat::Node *node) -> void;
+  auto operator()(const flat::stmt::Return &stmt, const flat::Node *node) -> void;
 
 private:
   ErrorReporterPtr error_reporter_;
   std::shared_ptr<Environment> globals_ = std::make_shared<Environment>();
   std::shared_ptr<Environment> environment_ = globals_;
-  void Execute(const Stmt &stmt);
-  auto Evaluate(const Expr &expr) -> ObjectT;
-  [[nodiscard]] static bool IsTruthy(const ObjectT &object);
-  [[nodiscard]] static bool IsEqual(const ObjectT &left, const ObjectT &right);
-  static void CheckNumberOperand(const Token &op, const ObjectT &operand);
-  static void CheckNumberOperands(const Token &op, const ObjectT &left, const ObjectT &right);
+  // The program the running code belongs to; tokens are looked up in it.
+  const FlatAst *ast_{ nullptr };
+  Optimizer::InlineFunctions inline_functions_{};
+  void Execute(const flat::Node *stmt);
+  void Define(flat::TokenRef name, const Value &value);
+  auto Evaluate(const flat::Node *expr) -> Value;
+  void CheckNumberOperand(flat::TokenRef op, const Value &operand) const;
+  void CheckNumberOperands(flat::TokenRef op, const Value &left, const Value &right) const;
 };
 
 
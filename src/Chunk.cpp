@@ -0,0 +1,118 @@
+#include "Chunk.h"
+#include "Value.h"
+#include "VmObjects.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+void Chunk::Write(std::uint8_t byte, SourcePos pos)
+{
+  if (positions_.empty() || positions_.back().pos != pos) { positions_.push_back({ code_.size(), pos }); }
+  code_.push_back(byte);
+}
+
+std::size_t Chunk::AddConstant(Value value)
+{
+  constants_.push_back(std::move(value));
+  return constants_.size() - 1;
+}
+
+std::size_t Chunk::AddFunction(std::shared_ptr<VmFunction> function)
+{
+  functions_.push_back(std::move(function));
+  return functions_.size() - 1;
+}
+
+SourcePos Chunk::PosAt(std::size_t offset) const
+{
+  auto run = std::upper_bound(positions_.begin(), positions_.end(), offset, [](std::size_t value, const PosRun &run) {
+    return value < run.start;
+  });
+  if (run == positions_.begin()) { return 0; }
+  return std::prev(run)->pos;
+}
+
+int Chunk::MaxStack(int entry) const
+{
+  // Every path reaching an instruction arrives with the same depth, so one visit per offset is enough.
+  std::vector<int> depth_at(code_.size(), -1);
+  std::vector<std::size_t> pending{ 0 };
+  depth_at[0] = entry;
+  auto max_depth = entry;
+
+  auto read_short = [this](std::size_t offset) {
+    return static_cast<std::size_t>((code_[offset] << 8) | code_[offset + 1]);
+  };
+  auto reach = [&](std::size_t offset, int depth) {
+    if (offset >= code_.size() || depth_at[offset] != -1) { return; }
+    depth_at[offset] = depth;
+    pending.push_back(offset);
+  };
+
+  while (!pending.empty()) {
+    auto offset = pending.back();
+    pending.pop_back();
+    auto depth = depth_at[offset];
+
+    std::size_t next = offset + 1;
+    switch (static_cast<OpCode>(code_[offset])) {
+    case OpCode::NIL:
+    case OpCode::TRUE:
+    case OpCode::FALSE: ++depth; break;
+    case OpCode::CONSTANT:
+    case OpCode::GET_GLOBAL:
+      ++depth;
+      next += 2;
+      break;
+    case OpCode::GET_LOCAL:
+    case OpCode::GET_UPVALUE:
+      ++depth;
+      next += 1;
+      break;
+    case OpCode::SET_LOCAL:
+    case OpCode::SET_UPVALUE: next += 1; break;
+    case OpCode::SET_GLOBAL: next += 2; break;
+    case OpCode::DEFINE_GLOBAL:
+      --depth;
+      next += 2;
+      break;
+    case OpCode::POP:
+    case OpCode::PRINT:
+    case OpCode::CLOSE_UPVALUE:
+    case OpCode::EQUAL:
+    case OpCode::NOT_EQUAL:
+    case OpCode::GREATER:
+    case OpCode::GREATER_EQUAL:
+    case OpCode::LESS:
+    case OpCode::LESS_EQUAL:
+    case OpCode::ADD:
+    case OpCode::SUBTRACT:
+    case OpCode::MULTIPLY:
+    case OpCode::DIVIDE: --depth; break;
+    case OpCode::NOT:
+    case OpCode::NEGATE: break;
+    case OpCode::JUMP: reach(offset + 3 + read_short(offset + 1), depth); continue;
+    case OpCode::JUMP_IF_FALSE:
+      reach(offset + 3 + read_short(offset + 1), depth);
+      next += 2;
+      break;
+    case OpCode::LOOP: reach(offset + 3 - read_short(offset + 1), depth); continue;
+    case OpCode::CALL:
+      // Callee and arguments collapse into the result.
+      depth -= code_[offset + 1];
+      next += 1;
+      break;
+    case OpCode::CLOSURE:
+      ++depth;
+      next += 2 + 2 * static_cast<std::size_t>(functions_[read_short(offset + 1)]->upvalue_count);
+      break;
+    case OpCode::RETURN: continue;
+    }
+    max_depth = std::max(max_depth, depth);
+    reach(next, depth);
+  }
+  return max_depth;
+}
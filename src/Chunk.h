@@ -0,0 +1,82 @@
+#ifndef LOX_CHUNK_H
+#define LOX_CHUNK_H
+
+#include "Source.h"
+#include "Value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Instruction set of the bytecode VM. Operands follow the opcode inline; 16 bit operands are stored big-endian.
+enum class OpCode : std::uint8_t {
+  CONSTANT,// u16 constant index
+  NIL,
+  TRUE,
+  FALSE,
+  POP,
+  GET_LOCAL,// u8 stack slot
+  SET_LOCAL,// u8 stack slot
+  GET_GLOBAL,// u16 name constant
+  DEFINE_GLOBAL,// u16 name constant
+  SET_GLOBAL,// u16 name constant
+  GET_UPVALUE,// u8 upvalue index
+  SET_UPVALUE,// u8 upvalue index
+  EQUAL,
+  NOT_EQUAL,
+  GREATER,
+  GREATER_EQUAL,
+  LESS,
+  LESS_EQUAL,
+  ADD,
+  SUBTRACT,
+  MULTIPLY,
+  DIVIDE,
+  NOT,
+  NEGATE,
+  PRINT,
+  JUMP,// u16 forward offset
+  JUMP_IF_FALSE,// u16 forward offset
+  LOOP,// u16 backward offset
+  CALL,// u8 argument count
+  CLOSURE,// u16 function index, then (u8 is_local, u8 index) per upvalue
+  CLOSE_UPVALUE,
+  RETURN,
+};
+
+struct VmFunction;
+
+class Chunk
+{
+public:
+  void Write(std::uint8_t byte, SourcePos pos);
+  void Write(OpCode op, SourcePos pos) { Write(static_cast<std::uint8_t>(op), pos); }
+  void Patch(std::size_t offset, std::uint8_t byte) { code_[offset] = byte; }
+
+  [[nodiscard]] std::size_t AddConstant(Value value);
+  [[nodiscard]] std::size_t AddFunction(std::shared_ptr<VmFunction> function);
+
+  [[nodiscard]] const std::vector<std::uint8_t> &Code() const { return code_; }
+  [[nodiscard]] const std::vector<Value> &Constants() const { return constants_; }
+  [[nodiscard]] const std::vector<std::shared_ptr<VmFunction>> &Functions() const { return functions_; }
+  [[nodiscard]] SourcePos PosAt(std::size_t offset) const;
+  // Deepest the value stack gets while running this chunk, counting the `entry` slots already in use on entry.
+  [[nodiscard]] int MaxStack(int entry) const;
+
+private:
+  // Run-length encoded position table: every instruction from `start` up to the next run was emitted for `pos`.
+  struct PosRun
+  {
+    std::size_t start;
+    SourcePos pos;
+  };
+
+  std::vector<std::uint8_t> code_;
+  std::vector<Value> constants_;
+  std::vector<std::shared_ptr<VmFunction>> functions_;
+  std::vector<PosRun> positions_;
+};
+
+
+#endif// LOX_CHUNK_H
@@ -1,8 +1,8 @@
 #ifndef LOX_CLOCKCALLABLE_H
 #define LOX_CLOCKCALLABLE_H
 
-#include "Common.h"
 #include "LoxCallable.h"
+#include "Value.h"
 
 #include <chrono>
 #include <vector>
@@ -12,8 +12,8 @@ class AstInterpreter;
 class ClockCallable : public LoxCallable
 {
 public:
-  ObjectT Call([[maybe_unused]] AstInterpreter *interpreter,
-    [[maybe_unused]] const std::vector<ObjectT> &arguments) override
+  Value Call([[maybe_unused]] AstInterpreter *interpreter,
+    [[maybe_unused]] const std::vector<Value> &arguments) override
   {
     auto millis =
       std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
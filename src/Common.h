@@ -2,39 +2,26 @@
 #define LOX_COMMON_H
 
 #include "fmt/core.h"
+#include <cstdint>
 #include <fmt/format.h>
-#include <memory>
-#include <string>
+#include <string_view>
 #include <type_traits>
 #include <variant>
 
-// Forward declaration
-struct LoxCallable;
-using LoxCallablePtr = std::shared_ptr<LoxCallable>;
-
-template<typename T, typename... Args> struct Concatenator;
-template<typename... Args0, typename... Args1> struct Concatenator<std::variant<Args0...>, Args1...>
-{
-  using type = std::variant<Args0..., Args1...>;
-};
-
 using Nil = std::monostate;
-using LiteralT = std::variant<Nil, bool, double, int, std::string>;
+// String literals refer into the scanned source, see Source.h.
+using LiteralT = std::variant<Nil, bool, double, int, std::string_view>;
 
-using ObjectT = Concatenator<LiteralT, LoxCallablePtr>::type;
-
-template<> struct fmt::formatter<ObjectT>
+template<> struct fmt::formatter<LiteralT>
 {
   template<typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
 
-  template<typename FormatContext> auto format(const ObjectT &literal, FormatContext &ctx)
+  template<typename FormatContext> auto format(const LiteralT &literal, FormatContext &ctx)
   {
     return std::visit(
       [&ctx](auto &&arg) {
         using T = std::decay_t<decltype(arg)>;
-        if constexpr (std::is_same_v<T, LoxCallablePtr>) {
-          return fmt::format_to(ctx.out(), "<Callable>");
-        } else if constexpr (std::is_same_v<T, Nil>) {
+        if constexpr (std::is_same_v<T, Nil>) {
           return fmt::format_to(ctx.out(), "nil");
         } else {
           return fmt::format_to(ctx.out(), "{}", arg);
@@ -44,4 +31,24 @@ template<> struct fmt::formatter<ObjectT>
   }
 };
 
+// Where the resolver found a variable: `depth` environments up from the current one, at `index` in its slots.
+// Variables the resolver could not find in any local scope are globals and are looked up by name instead.
+struct Slot
+{
+  int depth{ -1 };
+  int index{ -1 };
+
+  [[nodiscard]] bool IsGlobal() const { return depth < 0; }
+};
+
+class TokenStream;
+
+// A function body the parser skipped over, checking only that its brackets pair up, to be parsed in full the first
+// time the function is called. `function` is the index in `tokens` of the function's name.
+struct LazyBody
+{
+  const TokenStream *tokens;
+  std::uint32_t function;
+};
+
 #endif// LOX_COMMON_H
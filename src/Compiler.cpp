@@ -0,0 +1,434 @@
+#include "Compiler.h"
+#include "Ast.h"
+#include "Chunk.h"
+#include "Token.h"
+#include "VmObjects.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+constexpr int kMaxLocals = std::numeric_limits<std::uint8_t>::max() + 1;
+constexpr int kMaxUpvalues = std::numeric_limits<std::uint8_t>::max() + 1;
+}// namespace
+
+std::shared_ptr<VmFunction> Compiler::Compile(const std::vector<Stmt> &stmts)
+{
+  FunctionState script{ std::make_shared<VmFunction>(), nullptr };
+  script.function->name = "script";
+  // Slot zero holds the function being called.
+  script.locals.push_back({ kNoSymbol, 0, false });
+  current_ = &script;
+
+  for (const auto &stmt : stmts) { Compile(stmt); }
+  Emit(OpCode::NIL);
+  Emit(OpCode::RETURN);
+  script.function->max_stack = CurrentChunk().MaxStack(1);
+
+  current_ = nullptr;
+  return script.function;
+}
+
+void Compiler::Compile(const Stmt &stmt) { std::visit(*this, stmt); }
+
+void Compiler::Compile(const Expr &expr) { std::visit(*this, expr); }
+
+void Compiler::CompileFunction(const stmt::Function &function)
+{
+  FunctionState state{ std::make_shared<VmFunction>(), current_ };
+  state.function->name = function.name.Lexeme();
+  state.function->arity = static_cast<int>(function.params.size());
+  state.locals.push_back({ kNoSymbol, 0, false });
+  current_ = &state;
+
+  // Parameters and body share one scope, mirroring the tree-walking interpreter.
+  BeginScope();
+  for (const auto &param : function.params) {
+    DeclareLocal(param);
+    MarkInitialized();
+  }
+  for (const auto &stmt : function.body) { Compile(stmt); }
+  Emit(OpCode::NIL);
+  Emit(OpCode::RETURN);
+  state.function->max_stack = CurrentChunk().MaxStack(state.function->arity + 1);
+
+  current_ = state.enclosing;
+  state.function->upvalue_count = static_cast<int>(state.upvalues.size());
+
+  auto index = CurrentChunk().AddFunction(state.function);
+  if (index > std::numeric_limits<std::uint16_t>::max()) { Error("Too many functions in one chunk."); }
+  EmitShort(OpCode::CLOSURE, static_cast<std::uint16_t>(index));
+  for (const auto &upvalue : state.upvalues) {
+    Emit(static_cast<std::uint8_t>(upvalue.is_local ? 1 : 0));
+    Emit(upvalue.index);
+  }
+}
+
+void Compiler::Emit(OpCode op, std::uint8_t operand)
+{
+  Emit(op);
+  Emit(operand);
+}
+
+void Compiler::EmitShort(OpCode op, std::uint16_t operand)
+{
+  Emit(op);
+  Emit(static_cast<std::uint8_t>(operand >> 8));
+  Emit(static_cast<std::uint8_t>(operand & 0xff));
+}
+
+void Compiler::EmitConstant(Value value) { EmitShort(OpCode::CONSTANT, MakeConstant(std::move(value))); }
+
+std::size_t Compiler::EmitJump(OpCode op)
+{
+  EmitShort(op, 0xffff);
+  return CurrentChunk().Code().size() - 2;
+}
+
+void Compiler::PatchJump(std::size_t offset)
+{
+  // Jump over the two operand bytes themselves as well.
+  auto jump = CurrentChunk().Code().size() - offset - 2;
+  if (jump > std::numeric_limits<std::uint16_t>::max()) { Error("Too much code to jump over."); }
+
+  CurrentChunk().Patch(offset, static_cast<std::uint8_t>((jump >> 8) & 0xff));
+  CurrentChunk().Patch(offset + 1, static_cast<std::uint8_t>(jump & 0xff));
+}
+
+void Compiler::EmitLoop(std::size_t loop_start)
+{
+  auto offset = CurrentChunk().Code().size() - loop_start + 3;
+  if (offset > std::numeric_limits<std::uint16_t>::max()) { Error("Loop body too large."); }
+  EmitShort(OpCode::LOOP, static_cast<std::uint16_t>(offset));
+}
+
+std::uint16_t Compiler::MakeConstant(Value value)
+{
+  auto &constants = current_->constants;
+  std::optional<ConstantKey> key{};
+  if (value.IsInt()) {
+    key = value.AsInt();
+  } else if (value.IsDouble()) {
+    key = std::bit_cast<std::uint64_t>(value.AsDouble());
+  } else if (value.IsString()) {
+    key = std::string_view{ value.AsString() };
+  }
+  if (key) {
+    if (auto existing = constants.find(*key); existing != constants.end()) { return existing->second; }
+  }
+
+  // Past the limit nothing more is pooled; the chunk is never run, so the operand does not matter.
+  if (CurrentChunk().Constants().size() > std::numeric_limits<std::uint16_t>::max()) {
+    if (!std::exchange(current_->constants_full, true)) { Error("Too many constants in one chunk."); }
+    return 0;
+  }
+  auto index = static_cast<std::uint16_t>(CurrentChunk().AddConstant(std::move(value)));
+  // A string key views the text of the object the pool now holds.
+  if (key) { constants.emplace(*key, index); }
+  return index;
+}
+
+std::uint16_t Compiler::IdentifierConstant(const Token &name)
+{
+  // Globals are looked up by symbol id, so the constant holds the id rather than the name.
+  return MakeConstant(Value{ static_cast<int>(name.Symbol()) });
+}
+
+void Compiler::BeginScope() { ++current_->scope_depth; }
+
+void Compiler::EndScope()
+{
+  --current_->scope_depth;
+
+  auto &locals = current_->locals;
+  while (!locals.empty() && locals.back().depth > current_->scope_depth) {
+    Emit(locals.back().captured ? OpCode::CLOSE_UPVALUE : OpCode::POP);
+    locals.pop_back();
+  }
+}
+
+void Compiler::DeclareLocal(const Token &name)
+{
+  if (current_->locals.size() >= kMaxLocals) {
+    Error("Too many local variables in function.");
+    return;
+  }
+  // Depth -1 marks the local as declared but not yet initialized.
+  current_->locals.push_back({ name.Symbol(), -1, false });
+}
+
+void Compiler::MarkInitialized() { current_->locals.back().depth = current_->scope_depth; }
+
+int Compiler::ResolveLocal(const FunctionState &state, SymbolId name)
+{
+  for (auto i = static_cast<int>(state.locals.size()) - 1; i >= 0; --i) {
+    if (state.locals[i].name == name) { return i; }
+  }
+  return -1;
+}
+
+int Compiler::ResolveUpvalue(FunctionState &state, SymbolId name)
+{
+  if (state.enclosing == nullptr) { return -1; }
+
+  if (auto local = ResolveLocal(*state.enclosing, name); local != -1) {
+    state.enclosing->locals[local].captured = true;
+    return AddUpvalue(state, static_cast<std::uint8_t>(local), true);
+  }
+
+  if (auto upvalue = ResolveUpvalue(*state.enclosing, name); upvalue != -1) {
+    return AddUpvalue(state, static_cast<std::uint8_t>(upvalue), false);
+  }
+
+  return -1;
+}
+
+int Compiler::AddUpvalue(FunctionState &state, std::uint8_t index, bool is_local)
+{
+  for (std::size_t i = 0; i < state.upvalues.size(); ++i) {
+    if (state.upvalues[i].index == index && state.upvalues[i].is_local == is_local) { return static_cast<int>(i); }
+  }
+
+  if (state.upvalues.size() >= kMaxUpvalues) {
+    Error("Too many closure variables in function.");
+    return 0;
+  }
+
+  state.upvalues.push_back({ index, is_local });
+  return static_cast<int>(state.upvalues.size()) - 1;
+}
+
+void Compiler::NamedVariable(const Token &name, bool assign)
+{
+  pos_ = name.Pos();
+
+  if (auto local = ResolveLocal(*current_, name.Symbol()); local != -1) {
+    Emit(assign ? OpCode::SET_LOCAL : OpCode::GET_LOCAL, static_cast<std::uint8_t>(local));
+  } else if (auto upvalue = ResolveUpvalue(*current_, name.Symbol()); upvalue != -1) {
+    Emit(assign ? OpCode::SET_UPVALUE : OpCode::GET_UPVALUE, static_cast<std::uint8_t>(upvalue));
+  } else {
+    EmitShort(assign ? OpCode::SET_GLOBAL : OpCode::GET_GLOBAL, IdentifierConstant(name));
+  }
+}
+
+void Compiler::Error(std::string_view message) { error_reporter_->Report(pos_, "", message); }
+
+auto Compiler::operator()(const expr::Assign &assign) -> void
+{
+  Compile(*assign.value);
+  NamedVariable(assign.name, true);
+}
+
+auto Compiler::operator()(const expr::Binary &binary) -> void
+{
+  Compile(*binary.left);
+  Compile(*binary.right);
+
+  pos_ = binary.op.Pos();
+  switch (binary.op.Type()) {
+  case TokenType::MINUS:
+    Emit(OpCode::SUBTRACT);
+    break;
+  case TokenType::SLASH:
+    Emit(OpCode::DIVIDE);
+    break;
+  case TokenType::STAR:
+    Emit(OpCode::MULTIPLY);
+    break;
+  case TokenType::PLUS:
+    Emit(OpCode::ADD);
+    break;
+  case TokenType::GREATER:
+    Emit(OpCode::GREATER);
+    break;
+  case TokenType::GREATER_EQUAL:
+    Emit(OpCode::GREATER_EQUAL);
+    break;
+  case TokenType::LESS:
+    Emit(OpCode::LESS);
+    break;
+  case TokenType::LESS_EQUAL:
+    Emit(OpCode::LESS_EQUAL);
+    break;
+  case TokenType::BANG_EQUAL:
+    Emit(OpCode::NOT_EQUAL);
+    break;
+  case TokenType::EQUAL_EQUAL:
+    Emit(OpCode::EQUAL);
+    break;
+  default:
+    // The tree-walking interpreter evaluates unknown operators to nil.
+    Emit(OpCode::POP);
+    Emit(OpCode::POP);
+    Emit(OpCode::NIL);
+    break;
+  }
+}
+
+auto Compiler::operator()(const expr::Call &call) -> void
+{
+  Compile(*call.callee);
+  for (const auto &argument : call.arguments) { Compile(*argument); }
+
+  pos_ = call.paren.Pos();
+  Emit(OpCode::CALL, static_cast<std::uint8_t>(call.arguments.size()));
+}
+
+auto Compiler::operator()(const expr::Grouping &grouping) -> void { Compile(*grouping.expression); }
+
+auto Compiler::operator()(const expr::Literal &literal) -> void
+{
+  if (literal.value.IsNil()) {
+    Emit(OpCode::NIL);
+  } else if (literal.value.IsBool()) {
+    Emit(literal.value.AsBool() ? OpCode::TRUE : OpCode::FALSE);
+  } else {
+    EmitConstant(literal.value);
+  }
+}
+
+auto Compiler::operator()(const expr::Logical &logical) -> void
+{
+  Compile(*logical.left);
+
+  pos_ = logical.op.Pos();
+  if (logical.op.Type() == TokenType::OR) {
+    auto else_jump = EmitJump(OpCode::JUMP_IF_FALSE);
+    auto end_jump = EmitJump(OpCode::JUMP);
+    PatchJump(else_jump);
+    Emit(OpCode::POP);
+    Compile(*logical.right);
+    PatchJump(end_jump);
+  } else {
+    auto end_jump = EmitJump(OpCode::JUMP_IF_FALSE);
+    Emit(OpCode::POP);
+    Compile(*logical.right);
+    PatchJump(end_jump);
+  }
+}
+
+auto Compiler::operator()(const expr::Unary &unary) -> void
+{
+  Compile(*unary.right);
+
+  pos_ = unary.op.Pos();
+  switch (unary.op.Type()) {
+  case TokenType::MINUS:
+    Emit(OpCode::NEGATE);
+    break;
+  case TokenType::BANG:
+    Emit(OpCode::NOT);
+    break;
+  default:
+    Emit(OpCode::POP);
+    Emit(OpCode::NIL);
+    break;
+  }
+}
+
+auto Compiler::operator()(const expr::Variable &variable) -> void { NamedVariable(variable.name, false); }
+
+auto Compiler::operator()(const stmt::Expression &expression) -> void
+{
+  Compile(*expression.expression);
+  Emit(OpCode::POP);
+}
+
+auto Compiler::operator()(const stmt::Function &function) -> void
+{
+  pos_ = function.name.Pos();
+  if (current_->scope_depth > 0) {
+    // Initialized before the body is compiled, so the function can refer to itself.
+    DeclareLocal(function.name);
+    MarkInitialized();
+    CompileFunction(function);
+  } else {
+    CompileFunction(function);
+    EmitShort(OpCode::DEFINE_GLOBAL, IdentifierConstant(function.name));
+  }
+}
+
+auto Compiler::operator()(const stmt::If &stmt) -> void
+{
+  Compile(*stmt.condition);
+
+  auto then_jump = EmitJump(OpCode::JUMP_IF_FALSE);
+  Emit(OpCode::POP);
+  Compile(*stmt.then_branch);
+
+  auto else_jump = EmitJump(OpCode::JUMP);
+  PatchJump(then_jump);
+  Emit(OpCode::POP);
+  Compile(*stmt.else_branch);
+  PatchJump(else_jump);
+}
+
+auto Compiler::operator()(const stmt::Print &print) -> void
+{
+  pos_ = print.keyword.Pos();
+  Compile(*print.expression);
+  Emit(OpCode::PRINT);
+}
+
+auto Compiler::operator()(const stmt::Return &stmt) -> void
+{
+  pos_ = stmt.keyword.Pos();
+  if (stmt.value) {
+    Compile(*stmt.value);
+  } else {
+    Emit(OpCode::NIL);
+  }
+  Emit(OpCode::RETURN);
+}
+
+auto Compiler::operator()(const stmt::Var &var) -> void
+{
+  pos_ = var.name.Pos();
+  if (var.initializer) {
+    Compile(*var.initializer);
+  } else {
+    Emit(OpCode::NIL);
+  }
+
+  pos_ = var.name.Pos();
+  // Declared once the initializer is compiled, so that a name it reads is one from outside; its value is then already
+  // in the new local's stack slot.
+  if (current_->scope_depth > 0) {
+    DeclareLocal(var.name);
+    MarkInitialized();
+  } else {
+    EmitShort(OpCode::DEFINE_GLOBAL, IdentifierConstant(var.name));
+  }
+}
+
+auto Compiler::operator()(const stmt::While &stmt) -> void
+{
+  auto loop_start = CurrentChunk().Code().size();
+  Compile(*stmt.condition);
+
+  auto exit_jump = EmitJump(OpCode::JUMP_IF_FALSE);
+  Emit(OpCode::POP);
+  Compile(*stmt.body);
+  EmitLoop(loop_start);
+
+  PatchJump(exit_jump);
+  Emit(OpCode::POP);
+}
+
+auto Compiler::operator()([[maybe_unused]] const stmt::Empty &empty) -> void {}
+
+auto Compiler::operator()(const stmt::Block &block) -> void
+{
+  BeginScope();
+  for (const auto &stmt : block.statements) { Compile(stmt); }
+  EndScope();
+}
@@ -0,0 +1,113 @@
+#ifndef LOX_COMPILER_H
+#define LOX_COMPILER_H
+
+#include "Ast.h"
+#include "Chunk.h"
+#include "ErrorReporter.h"
+#include "SymbolTable.h"
+#include "Token.h"
+#include "VmObjects.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Translates a resolved program into bytecode for the Vm. Locals live in stack slots and captured variables
+// become upvalues, so scoping is decided here rather than through the Resolver's environment slots.
+class Compiler
+{
+public:
+  explicit Compiler(ErrorReporterPtr error_reporter) : error_reporter_{ std::move(error_reporter) } {}
+
+  [[nodiscard]] std::shared_ptr<VmFunction> Compile(const std::vector<Stmt> &stmts);
+  auto operator()(const expr::Assign &assign) -> void;
+  auto operator()(const expr::Binary &binary) -> void;
+  auto operator()(const expr::Call &call) -> void;
+  auto operator()(const expr::Grouping &grouping) -> void;
+  auto operator()(const expr::Literal &literal) -> void;
+  auto operator()(const expr::Logical &logical) -> void;
+  auto operator()(const expr::Unary &unary) -> void;
+  auto operator()(const expr::Variable &variable) -> void;
+  auto operator()(const stmt::Expression &expression) -> void;
+  auto operator()(const stmt::Function &function) -> void;
+  auto operator()(const stmt::If &stmt) -> void;
+  auto operator()(const stmt::Print &print) -> void;
+  auto operator()(const stmt::Return &stmt) -> void;
+  auto operator()(const stmt::Var &var) -> void;
+  auto operator()(const stmt::While &stmt) -> void;
+  auto operator()(const stmt::Empty &empty) -> void;
+  auto operator()(const stmt::Block &block) -> void;
+
+private:
+  struct Local
+  {
+    SymbolId name;
+    int depth;
+    bool captured;
+  };
+
+  struct UpvalueRef
+  {
+    std::uint8_t index;
+    bool is_local;
+  };
+
+  // What makes two constants the same: an int, the bits of a double, or the text of a string, which the pooled
+  // constant keeps alive.
+  using ConstantKey = std::variant<int, std::uint64_t, std::string_view>;
+
+  // Per-function compilation state, chained to the function being compiled around it.
+  struct FunctionState
+  {
+    std::shared_ptr<VmFunction> function;
+    FunctionState *enclosing;
+    std::vector<Local> locals{};
+    std::vector<UpvalueRef> upvalues{};
+    // Index of each constant in the chunk's pool, so that every value is pooled once.
+    std::unordered_map<ConstantKey, std::uint16_t> constants{};
+    // Set once the pool is full and that has been reported.
+    bool constants_full{ false };
+    int scope_depth{ 0 };
+  };
+
+  ErrorReporterPtr error_reporter_;
+  FunctionState *current_{ nullptr };
+  SourcePos pos_{ 0 };
+
+  void Compile(const Stmt &stmt);
+  void Compile(const Expr &expr);
+  void CompileFunction(const stmt::Function &function);
+
+  [[nodiscard]] Chunk &CurrentChunk() { return current_->function->chunk; }
+  void Emit(OpCode op) { CurrentChunk().Write(op, pos_); }
+  void Emit(std::uint8_t byte) { CurrentChunk().Write(byte, pos_); }
+  void Emit(OpCode op, std::uint8_t operand);
+  void EmitShort(OpCode op, std::uint16_t operand);
+  void EmitConstant(Value value);
+  [[nodiscard]] std::size_t EmitJump(OpCode op);
+  void PatchJump(std::size_t offset);
+  void EmitLoop(std::size_t loop_start);
+
+  [[nodiscard]] std::uint16_t MakeConstant(Value value);
+  [[nodiscard]] std::uint16_t IdentifierConstant(const Token &name);
+
+  void BeginScope();
+  void EndScope();
+  void DeclareLocal(const Token &name);
+  void MarkInitialized();
+  [[nodiscard]] static int ResolveLocal(const FunctionState &state, SymbolId name);
+  [[nodiscard]] int ResolveUpvalue(FunctionState &state, SymbolId name);
+  [[nodiscard]] int AddUpvalue(FunctionState &state, std::uint8_t index, bool is_local);
+  void NamedVariable(const Token &name, bool assign);
+
+  void Error(std::string_view message);
+};
+
+
+#endif// LOX_COMPILER_H
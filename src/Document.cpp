@@ -0,0 +1,200 @@
+#include "Document.h"
+#include "Ast.h"
+#include "Parser.h"
+#include "Scanner.h"
+#include "Token.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+// Moves every token of a reused declaration by `delta` bytes.
+struct ShiftPositions
+{
+  std::ptrdiff_t delta;
+
+  void Shift(Token &token) const { token = token.Shifted(delta); }
+  void Shift(const ExprPtr &expr) const
+  {
+    if (expr) { std::visit(*this, *expr); }
+  }
+  void Shift(const StmtPtr &stmt) const
+  {
+    if (stmt) { std::visit(*this, *stmt); }
+  }
+
+  auto operator()(expr::Assign &assign) const -> void
+  {
+    Shift(assign.name);
+    Shift(assign.value);
+  }
+  auto operator()(expr::Binary &binary) const -> void
+  {
+    Shift(binary.left);
+    Shift(binary.op);
+    Shift(binary.right);
+  }
+  auto operator()(expr::Call &call) const -> void
+  {
+    Shift(call.callee);
+    Shift(call.paren);
+    for (auto &argument : call.arguments) { Shift(argument); }
+  }
+  auto operator()(expr::Grouping &grouping) const -> void { Shift(grouping.expression); }
+  auto operator()(expr::Literal &) const -> void {}
+  auto operator()(expr::Logical &logical) const -> void
+  {
+    Shift(logical.left);
+    Shift(logical.op);
+    Shift(logical.right);
+  }
+  auto operator()(expr::Unary &unary) const -> void
+  {
+    Shift(unary.op);
+    Shift(unary.right);
+  }
+  auto operator()(expr::Variable &variable) const -> void { Shift(variable.name); }
+
+  auto operator()(stmt::Expression &expression) const -> void { Shift(expression.expression); }
+  auto operator()(stmt::Function &function) const -> void
+  {
+    Shift(function.name);
+    for (auto &param : function.params) { Shift(param); }
+    for (auto &stmt : function.body) { std::visit(*this, stmt); }
+  }
+  auto operator()(stmt::If &stmt) const -> void
+  {
+    Shift(stmt.condition);
+    Shift(stmt.then_branch);
+    Shift(stmt.else_branch);
+  }
+  auto operator()(stmt::Print &print) const -> void
+  {
+    Shift(print.keyword);
+    Shift(print.expression);
+  }
+  auto operator()(stmt::Return &stmt) const -> void
+  {
+    Shift(stmt.keyword);
+    Shift(stmt.value);
+  }
+  auto operator()(stmt::Var &var) const -> void
+  {
+    Shift(var.name);
+    Shift(var.initializer);
+  }
+  auto operator()(stmt::While &stmt) const -> void
+  {
+    Shift(stmt.condition);
+    Shift(stmt.body);
+  }
+  auto operator()(stmt::Empty &) const -> void {}
+  auto operator()(stmt::Block &block) const -> void
+  {
+    for (auto &stmt : block.statements) { std::visit(*this, stmt); }
+  }
+};
+
+// Replaces elements [first, last) of `into` with `with`.
+template<typename T> void Splice(std::vector<T> &into, std::size_t first, std::size_t last, std::vector<T> with)
+{
+  auto at = into.erase(into.begin() + first, into.begin() + last);
+  into.insert(at, std::make_move_iterator(with.begin()), std::make_move_iterator(with.end()));
+}
+}// namespace
+
+Document::Document(std::string text) : error_reporter_{ std::make_shared<ErrorReporter>(sources_) }
+{
+  Load(std::move(text));
+}
+
+Document::Document(std::string text, ErrorReporter::ErrorFn report_error)
+  : error_reporter_{ std::make_shared<ErrorReporter>(sources_, std::move(report_error)) }
+{
+  Load(std::move(text));
+}
+
+void Document::Load(std::string text)
+{
+  source_ = sources_.Replace(std::move(text));
+  Scanner scanner{ source_->Text(), error_reporter_, source_->Base() };
+  tokens_ = scanner.ScanTokens();
+
+  auto arena = std::make_shared<AstArena>();
+  Parser parser{ tokens_, *arena, error_reporter_ };
+  while (!parser.IsAtEnd()) {
+    starts_.push_back(parser.Position());
+    statements_.push_back(parser.ParseDeclaration());
+  }
+  parsed_from_.assign(statements_.size(), { source_, arena });
+}
+
+Document::Stats Document::Apply(const TextEdit &edit)
+{
+  auto old_text = Text();
+  if (edit.offset > old_text.size() || edit.removed > old_text.size() - edit.offset) {
+    throw std::out_of_range("Edit reaches past the end of the document.");
+  }
+
+  std::string text{};
+  text.reserve(old_text.size() - edit.removed + edit.inserted.size());
+  text.append(old_text.substr(0, edit.offset))
+    .append(edit.inserted)
+    .append(old_text.substr(edit.offset + edit.removed));
+  auto source = sources_.Replace(std::move(text));
+
+  Scanner scanner{ source->Text(), error_reporter_, source->Base() };
+  auto rescanned = scanner.Rescan(std::move(tokens_), edit);
+  auto token_shift = static_cast<std::ptrdiff_t>(rescanned.new_end) - static_cast<std::ptrdiff_t>(rescanned.old_end);
+  auto pos_shift = static_cast<std::ptrdiff_t>(edit.inserted.size()) - static_cast<std::ptrdiff_t>(edit.removed);
+
+  // Parse again from the declaration holding the first damaged token. When that token is where a declaration starts,
+  // the one before it goes too: where it ended was decided by looking at that token, as with `if (a) b;` and `else`.
+  std::size_t first = std::upper_bound(starts_.begin(), starts_.end(), rescanned.first) - starts_.begin();
+  if (first > 0) { --first; }
+  if (first > 0 && starts_[first] == rescanned.first) { --first; }
+  // Old declarations from `resume` on start after the damage. Parsing stops at the first of them it lands on, since
+  // from there on it would only produce them again.
+  std::size_t resume = std::lower_bound(starts_.begin(), starts_.end(), rescanned.old_end) - starts_.begin();
+  auto moved_start = [&](std::size_t i) { return static_cast<std::ptrdiff_t>(starts_[i]) + token_shift; };
+
+  // A fresh arena for each edit, so nodes of declarations that were parsed again go once nothing uses their arena.
+  auto arena = std::make_shared<AstArena>();
+  Parser parser{ rescanned.tokens, *arena, error_reporter_ };
+  parser.Seek(starts_.empty() ? 0 : starts_[first]);
+  std::vector<Stmt> statements{};
+  std::vector<std::size_t> starts{};
+  while (true) {
+    if (parser.IsAtEnd()) {
+      resume = starts_.size();
+      break;
+    }
+    auto at = static_cast<std::ptrdiff_t>(parser.Position());
+    while (resume < starts_.size() && moved_start(resume) < at) { ++resume; }
+    if (resume < starts_.size() && moved_start(resume) == at) { break; }
+
+    starts.push_back(parser.Position());
+    statements.push_back(parser.ParseDeclaration());
+  }
+
+  if (pos_shift != 0) {
+    ShiftPositions shift{ pos_shift };
+    for (auto i = resume; i < statements_.size(); ++i) { std::visit(shift, statements_[i]); }
+  }
+  for (auto i = resume; i < starts_.size(); ++i) { starts_[i] = static_cast<std::size_t>(moved_start(i)); }
+
+  Stats stats{ rescanned.new_end - rescanned.first, statements.size() };
+  Splice(parsed_from_, first, resume, std::vector(statements.size(), Origin{ source, arena }));
+  Splice(starts_, first, resume, std::move(starts));
+  Splice(statements_, first, resume, std::move(statements));
+  tokens_ = std::move(rescanned.tokens);
+  source_ = std::move(source);
+  return stats;
+}
@@ -0,0 +1,68 @@
+#ifndef LOX_DOCUMENT_H
+#define LOX_DOCUMENT_H
+
+#include "Ast.h"
+#include "AstArena.h"
+#include "ErrorReporter.h"
+#include "Source.h"
+#include "TokenStream.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Tokens and top-level declarations of a script that is being edited, as in an editor or language server. Apply
+// updates both after an edit by scanning again only the damaged tokens and parsing again only the top-level
+// declarations that contain them; the statements come out the same as a full parse of the new text would give.
+//
+// Reused declarations are not copied. Those after the edit have their positions shifted, and the lexemes of all of
+// them keep pointing at the version of the text they were parsed from. That text and the arena their nodes were
+// parsed into are kept alive for as long as they are.
+class Document
+{
+public:
+  explicit Document(std::string text);
+  Document(std::string text, ErrorReporter::ErrorFn report_error);
+
+  Document(const Document &) = delete;
+  Document &operator=(const Document &) = delete;
+
+  // How much of the document the last Apply went over again.
+  struct Stats
+  {
+    std::size_t tokens_rescanned;
+    std::size_t declarations_reparsed;
+  };
+
+  // Throws std::out_of_range if the edit reaches past the end of the text. Errors are reported for the rescanned
+  // tokens and re-parsed declarations only.
+  Stats Apply(const TextEdit &edit);
+
+  [[nodiscard]] std::string_view Text() const { return source_->Text(); }
+  [[nodiscard]] const TokenStream &Tokens() const { return tokens_; }
+  [[nodiscard]] const std::vector<Stmt> &Statements() const { return statements_; }
+  [[nodiscard]] const SourceMap &Sources() const { return sources_; }
+
+private:
+  SourceMap sources_;
+  ErrorReporterPtr error_reporter_;
+  std::shared_ptr<const Source> source_;
+  TokenStream tokens_;
+  // What a declaration's lexemes and nodes live in.
+  struct Origin
+  {
+    std::shared_ptr<const Source> source;
+    std::shared_ptr<AstArena> arena;
+  };
+
+  // One entry per top-level declaration: the statement, the index of its first token, and the parse it came from.
+  std::vector<Stmt> statements_;
+  std::vector<std::size_t> starts_;
+  std::vector<Origin> parsed_from_;
+
+  void Load(std::string text);
+};
+
+#endif// LOX_DOCUMENT_H
@@ -1,26 +1,23 @@
 #include "Environment.h"
-#include "Common.h"
 #include "Errors.h"
 #include "Token.h"
+#include "Value.h"
 
 #include <fmt/core.h>
-#include <string>
 
-void Environment::Define(const std::string &name, const ObjectT &value) { values_[name] = value; }
-
-ObjectT Environment::Get(const Token &name) const
+Value Environment::Get(const Token &name) const
 {
-  if (values_.contains(name.Lexeme())) { return values_.at(name.Lexeme()); }
+  if (const auto *value = values_.Find(name.Symbol())) { return *value; }
 
   if (enclosing_) { return enclosing_->Get(name); }
 
   throw RuntimeError(name, fmt::format("Undefined variable '{}'.", name.Lexeme()));
 }
 
-void Environment::Assign(const Token &name, const ObjectT &value)
+void Environment::Assign(const Token &name, const Value &value)
 {
-  if (values_.contains(name.Lexeme())) {
-    values_[name.Lexeme()] = value;
+  if (auto *binding = values_.Find(name.Symbol())) {
+    *binding = value;
     return;
   }
 
@@ -30,4 +27,18 @@ void Environment::Assign(const Token &name, const ObjectT &value)
   }
 
   throw RuntimeError(name, fmt::format("Undefined variable '{}'.", name.Lexeme()));
-}
\ No newline at end of file
+}
+
+const Environment *Environment::Ancestor(int depth) const
+{
+  const auto *environment = this;
+  for (int i = 0; i < depth; ++i) { environment = environment->enclosing_.get(); }
+  return environment;
+}
+
+Environment *Environment::Ancestor(int depth)
+{
+  auto *environment = this;
+  for (int i = 0; i < depth; ++i) { environment = environment->enclosing_.get(); }
+  return environment;
+}
@@ -1,13 +1,13 @@
 #ifndef LOX_ENVIRONMENT_H
 #define LOX_ENVIRONMENT_H
 
-#include "Common.h"
+#include "SymbolTable.h"
 #include "Token.h"
+#include "Value.h"
 
 #include <memory>
-#include <string>
-#include <unordered_map>
 #include <utility>
+#include <vector>
 
 class Environment
 {
@@ -15,13 +15,23 @@ public:
   Environment() = default;
   explicit Environment(std::shared_ptr<Environment> enclosing) : enclosing_{ std::move(enclosing) } {}
 
-  void Define(const std::string &name, const ObjectT &value);
-  [[nodiscard]] ObjectT Get(const Token &name) const;
-  void Assign(const Token &name, const ObjectT &value);
+  // Named bindings, used for globals.
+  void Define(SymbolId name, const Value &value) { values_.InsertOrAssign(name, value); }
+  [[nodiscard]] Value Get(const Token &name) const;
+  void Assign(const Token &name, const Value &value);
+
+  // Slot bindings, used for locals. Slots are handed out in declaration order, matching the Resolver.
+  void Define(const Value &value) { slots_.push_back(value); }
+  [[nodiscard]] Value GetAt(const Slot &slot) const { return Ancestor(slot.depth)->slots_[slot.index]; }
+  void AssignAt(const Slot &slot, const Value &value) { Ancestor(slot.depth)->slots_[slot.index] = value; }
 
 private:
-  std::unordered_map<std::string, ObjectT> values_;
+  SymbolMap<Value> values_;
+  std::vector<Value> slots_;
   std::shared_ptr<Environment> enclosing_{ nullptr };
+
+  [[nodiscard]] const Environment *Ancestor(int depth) const;
+  [[nodiscard]] Environment *Ancestor(int depth);
 };
 
 #endif// LOX_ENVIRONMENT_H
@@ -1,18 +1,24 @@
 #ifndef LOX_ERRORREPORTER_H
 #define LOX_ERRORREPORTER_H
 
+#include "Source.h"
+
 #include <cassert>
+#include <cstddef>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <string_view>
 #include <utility>
 
+// Errors are raised with a SourcePos; the line shown to the user is looked up in `sources` only at that point.
 class ErrorReporter
 {
+public:
   using ErrorFn = std::function<void(int, std::string_view, std::string_view)>;
   using RuntimeErrorFn = std::function<void(int, std::string_view)>;
 
+private:
   static void DefaultErrorReporter(int line, std::string_view where, std::string_view message)
   {
     std::cerr << "[line " << line << "] Error" << where << ": " << message << std::endl;
@@ -23,16 +29,32 @@ class ErrorReporter
   }
 
 public:
-  ErrorReporter() = default;
-  explicit ErrorReporter(ErrorFn report_error, RuntimeErrorFn runtime_report_error)
-    : report_error_{ std::move(report_error) }, runtime_report_error_{ std::move(runtime_report_error) }
+  explicit ErrorReporter(const SourceMap &sources) : sources_{ &sources } {}
+  explicit ErrorReporter(const SourceMap &sources, ErrorFn report_error)
+    : sources_{ &sources }, report_error_{ std::move(report_error) }
   {}
-  void Report(int line, std::string_view where, std::string_view message) const { report_error_(line, where, message); }
-  void ReportRuntime(int line, std::string_view message) const { runtime_report_error_(line, message); }
+  explicit ErrorReporter(const SourceMap &sources, ErrorFn report_error, RuntimeErrorFn runtime_report_error)
+    : sources_{ &sources }, report_error_{ std::move(report_error) },
+      runtime_report_error_{ std::move(runtime_report_error) }
+  {}
+  void Report(SourcePos pos, std::string_view where, std::string_view message) const
+  {
+    ++errors_;
+    report_error_(sources_->Line(pos), where, message);
+  }
+  void ReportRuntime(SourcePos pos, std::string_view message) const
+  {
+    runtime_report_error_(sources_->Line(pos), message);
+  }
+
+  // Static errors reported so far.
+  [[nodiscard]] std::size_t ErrorCount() const { return errors_; }
 
 private:
+  const SourceMap *sources_;
   ErrorFn report_error_{ DefaultErrorReporter };
   RuntimeErrorFn runtime_report_error_{ DefaultRuntimeErrorReporter };
+  mutable std::size_t errors_{ 0 };
 };
 
 using ErrorReporterPtr = std::shared_ptr<ErrorReporter>;
@@ -19,10 +19,10 @@ private:
 };
 
 
-class ParseError : public std::runtime_error
+// A syntax error that has been reported already. The parser returns it instead of throwing, see Parser::Parsed; a call
+// whose lazily parsed body turns out to have one throws it, see AstInterpreter::ParseLazyFunction.
+struct ParseError
 {
-public:
-  ParseError(std::string_view message) : std::runtime_error{ message.data() } {}
 };
 
 
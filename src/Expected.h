@@ -0,0 +1,39 @@
+#ifndef LOX_EXPECTED_H
+#define LOX_EXPECTED_H
+
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+// The error half of an Expected, for returning one: `return Unexpected{ error };`.
+template<typename E> struct Unexpected
+{
+  E error;
+};
+
+// Either a T or the E that explains why there is none, along the lines of C++23's std::expected. Used where failure is
+// common enough that throwing would be too slow, such as parse errors in machine-generated input.
+template<typename T, typename E> class Expected
+{
+public:
+  template<typename U = T>
+    requires std::is_convertible_v<U &&, T>
+  Expected(U &&value) : storage_{ std::in_place_index<0>, std::forward<U>(value) }
+  {}
+  Expected(Unexpected<E> unexpected) : storage_{ std::in_place_index<1>, std::move(unexpected.error) } {}
+
+  [[nodiscard]] bool HasValue() const { return storage_.index() == 0; }
+  explicit operator bool() const { return HasValue(); }
+
+  [[nodiscard]] T &operator*() { return *std::get_if<0>(&storage_); }
+  [[nodiscard]] const T &operator*() const { return *std::get_if<0>(&storage_); }
+  [[nodiscard]] T *operator->() { return std::get_if<0>(&storage_); }
+  [[nodiscard]] const T *operator->() const { return std::get_if<0>(&storage_); }
+
+  [[nodiscard]] const E &Error() const { return *std::get_if<1>(&storage_); }
+
+private:
+  std::variant<T, E> storage_;
+};
+
+#endif// LOX_EXPECTED_H
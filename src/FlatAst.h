@@ -0,0 +1,511 @@
+#ifndef LOX_FLAT_AST_H
+#define LOX_FLAT_AST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "Ast.h"
+#include "Common.h"
+#include "Source.h"
+#include "SymbolTable.h"
+#include "Token.h"
+#include "Value.h"
+
+// The same AST laid out in one buffer: every node is a fixed-size Node, written after all of its children (post-order),
+// so the nodes of a function body are one contiguous run ending at the function. Children are found by counting back
+// from their parent instead of following a pointer; lists go through a run of Link nodes placed just before it.
+namespace flat {
+// Distance back from a node to one of its children; 0 means there is none.
+using Offset = std::uint32_t;
+// Index of a value, see FlatAst::ConstantAt.
+using Constant = std::uint32_t;
+// A token, kept for error messages and global names (see FlatAst::TokenAt), with the one thing evaluation needs from it
+// inline.
+struct TokenRef {
+    std::uint32_t index;
+    TokenType type;
+    // What would otherwise be padding, spelled out so that every byte of a node written to disk is determined.
+    std::uint8_t reserved[3]{};
+};
+// `count` tokens kept from index `first` on.
+struct TokenList {
+    std::uint32_t first;
+    std::uint32_t count;
+};
+// One more than the index of a function body that was skipped, see FlatAst::LazyAt; 0 means it was parsed.
+using Lazy = std::uint32_t;
+// `count` consecutive Links, the first of them `first` nodes back.
+struct NodeList {
+    Offset first;
+    std::uint32_t count;
+};
+
+inline constexpr std::uint32_t kNoSymbolIndex = ~std::uint32_t{0};
+// How a FlatAst keeps a token: where its lexeme is, counted from the start of the program's text, and which of the
+// program's symbols it names, if any. Nothing in it depends on where the program was loaded.
+struct TokenRecord {
+    std::uint32_t offset;
+    std::uint32_t length;
+    std::uint32_t symbol;
+    TokenType type;
+    std::uint8_t reserved[3]{};
+};
+static_assert(std::has_unique_object_representations_v<TokenRecord>);
+
+enum class Kind : std::uint8_t { ASSIGN, BINARY, CALL, GROUPING, LITERAL, LOGICAL, UNARY, VARIABLE, EXPRESSION, FUNCTION, IF, PRINT, RETURN, VAR, WHILE, EMPTY, BLOCK, LINK };
+
+namespace expr {
+struct Assign {
+    TokenRef name;
+    Offset value;
+    Slot slot;
+};
+
+struct Binary {
+    Offset left;
+    TokenRef op;
+    Offset right;
+};
+
+struct Call {
+    Offset callee;
+    TokenRef paren;
+    NodeList arguments;
+};
+
+struct Grouping {
+    Offset expression;
+};
+
+struct Literal {
+    Constant value;
+};
+
+struct Logical {
+    Offset left;
+    TokenRef op;
+    Offset right;
+};
+
+struct Unary {
+    TokenRef op;
+    Offset right;
+};
+
+struct Variable {
+    TokenRef name;
+    Slot slot;
+};
+
+} // namespace expr
+namespace stmt {
+struct Expression {
+    Offset expression;
+};
+
+struct Function {
+    TokenRef name;
+    TokenList params;
+    NodeList body;
+    Lazy lazy;
+};
+
+struct If {
+    Offset condition;
+    Offset then_branch;
+    Offset else_branch;
+};
+
+struct Print {
+    TokenRef keyword;
+    Offset expression;
+};
+
+struct Return {
+    TokenRef keyword;
+    Offset value;
+};
+
+struct Var {
+    TokenRef name;
+    Offset initializer;
+};
+
+struct While {
+    Offset condition;
+    Offset body;
+};
+
+struct Empty {
+};
+
+struct Block {
+    NodeList statements;
+};
+
+} // namespace stmt
+// One item of a NodeList.
+struct Link {
+    Offset node;
+};
+
+template <typename T> inline constexpr Kind kKindOf = Kind::LINK;
+template <> inline constexpr Kind kKindOf<expr::Assign> = Kind::ASSIGN;
+template <> inline constexpr Kind kKindOf<expr::Binary> = Kind::BINARY;
+template <> inline constexpr Kind kKindOf<expr::Call> = Kind::CALL;
+template <> inline constexpr Kind kKindOf<expr::Grouping> = Kind::GROUPING;
+template <> inline constexpr Kind kKindOf<expr::Literal> = Kind::LITERAL;
+template <> inline constexpr Kind kKindOf<expr::Logical> = Kind::LOGICAL;
+template <> inline constexpr Kind kKindOf<expr::Unary> = Kind::UNARY;
+template <> inline constexpr Kind kKindOf<expr::Variable> = Kind::VARIABLE;
+template <> inline constexpr Kind kKindOf<stmt::Expression> = Kind::EXPRESSION;
+template <> inline constexpr Kind kKindOf<stmt::Function> = Kind::FUNCTION;
+template <> inline constexpr Kind kKindOf<stmt::If> = Kind::IF;
+template <> inline constexpr Kind kKindOf<stmt::Print> = Kind::PRINT;
+template <> inline constexpr Kind kKindOf<stmt::Return> = Kind::RETURN;
+template <> inline constexpr Kind kKindOf<stmt::Var> = Kind::VAR;
+template <> inline constexpr Kind kKindOf<stmt::While> = Kind::WHILE;
+template <> inline constexpr Kind kKindOf<stmt::Empty> = Kind::EMPTY;
+template <> inline constexpr Kind kKindOf<stmt::Block> = Kind::BLOCK;
+
+inline constexpr std::size_t kPayloadSize = std::max({ sizeof(expr::Assign), sizeof(expr::Binary), sizeof(expr::Call), sizeof(expr::Grouping), sizeof(expr::Literal), sizeof(expr::Logical), sizeof(expr::Unary), sizeof(expr::Variable), sizeof(stmt::Expression), sizeof(stmt::Function), sizeof(stmt::If), sizeof(stmt::Print), sizeof(stmt::Return), sizeof(stmt::Var), sizeof(stmt::While), sizeof(stmt::Empty), sizeof(stmt::Block), sizeof(Link) });
+static_assert(std::has_unique_object_representations_v<expr::Assign> && alignof(expr::Assign) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Binary> && alignof(expr::Binary) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Call> && alignof(expr::Call) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Grouping> && alignof(expr::Grouping) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Literal> && alignof(expr::Literal) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Logical> && alignof(expr::Logical) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Unary> && alignof(expr::Unary) <= 4);
+static_assert(std::has_unique_object_representations_v<expr::Variable> && alignof(expr::Variable) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::Expression> && alignof(stmt::Expression) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::Function> && alignof(stmt::Function) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::If> && alignof(stmt::If) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::Print> && alignof(stmt::Print) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::Return> && alignof(stmt::Return) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::Var> && alignof(stmt::Var) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::While> && alignof(stmt::While) <= 4);
+static_assert(std::is_empty_v<stmt::Empty> && alignof(stmt::Empty) <= 4);
+static_assert(std::has_unique_object_representations_v<stmt::Block> && alignof(stmt::Block) <= 4);
+static_assert(std::has_unique_object_representations_v<Link> && alignof(Link) <= 4);
+
+struct Node {
+    Kind kind;
+    std::uint8_t reserved[3];
+    alignas(4) std::byte payload[kPayloadSize];
+
+    template <typename T> static Node Of(const T &fields)
+    {
+        // Zeroed first, so the bytes of a payload shorter than the largest are determined too.
+        Node node{};
+        node.kind = kKindOf<T>;
+        new (node.payload) T(fields);
+        return node;
+    }
+
+    template <typename T> [[nodiscard]] const T &As() const
+    {
+        return *std::launder(reinterpret_cast<const T *>(payload));
+    }
+};
+static_assert(std::has_unique_object_representations_v<Node>);
+
+// The child `offset` nodes back from `node`, or nullptr for offset 0.
+inline const Node *Child(const Node *node, Offset offset) { return offset == 0 ? nullptr : node - offset; }
+
+// Every table a program in flat form is made of. Nodes and tokens hold offsets and indices only, so they can be used
+// wherever they lie in memory (see AstCache); constants, symbols and lazy bodies belong to the running process.
+struct Tables {
+    std::span<const Node> nodes;
+    NodeList roots;
+    std::span<const Value> constants;
+    std::span<const TokenRecord> tokens;
+    // The SymbolId of each symbol a TokenRecord can name.
+    std::span<const SymbolId> symbols;
+    std::span<const LazyBody> lazy_bodies;
+};
+
+// Changes whenever the node definitions do, so encodings from an older build are not mistaken for current ones.
+inline constexpr std::uint64_t kLayoutHash = 0x0f5fff1e483998e2;
+
+// Item `i` of `list`, which belongs to `node`.
+inline const Node *Item(const Node *node, NodeList list, std::size_t i)
+{
+    const auto *link = node - list.first + i;
+    return link - link->As<Link>().node;
+}
+
+// Calls `visitor` with the fields of `node`, which must be an Expr, and `node` itself.
+template <typename Visitor> decltype(auto) VisitExpr(const Node *node, Visitor &&visitor)
+{
+    switch (node->kind) {
+    case Kind::ASSIGN:
+        return visitor(node->As<expr::Assign>(), node);
+    case Kind::BINARY:
+        return visitor(node->As<expr::Binary>(), node);
+    case Kind::CALL:
+        return visitor(node->As<expr::Call>(), node);
+    case Kind::GROUPING:
+        return visitor(node->As<expr::Grouping>(), node);
+    case Kind::LITERAL:
+        return visitor(node->As<expr::Literal>(), node);
+    case Kind::LOGICAL:
+        return visitor(node->As<expr::Logical>(), node);
+    case Kind::UNARY:
+        return visitor(node->As<expr::Unary>(), node);
+    case Kind::VARIABLE:
+        return visitor(node->As<expr::Variable>(), node);
+    default:
+        break;
+    }
+    throw std::logic_error{"not an Expr"};
+}
+
+// Calls `visitor` with the fields of `node`, which must be a Stmt, and `node` itself.
+template <typename Visitor> decltype(auto) VisitStmt(const Node *node, Visitor &&visitor)
+{
+    switch (node->kind) {
+    case Kind::EXPRESSION:
+        return visitor(node->As<stmt::Expression>(), node);
+    case Kind::FUNCTION:
+        return visitor(node->As<stmt::Function>(), node);
+    case Kind::IF:
+        return visitor(node->As<stmt::If>(), node);
+    case Kind::PRINT:
+        return visitor(node->As<stmt::Print>(), node);
+    case Kind::RETURN:
+        return visitor(node->As<stmt::Return>(), node);
+    case Kind::VAR:
+        return visitor(node->As<stmt::Var>(), node);
+    case Kind::WHILE:
+        return visitor(node->As<stmt::While>(), node);
+    case Kind::EMPTY:
+        return visitor(node->As<stmt::Empty>(), node);
+    case Kind::BLOCK:
+        return visitor(node->As<stmt::Block>(), node);
+    default:
+        break;
+    }
+    throw std::logic_error{"not a Stmt"};
+}
+
+} // namespace flat
+
+// A program in flat form. Functions defined by it keep it alive, see LoxFunction.
+class FlatAst : public std::enable_shared_from_this<FlatAst>
+{
+public:
+    // Flattens `stmts`, whose tokens all lie in `text`, the text of a Source that starts at `base`.
+    FlatAst(std::string_view text, SourcePos base, std::span<const Stmt> stmts) : text_{ text }, base_{ base }
+    {
+        auto first = EmitList(stmts);
+        auto roots = List(first, stmts.size());
+        pending_ = {};
+        symbol_indices_ = {};
+        tables_ = { nodes_, roots, constants_, tokens_, symbols_, lazy_bodies_ };
+    }
+    // A program flattened from `text` before, whose tables lie in memory that `storage` keeps alive.
+    FlatAst(std::string_view text, SourcePos base, const flat::Tables &tables, std::shared_ptr<const void> storage)
+        : text_{ text }, base_{ base }, tables_{ tables }, storage_{ std::move(storage) }
+    {}
+
+    FlatAst(const FlatAst &) = delete;
+    FlatAst &operator=(const FlatAst &) = delete;
+
+    [[nodiscard]] const flat::Tables &Tables() const { return tables_; }
+    [[nodiscard]] std::span<const flat::Node> Nodes() const { return tables_.nodes; }
+    // The top-level statements, as a list belonging to the end of Nodes.
+    [[nodiscard]] flat::NodeList Roots() const { return tables_.roots; }
+    [[nodiscard]] const flat::Node *End() const { return tables_.nodes.data() + tables_.nodes.size(); }
+    [[nodiscard]] const Value &ConstantAt(flat::Constant constant) const { return tables_.constants[constant]; }
+    [[nodiscard]] Token TokenAt(flat::TokenRef ref) const
+    {
+        const auto &record = tables_.tokens[ref.index];
+        auto symbol = record.symbol == flat::kNoSymbolIndex ? kNoSymbol : tables_.symbols[record.symbol];
+        return { record.type, text_.substr(record.offset, record.length), Nil{}, base_ + record.offset, symbol };
+    }
+    [[nodiscard]] const LazyBody &LazyAt(flat::Lazy lazy) const { return tables_.lazy_bodies[lazy - 1]; }
+
+    std::uint32_t operator()(const ::expr::Assign &node)
+    {
+        auto value = Emit(node.value);
+        return Push(flat::expr::Assign{ Ref(node.name), Back(value), node.slot });
+    }
+    std::uint32_t operator()(const ::expr::Binary &node)
+    {
+        auto left = Emit(node.left);
+        auto right = Emit(node.right);
+        return Push(flat::expr::Binary{ Back(left), Ref(node.op), Back(right) });
+    }
+    std::uint32_t operator()(const ::expr::Call &node)
+    {
+        auto callee = Emit(node.callee);
+        auto arguments = EmitList(node.arguments);
+        return Push(flat::expr::Call{ Back(callee), Ref(node.paren), List(arguments, node.arguments.size()) });
+    }
+    std::uint32_t operator()(const ::expr::Grouping &node)
+    {
+        auto expression = Emit(node.expression);
+        return Push(flat::expr::Grouping{ Back(expression) });
+    }
+    std::uint32_t operator()(const ::expr::Literal &node)
+    {
+        return Push(flat::expr::Literal{ Intern(node.value) });
+    }
+    std::uint32_t operator()(const ::expr::Logical &node)
+    {
+        auto left = Emit(node.left);
+        auto right = Emit(node.right);
+        return Push(flat::expr::Logical{ Back(left), Ref(node.op), Back(right) });
+    }
+    std::uint32_t operator()(const ::expr::Unary &node)
+    {
+        auto right = Emit(node.right);
+        return Push(flat::expr::Unary{ Ref(node.op), Back(right) });
+    }
+    std::uint32_t operator()(const ::expr::Variable &node)
+    {
+        return Push(flat::expr::Variable{ Ref(node.name), node.slot });
+    }
+    std::uint32_t operator()(const ::stmt::Expression &node)
+    {
+        auto expression = Emit(node.expression);
+        return Push(flat::stmt::Expression{ Back(expression) });
+    }
+    std::uint32_t operator()(const ::stmt::Function &node)
+    {
+        auto body = EmitList(node.body);
+        return Push(flat::stmt::Function{ Ref(node.name), Tokens(node.params), List(body, node.body.size()), Defer(node.lazy) });
+    }
+    std::uint32_t operator()(const ::stmt::If &node)
+    {
+        auto condition = Emit(node.condition);
+        auto then_branch = Emit(node.then_branch);
+        auto else_branch = Emit(node.else_branch);
+        return Push(flat::stmt::If{ Back(condition), Back(then_branch), Back(else_branch) });
+    }
+    std::uint32_t operator()(const ::stmt::Print &node)
+    {
+        auto expression = Emit(node.expression);
+        return Push(flat::stmt::Print{ Ref(node.keyword), Back(expression) });
+    }
+    std::uint32_t operator()(const ::stmt::Return &node)
+    {
+        auto value = Emit(node.value);
+        return Push(flat::stmt::Return{ Ref(node.keyword), Back(value) });
+    }
+    std::uint32_t operator()(const ::stmt::Var &node)
+    {
+        auto initializer = Emit(node.initializer);
+        return Push(flat::stmt::Var{ Ref(node.name), Back(initializer) });
+    }
+    std::uint32_t operator()(const ::stmt::While &node)
+    {
+        auto condition = Emit(node.condition);
+        auto body = Emit(node.body);
+        return Push(flat::stmt::While{ Back(condition), Back(body) });
+    }
+    std::uint32_t operator()(const ::stmt::Empty &)
+    {
+        return Push(flat::stmt::Empty{});
+    }
+    std::uint32_t operator()(const ::stmt::Block &node)
+    {
+        auto statements = EmitList(node.statements);
+        return Push(flat::stmt::Block{ List(statements, node.statements.size()) });
+    }
+
+private:
+    static constexpr std::uint32_t kNone = ~std::uint32_t{0};
+
+    std::string_view text_;
+    SourcePos base_;
+    flat::Tables tables_{};
+    std::shared_ptr<const void> storage_;
+    // The tables of a program flattened here, while it is being flattened and after.
+    std::vector<flat::Node> nodes_;
+    std::vector<Value> constants_;
+    std::vector<flat::TokenRecord> tokens_;
+    std::vector<SymbolId> symbols_;
+    std::vector<LazyBody> lazy_bodies_;
+    // Index in symbols_ of each SymbolId met so far.
+    std::vector<std::uint32_t> symbol_indices_;
+    // Roots of the lists being emitted, innermost last.
+    std::vector<std::uint32_t> pending_;
+
+    [[nodiscard]] std::uint32_t Size() const { return static_cast<std::uint32_t>(nodes_.size()); }
+
+    std::uint32_t Emit(ExprPtr expr) { return expr ? std::visit(*this, *expr) : kNone; }
+    std::uint32_t Emit(StmtPtr stmt) { return stmt ? std::visit(*this, *stmt) : kNone; }
+    std::uint32_t Emit(const Stmt &stmt) { return std::visit(*this, stmt); }
+
+    // Emits every item and then their Links; returns the index of the first Link.
+    template <typename T> std::uint32_t EmitList(std::span<T> items)
+    {
+        auto base = pending_.size();
+        for (auto &item : items) { pending_.push_back(Emit(item)); }
+        auto first = Size();
+        for (auto i = base; i < pending_.size(); ++i) { Push(flat::Link{ Size() - pending_[i] }); }
+        pending_.resize(base);
+        return items.empty() ? kNone : first;
+    }
+
+    template <typename T> std::uint32_t Push(const T &fields)
+    {
+        nodes_.push_back(flat::Node::Of(fields));
+        return Size() - 1;
+    }
+
+    // Offset from the node about to be pushed back to `index`.
+    [[nodiscard]] flat::Offset Back(std::uint32_t index) const { return index == kNone ? 0 : Size() - index; }
+    [[nodiscard]] flat::NodeList List(std::uint32_t first, std::size_t count) const
+    {
+        return { Back(first), static_cast<std::uint32_t>(count) };
+    }
+    void Record(const Token &token)
+    {
+        auto symbol = flat::kNoSymbolIndex;
+        if (token.Symbol() != kNoSymbol) {
+            auto id = Index(token.Symbol());
+            if (id >= symbol_indices_.size()) { symbol_indices_.resize(id + 1, flat::kNoSymbolIndex); }
+            if (symbol_indices_[id] == flat::kNoSymbolIndex) {
+                symbol_indices_[id] = static_cast<std::uint32_t>(symbols_.size());
+                symbols_.push_back(token.Symbol());
+            }
+            symbol = symbol_indices_[id];
+        }
+        auto length = static_cast<std::uint32_t>(token.Lexeme().size());
+        tokens_.push_back({ token.Pos() - base_, length, symbol, token.Type() });
+    }
+    flat::TokenRef Ref(const Token &token)
+    {
+        Record(token);
+        return { static_cast<std::uint32_t>(tokens_.size() - 1), token.Type() };
+    }
+    flat::TokenList Tokens(std::span<const Token> tokens)
+    {
+        auto first = static_cast<std::uint32_t>(tokens_.size());
+        for (const auto &token : tokens) { Record(token); }
+        return { first, static_cast<std::uint32_t>(tokens.size()) };
+    }
+    flat::Constant Intern(const Value &value)
+    {
+        constants_.push_back(value);
+        return static_cast<flat::Constant>(constants_.size() - 1);
+    }
+    flat::Lazy Defer(const LazyBody *lazy)
+    {
+        if (lazy == nullptr) { return 0; }
+        lazy_bodies_.push_back(*lazy);
+        return static_cast<flat::Lazy>(lazy_bodies_.size());
+    }
+};
+
+#endif // LOX_FLAT_AST_H
@@ -0,0 +1,121 @@
+#ifndef LOX_KEYWORDS_H
+#define LOX_KEYWORDS_H
+
+#include "Token.h"
+#include <array>
+#include <cstddef>
+#include <magic_enum/magic_enum.hpp>
+#include <string_view>
+
+// Keyword recognition through a perfect hash that is built at compile time. The keyword spellings are not written out
+// anywhere: they are the lower-cased names of the TokenType values from AND through WHILE, so adding a keyword only
+// means adding its enumerator to that block.
+namespace keywords {
+
+inline constexpr auto kFirst = magic_enum::enum_integer(TokenType::AND);
+inline constexpr auto kLast = magic_enum::enum_integer(TokenType::WHILE);
+inline constexpr std::size_t kCount = kLast - kFirst + 1;
+inline constexpr std::size_t kMaxLength = 8;
+inline constexpr std::size_t kTableSize = 64;
+
+static_assert(magic_enum::enum_integer(TokenType::NUMBER) + 1 == kFirst
+                && kLast + 1 == magic_enum::enum_integer(TokenType::EOF_),
+  "keyword token types must be declared together between NUMBER and EOF_");
+
+struct Keyword
+{
+  std::array<char, kMaxLength> text{};
+  std::size_t length{ 0 };
+  TokenType type{ TokenType::IDENTIFIER };
+
+  [[nodiscard]] constexpr std::string_view View() const { return { text.data(), length }; }
+};
+
+constexpr Keyword Spelling(TokenType type)
+{
+  auto name = magic_enum::enum_name(type);
+  Keyword keyword{};
+  for (std::size_t i = 0; i < name.size() && i < kMaxLength; ++i) {
+    auto c = name[i];
+    keyword.text[i] = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+  keyword.length = name.size();
+  keyword.type = type;
+  return keyword;
+}
+
+constexpr std::array<Keyword, kCount> All()
+{
+  std::array<Keyword, kCount> all{};
+  for (std::size_t i = 0; i < kCount; ++i) {
+    all[i] = Spelling(static_cast<TokenType>(kFirst + i));
+    if (all[i].length > kMaxLength) { throw "keyword longer than kMaxLength"; }
+  }
+  return all;
+}
+
+inline constexpr auto kKeywords = All();
+
+// Only the length and the first and last characters are hashed, so a lookup reads at most three bytes before the
+// final comparison.
+constexpr std::size_t Hash(std::string_view text, unsigned multiplier)
+{
+  auto first = static_cast<unsigned char>(text.front());
+  auto last = static_cast<unsigned char>(text.back());
+  return (first * multiplier + last + text.size() * 3) % kTableSize;
+}
+
+// Smallest multiplier for which no two keywords share a slot.
+constexpr unsigned FindMultiplier()
+{
+  for (unsigned multiplier = 1; multiplier < 1024; ++multiplier) {
+    std::array<bool, kTableSize> used{};
+    bool collision = false;
+    for (const auto &keyword : kKeywords) {
+      auto slot = Hash(keyword.View(), multiplier);
+      collision = collision || used[slot];
+      used[slot] = true;
+    }
+    if (!collision) { return multiplier; }
+  }
+  throw "no collision-free multiplier for the keyword table";
+}
+
+inline constexpr unsigned kMultiplier = FindMultiplier();
+
+constexpr std::array<Keyword, kTableSize> BuildTable()
+{
+  std::array<Keyword, kTableSize> table{};
+  for (const auto &keyword : kKeywords) { table[Hash(keyword.View(), kMultiplier)] = keyword; }
+  return table;
+}
+
+inline constexpr auto kTable = BuildTable();
+
+// Token type for an identifier-shaped lexeme: its keyword type, or IDENTIFIER.
+[[nodiscard]] constexpr TokenType Lookup(std::string_view text)
+{
+  if (text.empty() || text.size() > kMaxLength) { return TokenType::IDENTIFIER; }
+  const auto &slot = kTable[Hash(text, kMultiplier)];
+  return slot.View() == text ? slot.type : TokenType::IDENTIFIER;
+}
+
+constexpr bool EveryKeywordRoundTrips()
+{
+  for (auto type : magic_enum::enum_values<TokenType>()) {
+    auto spelling = Spelling(type);
+    auto is_keyword = magic_enum::enum_integer(type) >= kFirst && magic_enum::enum_integer(type) <= kLast;
+    if (spelling.length <= kMaxLength && Lookup(spelling.View()) != (is_keyword ? type : TokenType::IDENTIFIER)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static_assert(EveryKeywordRoundTrips(), "keyword table disagrees with TokenType");
+static_assert(Lookup("fun") == TokenType::FUN && Lookup("funny") == TokenType::IDENTIFIER
+              && Lookup("While") == TokenType::IDENTIFIER);
+
+}// namespace keywords
+
+#endif// LOX_KEYWORDS_H
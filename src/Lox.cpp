@@ -1,26 +1,30 @@
-#include <fstream>
 #include <iostream>
-#include <sstream>
-#include <stdexcept>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 
 
+#include "AstCache.h"
+#include "Compiler.h"
+#include "FlatAst.h"
 #include "Lox.h"
+#include "Optimizer.h"
 #include "Parser.h"
+#include "Resolver.h"
 #include "Scanner.h"
 #include "fmt/core.h"
 
 bool Lox::RunFile(std::string_view path)
 {
-  std::ifstream file{ path.data() };
-  if (!file) { throw std::runtime_error(fmt::format("File not found: {}", path)); }
-
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  file.close();
-
-  Run(buffer.str());
+  const auto &source = sources_.AddFile(path);
+  // A cached program was scanned, parsed and resolved without errors when it was stored.
+  if (auto ast = cache_ && engine_ == Engine::AST ? cache_->Load(source, inline_budget_) : nullptr) {
+    interpreter_.Interpret(std::move(ast));
+  } else {
+    Run(source, true);
+  }
 
   return had_error_ || had_runtime_error_;
 }
@@ -32,21 +36,47 @@ void Lox::RunPrompt()
   while (true) {
     std::cout << "> " << std::flush;
     getline(std::cin, line);
-    Run(line);
+    Run(sources_.Add(std::move(line)));
     had_error_ = false;
   }
 }
 
-void Lox::Run(std::string_view source)
+void Lox::Run(const Source &source, bool from_file)
 {
-  Scanner scanner{ source, error_reporter_ };
-  auto tokens = scanner.ScanTokens();
-  Parser parser{ tokens, error_reporter_ };
-  auto statements = parser.Parse();
+  Scanner scanner{ source.Text(), error_reporter_, source.Base() };
+  const auto &tokens = *token_streams_.emplace_back(
+    std::make_unique<const TokenStream>(scanner.ScanTokensParallel(std::thread::hardware_concurrency())));
+  Parser parser{ tokens, arena_, error_reporter_ };
+  // The VM compiles every function before it runs anything, so only the tree-walker can put off parsing them; and a
+  // program goes into the cache whole.
+  auto cacheable = from_file && cache_ != nullptr;
+  parser.ParseFunctionsLazily(lazy_functions_ && engine_ == Engine::AST && !cacheable);
+  auto statements = parser.ParseParallel(std::thread::hardware_concurrency());
 
   if (HadError() || statements.empty()) { return; }
 
-  interpreter_.Interpret(statements);
+  Resolver resolver{ error_reporter_ };
+  resolver.Resolve(statements);
+
+  if (HadError()) { return; }
+
+  Optimizer optimizer{ arena_ };
+  optimizer.WholeProgram(from_file);
+  optimizer.InlineFunctionsUpTo(from_file ? inline_budget_ : 0);
+  optimizer.Optimize(statements);
+
+  if (engine_ == Engine::VM) {
+    Compiler compiler{ error_reporter_ };
+    auto script = compiler.Compile(statements);
+    if (HadError()) { return; }
+
+    vm_.Interpret(script);
+  } else {
+    auto ast = std::make_shared<const FlatAst>(source.Text(), source.Base(), statements);
+    if (cacheable) { cache_->Store(source, *ast, inline_budget_); }
+    interpreter_.InlineCallsTo(optimizer.Inlined());
+    interpreter_.Interpret(std::move(ast));
+  }
 }
 
 void Lox::Report(int line, std::string_view where, std::string_view message)
@@ -1,28 +1,66 @@
 #ifndef LOX_LOX_H
 #define LOX_LOX_H
 
+#include "AstArena.h"
+#include "AstCache.h"
 #include "AstInterpreter.h"
 #include "ErrorReporter.h"
+#include "Optimizer.h"
+#include "Source.h"
+#include "TokenStream.h"
+#include "Vm.h"
+#include <cstddef>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
+
+enum class Engine { AST, VM };
 
 class Lox
 {
 public:
+  // Scripts run from files are cached in `cache`, if there is one; see AstCache.
+  explicit Lox(Engine engine = Engine::AST, std::unique_ptr<AstCache> cache = nullptr)
+    : engine_{ engine }, cache_{ std::move(cache) }
+  {}
+
+  // Calls to functions that return an expression of at most `nodes` nodes are inlined; see Optimizer.
+  void InlineFunctionsUpTo(std::size_t nodes) { inline_budget_ = nodes; }
+
+  // Top-level function bodies are parsed on their first call; see Parser::ParseFunctionsLazily. Errors in a body are
+  // then only reported when it is called, after the statements before the call have run, and never if it is not.
+  void ParseFunctionsLazily(bool lazy) { lazy_functions_ = lazy; }
+
+  // Runs the script at `path`, or standard input when `path` is "-".
   bool RunFile(std::string_view path);
   [[noreturn]] void RunPrompt();
 
 private:
+  Engine engine_;
+  std::unique_ptr<AstCache> cache_;
+  std::size_t inline_budget_{ Optimizer::kDefaultInlineBudget };
+  bool lazy_functions_{ false };
   bool had_error_{ false };
   bool had_runtime_error_{ false };
+  // Functions defined by earlier REPL lines keep pointing into their text, their nodes and, until their bodies are
+  // parsed, their tokens, so every Source, the arena all lines are parsed into and every token stream live as long as
+  // Lox.
+  SourceMap sources_;
+  AstArena arena_;
+  std::vector<std::unique_ptr<const TokenStream>> token_streams_;
   ErrorReporterPtr error_reporter_{ std::make_shared<ErrorReporter>(
+    sources_,
     [this](int line, std::string_view where, std::string_view message) { Report(line, where, message); },
     [this](int line, std::string_view message) { ReportRuntime(line, message); }) };
   AstInterpreter interpreter_{ error_reporter_ };
+  Vm vm_{ error_reporter_ };
 
   void Report(int line, std::string_view where, std::string_view message);
   void ReportRuntime(int line, std::string_view message);
-  void Run(std::string_view source);
+  // A script run `from_file` is the whole program, and is stored in the cache if there is one.
+  void Run(const Source &source, bool from_file = false);
 
   [[nodiscard]] bool HadError() const;
 };
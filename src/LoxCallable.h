@@ -1,21 +1,24 @@
 #ifndef LOX_LOXCALLABLE_H
 #define LOX_LOXCALLABLE_H
 
-#include "AstInterpreter.h"
-#include "Common.h"
+#include "Object.h"
+#include "Value.h"
 
 #include <chrono>
 #include <vector>
 
-struct AstInterpreter;
+class AstInterpreter;
 
-class LoxCallable
+class LoxCallable : public Obj
 {
 public:
-  virtual ObjectT Call(AstInterpreter *interpreter, const std::vector<ObjectT> &arguments) = 0;
+  virtual Value Call(AstInterpreter *interpreter, const std::vector<Value> &arguments) = 0;
   virtual int Arity() const = 0;
 
-  virtual ~LoxCallable() = default;
+protected:
+  explicit LoxCallable(ObjType type = ObjType::CALLABLE) : Obj{ type } {}
 };
 
+inline LoxCallable *Value::AsCallable() const { return static_cast<LoxCallable *>(AsObj()); }
+
 #endif// LOX_LOXCALLABLE_H
\ No newline at end of file
@@ -1,11 +1,11 @@
 #ifndef LOX_LOXFUNCTION_H
 #define LOX_LOXFUNCTION_H
 
-#include "Ast.h"
 #include "AstInterpreter.h"
-#include "Common.h"
+#include "FlatAst.h"
 #include "LoxCallable.h"
 #include "Return.h"
+#include "Value.h"
 
 #include <memory>
 #include <vector>
@@ -13,18 +13,23 @@
 class LoxFunction : public LoxCallable
 {
 public:
-  LoxFunction(stmt::Function declaration, std::shared_ptr<Environment> closure)
-    : declaration_{ std::move(declaration) }, closure_{ std::move(closure) }
+  // `declaration` is a flat::stmt::Function node of `ast`.
+  LoxFunction(std::shared_ptr<const FlatAst> ast, const flat::Node *declaration, std::shared_ptr<Environment> closure)
+    : ast_{ std::move(ast) }, declaration_{ declaration }, closure_{ std::move(closure) }
   {}
-  ObjectT Call(AstInterpreter *interpreter, const std::vector<ObjectT> &arguments) override
+  Value Call(AstInterpreter *interpreter, const std::vector<Value> &arguments) override
   {
-    auto environment = std::make_shared<Environment>(closure_);
-    for (int i = 0; i < declaration_.params.size(); ++i) {
-      environment->Define(declaration_.params[i].Lexeme(), arguments.at(i));
+    // A body that was skipped is parsed now, and the function runs from the parsed copy from then on.
+    if (Declaration().lazy != 0) {
+      ast_ = interpreter->ParseLazyFunction(ast_->LazyAt(Declaration().lazy));
+      declaration_ = flat::Item(ast_->End(), ast_->Roots(), 0);
     }
 
+    auto environment = std::make_shared<Environment>(closure_);
+    for (const auto &argument : arguments) { environment->Define(argument); }
+
     try {
-      interpreter->ExecuteBlock(declaration_.body, *environment);
+      interpreter->ExecuteBlock(*ast_, declaration_, Declaration().body, *environment);
     } catch (const Return &return_value) {
       return return_value.GetValue();
     }
@@ -32,12 +37,15 @@ public:
     return Nil{};
   }
 
-  [[nodiscard]] int Arity() const override { return declaration_.params.size(); }
+  [[nodiscard]] int Arity() const override { return static_cast<int>(Declaration().params.count); }
 
 
 private:
-  stmt::Function declaration_;
+  std::shared_ptr<const FlatAst> ast_;
+  const flat::Node *declaration_;
   std::shared_ptr<Environment> closure_;
+
+  [[nodiscard]] const flat::stmt::Function &Declaration() const { return declaration_->As<flat::stmt::Function>(); }
 };
 
 #endif// LOX_LOXFUNCTION_H
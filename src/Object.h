@@ -0,0 +1,46 @@
+#ifndef LOX_OBJECT_H
+#define LOX_OBJECT_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+enum class ObjType : std::uint8_t { STRING, CALLABLE, VM_CLOSURE };
+
+// Base of every heap-allocated Lox value. Objects are reference counted intrusively by the Values that point at
+// them and delete themselves when the last reference goes away.
+class Obj
+{
+public:
+  Obj(const Obj &) = delete;
+  Obj &operator=(const Obj &) = delete;
+  virtual ~Obj() = default;
+
+  [[nodiscard]] ObjType Type() const { return type_; }
+
+  void Retain() { ++references_; }
+  void Release()
+  {
+    if (--references_ == 0) { delete this; }
+  }
+
+protected:
+  explicit Obj(ObjType type) : type_{ type } {}
+
+private:
+  std::uint32_t references_{ 0 };
+  ObjType type_;
+};
+
+class ObjString final : public Obj
+{
+public:
+  explicit ObjString(std::string value) : Obj{ ObjType::STRING }, value_{ std::move(value) } {}
+
+  [[nodiscard]] const std::string &Get() const { return value_; }
+
+private:
+  std::string value_;
+};
+
+#endif// LOX_OBJECT_H
@@ -0,0 +1,859 @@
+#include "Optimizer.h"
+#include "Ast.h"
+#include "SymbolTable.h"
+#include "Token.h"
+#include "TokenStream.h"
+#include "Value.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fmt/core.h>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+// The value of `left op right`, or nothing when the operation would fail at runtime.
+std::optional<Value> Fold(TokenType op, const Value &left, const Value &right)
+{
+  auto numbers = left.IsNumber() && right.IsNumber();
+  switch (op) {
+  case TokenType::MINUS:
+    if (numbers) { return Subtract(left, right); }
+    break;
+  case TokenType::SLASH:
+    if (numbers) { return Divide(left, right); }
+    break;
+  case TokenType::STAR:
+    if (numbers) { return Multiply(left, right); }
+    break;
+  case TokenType::PLUS:
+    if (numbers) { return Add(left, right); }
+    if (left.IsString() && right.IsString()) { return Value::String(left.AsString() + right.AsString()); }
+    break;
+  case TokenType::GREATER:
+    if (numbers) { return CompareNumbers(left, right, std::greater{}); }
+    break;
+  case TokenType::GREATER_EQUAL:
+    if (numbers) { return CompareNumbers(left, right, std::greater_equal{}); }
+    break;
+  case TokenType::LESS:
+    if (numbers) { return CompareNumbers(left, right, std::less{}); }
+    break;
+  case TokenType::LESS_EQUAL:
+    if (numbers) { return CompareNumbers(left, right, std::less_equal{}); }
+    break;
+  case TokenType::BANG_EQUAL:
+    return !IsEqual(left, right);
+  case TokenType::EQUAL_EQUAL:
+    return IsEqual(left, right);
+  default:
+    break;
+  }
+  return std::nullopt;
+}
+
+// Whether `expr` is computed from literals and the first `arity` slots of its function's scope alone, which are its
+// parameters, without calls or assignments.
+bool ReadsOnlyParameters(const Expr &expr, std::size_t arity)
+{
+  return std::visit(
+    [arity](const auto &node) -> bool {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, expr::Binary> || std::is_same_v<T, expr::Logical>) {
+        return ReadsOnlyParameters(*node.left, arity) && ReadsOnlyParameters(*node.right, arity);
+      } else if constexpr (std::is_same_v<T, expr::Grouping>) {
+        return ReadsOnlyParameters(*node.expression, arity);
+      } else if constexpr (std::is_same_v<T, expr::Unary>) {
+        return ReadsOnlyParameters(*node.right, arity);
+      } else if constexpr (std::is_same_v<T, expr::Variable>) {
+        return node.slot.depth == 0 && static_cast<std::size_t>(node.slot.index) < arity;
+      } else {
+        return std::is_same_v<T, expr::Literal>;
+      }
+    },
+    expr);
+}
+
+// Whether `expr` gives a number whenever it does not fail, whatever the variables it reads hold. Goes down the left
+// operands of a chain in a loop, since the chain can be as long as the parser allows.
+bool YieldsNumber(const Expr &expr)
+{
+  for (const auto *next = &expr;;) {
+    if (const auto *binary = std::get_if<expr::Binary>(next)) {
+      switch (binary->op.Type()) {
+      case TokenType::MINUS:
+      case TokenType::SLASH:
+      case TokenType::STAR:
+        return true;
+      case TokenType::PLUS:
+        // Adding to a number fails unless the other operand is one too.
+        if (YieldsNumber(*binary->right)) { return true; }
+        next = binary->left;
+        break;
+      default:
+        return false;
+      }
+    } else if (const auto *logical = std::get_if<expr::Logical>(next)) {
+      if (!YieldsNumber(*logical->right)) { return false; }
+      next = logical->left;
+    } else if (const auto *grouping = std::get_if<expr::Grouping>(next)) {
+      next = grouping->expression;
+    } else if (const auto *unary = std::get_if<expr::Unary>(next)) {
+      return unary->op.Type() == TokenType::MINUS;
+    } else if (const auto *literal = std::get_if<expr::Literal>(next)) {
+      return literal->value.IsNumber();
+    } else {
+      return false;
+    }
+  }
+}
+
+// The operator of a unary, binary or logical expression, and nullptr for anything else.
+const Token *Operator(const Expr &expr)
+{
+  return std::visit(
+    [](const auto &node) -> const Token * {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, expr::Binary> || std::is_same_v<T, expr::Logical>
+                    || std::is_same_v<T, expr::Unary>) {
+        return &node.op;
+      } else {
+        return nullptr;
+      }
+    },
+    expr);
+}
+
+// Calls `each` on every operand of `expr`, in the order they are evaluated.
+template<typename E, typename Each> void ForEachOperand(E &expr, const Each &each)
+{
+  std::visit(
+    [&each](auto &node) {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, expr::Assign>) {
+        each(node.value);
+      } else if constexpr (std::is_same_v<T, expr::Binary> || std::is_same_v<T, expr::Logical>) {
+        each(node.left);
+        each(node.right);
+      } else if constexpr (std::is_same_v<T, expr::Call>) {
+        each(node.callee);
+        for (auto &argument : node.arguments) { each(argument); }
+      } else if constexpr (std::is_same_v<T, expr::Grouping>) {
+        each(node.expression);
+      } else if constexpr (std::is_same_v<T, expr::Unary>) {
+        each(node.right);
+      }
+    },
+    expr);
+}
+
+// Calls `visit(node, scopes)` on `expr` and every expression in it, operands after the expression they belong to,
+// where `scopes` is the number of scopes opened around the node since the outermost call. Walks with a stack of its
+// own, as an expression can nest as deeply as the parser allows.
+template<typename Visit> void ForEachExpr(Expr &expr, int scopes, const Visit &visit)
+{
+  std::vector<Expr *> pending{ &expr };
+  while (!pending.empty()) {
+    auto *next = pending.back();
+    pending.pop_back();
+    visit(*next, scopes);
+    auto operands = pending.size();
+    ForEachOperand(*next, [&pending](Expr *operand) { pending.push_back(operand); });
+    std::reverse(pending.begin() + static_cast<std::ptrdiff_t>(operands), pending.end());
+  }
+}
+
+// The same for every expression in `stmt`, function bodies included.
+template<typename Visit> void ForEachExpr(Stmt &stmt, int scopes, const Visit &visit)
+{
+  std::visit(
+    [scopes, &visit](auto &node) {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, stmt::Expression> || std::is_same_v<T, stmt::Print>) {
+        ForEachExpr(*node.expression, scopes, visit);
+      } else if constexpr (std::is_same_v<T, stmt::Function>) {
+        for (auto &body : node.body) { ForEachExpr(body, scopes + 1, visit); }
+      } else if constexpr (std::is_same_v<T, stmt::If>) {
+        ForEachExpr(*node.condition, scopes, visit);
+        ForEachExpr(*node.then_branch, scopes, visit);
+        ForEachExpr(*node.else_branch, scopes, visit);
+      } else if constexpr (std::is_same_v<T, stmt::Return>) {
+        if (node.value != nullptr) { ForEachExpr(*node.value, scopes, visit); }
+      } else if constexpr (std::is_same_v<T, stmt::Var>) {
+        if (node.initializer != nullptr) { ForEachExpr(*node.initializer, scopes, visit); }
+      } else if constexpr (std::is_same_v<T, stmt::While>) {
+        ForEachExpr(*node.condition, scopes, visit);
+        ForEachExpr(*node.body, scopes, visit);
+      } else if constexpr (std::is_same_v<T, stmt::Block>) {
+        for (auto &statement : node.statements) { ForEachExpr(statement, scopes + 1, visit); }
+      }
+    },
+    stmt);
+}
+
+std::size_t CountNodes(const Stmt &stmt);
+
+std::size_t CountNodes(const Expr &expr)
+{
+  std::size_t count = 0;
+  std::vector<const Expr *> pending{ &expr };
+  while (!pending.empty()) {
+    const auto *next = pending.back();
+    pending.pop_back();
+    ++count;
+    ForEachOperand(*next, [&pending](const Expr *operand) { pending.push_back(operand); });
+  }
+  return count;
+}
+
+std::size_t CountNodes(std::span<const Stmt> stmts)
+{
+  std::size_t count = 0;
+  for (const auto &stmt : stmts) { count += CountNodes(stmt); }
+  return count;
+}
+
+std::size_t CountNodes(const Stmt &stmt)
+{
+  return 1 + std::visit(
+    [](const auto &node) -> std::size_t {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, stmt::Expression> || std::is_same_v<T, stmt::Print>) {
+        return CountNodes(*node.expression);
+      } else if constexpr (std::is_same_v<T, stmt::Function>) {
+        return CountNodes(node.body);
+      } else if constexpr (std::is_same_v<T, stmt::If>) {
+        return CountNodes(*node.condition) + CountNodes(*node.then_branch) + CountNodes(*node.else_branch);
+      } else if constexpr (std::is_same_v<T, stmt::Return>) {
+        return node.value != nullptr ? CountNodes(*node.value) : 0;
+      } else if constexpr (std::is_same_v<T, stmt::Var>) {
+        return node.initializer != nullptr ? CountNodes(*node.initializer) : 0;
+      } else if constexpr (std::is_same_v<T, stmt::While>) {
+        return CountNodes(*node.condition) + CountNodes(*node.body);
+      } else if constexpr (std::is_same_v<T, stmt::Block>) {
+        return CountNodes(node.statements);
+      } else {
+        return 0;
+      }
+    },
+    stmt);
+}
+}// namespace
+
+void Optimizer::Optimize(std::vector<Stmt> &stmts)
+{
+  removed_ = 0;
+  hoisted_ = 0;
+  for (auto pass : { Pass::FIND_ASSIGNMENTS, Pass::FOLD, Pass::FIND_REFERENCES, Pass::REMOVE_FUNCTIONS }) {
+    pass_ = pass;
+    stmts.resize(Walk(stmts).size());
+  }
+}
+
+std::span<Stmt> Optimizer::Walk(std::span<Stmt> stmts)
+{
+  switch (pass_) {
+  case Pass::FOLD: {
+    // Nothing after a return runs.
+    std::size_t end = 0;
+    while (end < stmts.size()) {
+      Optimize(stmts[end]);
+      if (std::holds_alternative<stmt::Return>(stmts[end++])) { break; }
+    }
+    return Compact(stmts, end);
+  }
+  case Pass::REMOVE_FUNCTIONS:
+    for (auto &stmt : stmts) { Optimize(stmt); }
+    return Compact(stmts, stmts.size());
+  default:
+    for (auto &stmt : stmts) { Optimize(stmt); }
+    return stmts;
+  }
+}
+
+std::span<Stmt> Optimizer::Compact(std::span<Stmt> stmts, std::size_t end)
+{
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < stmts.size(); ++i) {
+    if (i < end && !std::holds_alternative<stmt::Empty>(stmts[i])) {
+      stmts[kept++] = stmts[i];
+    } else {
+      removed_ += CountNodes(stmts[i]);
+    }
+  }
+  return stmts.first(kept);
+}
+
+void Optimizer::Optimize(Stmt &stmt)
+{
+  if (auto *replacement = std::visit(*this, stmt)) { stmt = *replacement; }
+}
+
+void Optimizer::Optimize(ExprPtr &expr)
+{
+  // Operands are visited before the expression they belong to, in the order they are evaluated, so that it sees them
+  // folded. The order is worked out with stacks rather than by recursion, since an operand chain can be as long as the
+  // parser allows: taking operands last to first, each node's slot goes into expr_order_ before those of its operands,
+  // and the slots are visited from the back. Inlining optimizes the calls it replaces while the visits are under way,
+  // so a walk only ever adds to expr_order_ past where the one it is nested in left off.
+  auto base = expr_order_.size();
+  expr_pending_.push_back(&expr);
+  while (!expr_pending_.empty()) {
+    auto *next = expr_pending_.back();
+    expr_pending_.pop_back();
+    expr_order_.push_back(next);
+    ForEachOperand(**next, [this](ExprPtr &operand) { expr_pending_.push_back(&operand); });
+  }
+  for (auto i = expr_order_.size(); i > base; --i) {
+    auto *slot = expr_order_[i - 1];
+    if (auto *replacement = std::visit(*this, **slot)) { *slot = replacement; }
+  }
+  expr_order_.resize(base);
+}
+
+const Optimizer::Declaration &Optimizer::Declared(const Slot &slot) const
+{
+  static const Declaration kGlobal{};
+  if (slot.IsGlobal()) { return kGlobal; }
+  return scopes_[scopes_.size() - 1 - static_cast<std::size_t>(slot.depth)][static_cast<std::size_t>(slot.index)];
+}
+
+void Optimizer::Declare(Declaration declaration)
+{
+  if (!scopes_.empty()) { scopes_.back().push_back(declaration); }
+}
+
+void Optimizer::DeclareGlobal(const Token &name)
+{
+  if (!declared_globals_.insert(name.Symbol()).second) { assigned_globals_.insert(name.Symbol()); }
+}
+
+void Optimizer::Reference(const Token &name, const Slot &slot)
+{
+  // A function that is only called by itself is still unused.
+  if (slot.IsGlobal()) {
+    if (enclosing_.empty() || enclosing_.front()->name.Symbol() != name.Symbol()) {
+      referenced_globals_.insert(name.Symbol());
+    }
+    return;
+  }
+  const auto *function = Declared(slot).function;
+  if (function != nullptr && std::find(enclosing_.begin(), enclosing_.end(), function) == enclosing_.end()) {
+    referenced_.insert(function);
+  }
+}
+
+void Optimizer::ScanLazyBody(const stmt::Function &function)
+{
+  // There are no nodes for a body that has not been parsed, so every name in it is taken to be a reference, and every
+  // name followed by `=` to be assigned.
+  const auto &tokens = *function.lazy->tokens;
+  std::size_t depth = 0;
+  for (std::size_t i = function.lazy->function + 1; i < tokens.Size(); ++i) {
+    auto type = tokens.Type(i);
+    if (type == TokenType::IDENTIFIER) {
+      auto symbol = tokens.Symbol(i);
+      if (pass_ == Pass::FIND_ASSIGNMENTS) {
+        if (i + 1 < tokens.Size() && tokens.Type(i + 1) == TokenType::EQUAL) {
+          assigned_globals_.insert(symbol);
+          non_number_globals_.insert(symbol);
+        }
+      } else if (symbol != function.name.Symbol()) {
+        referenced_globals_.insert(symbol);
+      }
+    } else if (type == TokenType::LEFT_BRACE) {
+      ++depth;
+    } else if (type == TokenType::RIGHT_BRACE && --depth == 0) {
+      break;
+    }
+  }
+}
+
+ExprPtr Optimizer::InlineValue(const stmt::Function &function) const
+{
+  if (function.body.size() != 1) { return nullptr; }
+  const auto *stmt = std::get_if<stmt::Return>(&function.body.front());
+  if (stmt == nullptr || stmt->value == nullptr) { return nullptr; }
+  if (CountNodes(*stmt->value) > inline_budget_ || !ReadsOnlyParameters(*stmt->value, function.params.size())) {
+    return nullptr;
+  }
+  return stmt->value;
+}
+
+const Optimizer::InlineFunction *Optimizer::FindInline(const expr::Call &call) const
+{
+  const auto *callee = std::get_if<expr::Variable>(call.callee);
+  if (callee == nullptr || !callee->slot.IsGlobal()) { return nullptr; }
+  for (const auto *functions : { &inline_functions_, program_functions_ }) {
+    if (functions == nullptr) { continue; }
+    if (auto function = functions->find(callee->name.Symbol()); function != functions->end()) {
+      return &function->second;
+    }
+  }
+  return nullptr;
+}
+
+ExprPtr Optimizer::Inline(const expr::Call &call)
+{
+  const auto *function = FindInline(call);
+  if (function == nullptr || function->arity != call.arguments.size()) { return nullptr; }
+  // Top-level code runs in order, so a function is defined by the time top-level code after it runs, and any function
+  // declared after it. One declared before it may be called before then.
+  if (!enclosing_.empty() && enclosing_.front()->name.Pos() < function->pos) { return nullptr; }
+  // Arguments are evaluated before the body, once each. The body neither calls nor assigns anything, so it is only
+  // safe to move into it the ones that cannot fail: literals and locals.
+  for (const auto *argument : call.arguments) {
+    const auto *variable = std::get_if<expr::Variable>(argument);
+    if (!std::holds_alternative<expr::Literal>(*argument) && (variable == nullptr || variable->slot.IsGlobal())) {
+      return nullptr;
+    }
+  }
+
+  auto inlined = Substitute(*function->value, call.arguments);
+  Optimize(inlined);
+  return inlined;
+}
+
+ExprPtr Optimizer::Substitute(const Expr &value, std::span<const ExprPtr> arguments)
+{
+  return std::visit(
+    [this, arguments](const auto &node) -> ExprPtr {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, expr::Variable>) {
+        return std::visit(
+          [this](const auto &argument) { return MakeExpr<std::decay_t<decltype(argument)>>(*arena_, argument); },
+          *arguments[static_cast<std::size_t>(node.slot.index)]);
+      } else if constexpr (std::is_same_v<T, expr::Binary> || std::is_same_v<T, expr::Logical>) {
+        return MakeExpr<T>(*arena_, Substitute(*node.left, arguments), node.op, Substitute(*node.right, arguments));
+      } else if constexpr (std::is_same_v<T, expr::Unary>) {
+        return MakeExpr<T>(*arena_, node.op, Substitute(*node.right, arguments));
+      } else if constexpr (std::is_same_v<T, expr::Grouping>) {
+        return Substitute(*node.expression, arguments);
+      } else {
+        return MakeExpr<T>(*arena_, node);
+      }
+    },
+    value);
+}
+
+bool Optimizer::IsUnused(const stmt::Function &function) const
+{
+  if (scopes_.empty()) { return whole_program_ && !referenced_globals_.contains(function.name.Symbol()); }
+  return !referenced_.contains(&function);
+}
+
+ExprPtr Optimizer::Literal(Value value) { return MakeExpr<expr::Literal>(*arena_, std::move(value)); }
+
+StmtPtr Optimizer::Hoist(stmt::While &loop)
+{
+  Loop found{};
+  auto find_effects = [this, &found](Expr &expr, int scopes) {
+    if (std::holds_alternative<expr::Call>(expr)) { found.calls = true; }
+    const auto *assign = std::get_if<expr::Assign>(&expr);
+    if (assign == nullptr) { return; }
+    if (assign->slot.IsGlobal()) {
+      found.assigned_globals.insert(assign->name.Symbol());
+    } else if (assign->slot.depth >= scopes) {
+      found.assigned.insert(&Declared({ assign->slot.depth - scopes, assign->slot.index }));
+    }
+  };
+  ForEachExpr(*loop.condition, 0, find_effects);
+  ForEachExpr(*loop.body, 0, find_effects);
+
+  FindInvariants(loop.condition, found, 0, true);
+  // The body runs only when the condition holds, so what is hoisted from it must not fail when it would not have run.
+  found.clean = false;
+  FindInvariants(*loop.body, found, 0);
+  if (found.invariants.empty()) { return nullptr; }
+
+  // The temporaries get a block of their own around the loop, which puts the locals outside it a scope further away.
+  auto shift = [](Expr &expr, int scopes) {
+    std::visit(
+      [scopes](auto &node) {
+        using T = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<T, expr::Assign> || std::is_same_v<T, expr::Variable>) {
+          if (node.slot.depth >= scopes) { ++node.slot.depth; }
+        }
+      },
+      expr);
+  };
+  ForEachExpr(*loop.condition, 0, shift);
+  ForEachExpr(*loop.body, 0, shift);
+
+  std::vector<Stmt> statements{};
+  for (auto [invariant, scopes] : found.invariants) {
+    auto *value = *invariant;
+    // Everything it reads is outside the loop, so from the block it is `scopes` fewer scopes away.
+    ForEachExpr(*value, 0, [scopes](Expr &expr, [[maybe_unused]] int depth) {
+      if (auto *variable = std::get_if<expr::Variable>(&expr); variable != nullptr && !variable->slot.IsGlobal()) {
+        variable->slot.depth -= scopes;
+      }
+    });
+    // Named so no identifier can refer to it. Runtime errors never name a local, so it borrows the operator's lexeme.
+    auto symbol = SymbolTable::Global().Intern(fmt::format("(invariant {})", hoisted_++));
+    const auto *op = Operator(*value);
+    Token name{ TokenType::IDENTIFIER, op->Lexeme(), Nil{}, op->Pos(), symbol };
+    *invariant = MakeExpr<expr::Variable>(*arena_, name, Slot{ scopes, static_cast<int>(statements.size()) });
+    statements.emplace_back(stmt::Var{ name, value });
+  }
+  statements.emplace_back(loop);
+  return MakeStmt<stmt::Block>(*arena_, arena_->Copy(std::span<const Stmt>{ statements }));
+}
+
+void Optimizer::FindInvariants(ExprPtr &expr, Loop &loop, int scopes, bool unconditional)
+{
+  auto classified = Classify(*expr, loop, scopes);
+  // Operands in the order they are evaluated, each followed by a second visit to its expression once they are done.
+  struct Visit
+  {
+    ExprPtr *expr;
+    bool unconditional;
+    bool operands_done;
+  };
+  std::vector<Visit> pending{ { &expr, unconditional, false } };
+  while (!pending.empty()) {
+    auto visit = pending.back();
+    pending.pop_back();
+    const auto &invariance = classified.at(*visit.expr);
+    if (visit.operands_done) {
+      loop.clean = loop.clean && invariance.safe;
+      continue;
+    }
+    if (invariance.invariant && Operator(**visit.expr) != nullptr
+        && (invariance.safe || (loop.clean && visit.unconditional))) {
+      loop.invariants.emplace_back(visit.expr, scopes);
+      continue;
+    }
+
+    pending.push_back({ visit.expr, visit.unconditional, true });
+    auto operands = pending.size();
+    const auto *logical = std::get_if<expr::Logical>(*visit.expr);
+    ForEachOperand(**visit.expr, [&pending, &visit, logical](ExprPtr &operand) {
+      // The right operand of a logical operator may not be evaluated.
+      auto runs = visit.unconditional && (logical == nullptr || &operand == &logical->left);
+      pending.push_back({ &operand, runs, false });
+    });
+    std::reverse(pending.begin() + static_cast<std::ptrdiff_t>(operands), pending.end());
+  }
+}
+
+void Optimizer::FindInvariants(Stmt &stmt, Loop &loop, int scopes)
+{
+  // Function bodies are left alone: they run when called, which may be after the loop.
+  std::visit(
+    [this, &loop, scopes](auto &node) {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, stmt::Expression> || std::is_same_v<T, stmt::Print>) {
+        FindInvariants(node.expression, loop, scopes, false);
+      } else if constexpr (std::is_same_v<T, stmt::If>) {
+        FindInvariants(node.condition, loop, scopes, false);
+        FindInvariants(*node.then_branch, loop, scopes);
+        FindInvariants(*node.else_branch, loop, scopes);
+      } else if constexpr (std::is_same_v<T, stmt::Return>) {
+        if (node.value != nullptr) { FindInvariants(node.value, loop, scopes, false); }
+      } else if constexpr (std::is_same_v<T, stmt::Var>) {
+        if (node.initializer != nullptr) { FindInvariants(node.initializer, loop, scopes, false); }
+      } else if constexpr (std::is_same_v<T, stmt::While>) {
+        FindInvariants(node.condition, loop, scopes, false);
+        FindInvariants(*node.body, loop, scopes);
+      } else if constexpr (std::is_same_v<T, stmt::Block>) {
+        for (auto &statement : node.statements) { FindInvariants(statement, loop, scopes + 1); }
+      }
+    },
+    stmt);
+}
+
+Optimizer::Invariances Optimizer::Classify(const Expr &expr, const Loop &loop, int scopes) const
+{
+  // Each node once, after its operands, so that the walk is linear and needs no recursion.
+  std::vector<const Expr *> order{};
+  std::vector<const Expr *> pending{ &expr };
+  while (!pending.empty()) {
+    const auto *next = pending.back();
+    pending.pop_back();
+    order.push_back(next);
+    ForEachOperand(*next, [&pending](const Expr *operand) { pending.push_back(operand); });
+  }
+  Invariances classified{};
+  classified.reserve(order.size());
+  for (auto node = order.rbegin(); node != order.rend(); ++node) {
+    classified.emplace(*node, Classify(**node, classified, loop, scopes));
+  }
+  return classified;
+}
+
+Optimizer::Invariance
+  Optimizer::Classify(const Expr &expr, const Invariances &operands, const Loop &loop, int scopes) const
+{
+  return std::visit(
+    [this, &operands, &loop, scopes](const auto &node) -> Invariance {
+      using T = std::decay_t<decltype(node)>;
+      if constexpr (std::is_same_v<T, expr::Literal>) {
+        return { true, true, node.value.IsNumber() };
+      } else if constexpr (std::is_same_v<T, expr::Variable>) {
+        if (node.slot.IsGlobal()) {
+          auto symbol = node.name.Symbol();
+          // Top-level code runs in order, so the globals declared before a top-level loop are defined in it.
+          auto defined = enclosing_.empty() && defined_globals_.contains(symbol);
+          auto number = whole_program_ && declared_globals_.contains(symbol) && !non_number_globals_.contains(symbol);
+          return { IsInvariant(symbol, loop), defined, number };
+        }
+        // Declared inside the loop.
+        if (node.slot.depth < scopes) { return { false, true, false }; }
+        const auto &declared = Declared({ node.slot.depth - scopes, node.slot.index });
+        auto number = declared.var != nullptr && !non_numbers_.contains(declared.var);
+        return { IsInvariant(declared, loop), true, number };
+      } else if constexpr (std::is_same_v<T, expr::Grouping>) {
+        return operands.at(node.expression);
+      } else if constexpr (std::is_same_v<T, expr::Unary>) {
+        auto right = operands.at(node.right);
+        if (node.op.Type() == TokenType::BANG) { return { right.invariant, right.safe, false }; }
+        return { right.invariant, right.safe && right.number, true };
+      } else if constexpr (std::is_same_v<T, expr::Logical>) {
+        auto left = operands.at(node.left);
+        auto right = operands.at(node.right);
+        return { left.invariant && right.invariant, left.safe && right.safe, left.number && right.number };
+      } else if constexpr (std::is_same_v<T, expr::Binary>) {
+        auto left = operands.at(node.left);
+        auto right = operands.at(node.right);
+        auto invariant = left.invariant && right.invariant;
+        auto safe = left.safe && right.safe;
+        auto numbers = left.number && right.number;
+        switch (node.op.Type()) {
+        case TokenType::BANG_EQUAL:
+        case TokenType::EQUAL_EQUAL:
+          return { invariant, safe, false };
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::LESS:
+        case TokenType::LESS_EQUAL:
+          return { invariant, safe && numbers, false };
+        case TokenType::PLUS:
+          return { invariant, safe && numbers, left.number || right.number };
+        default:
+          return { invariant, safe && numbers, true };
+        }
+      } else {
+        return { false, false, false };
+      }
+    },
+    expr);
+}
+
+bool Optimizer::IsInvariant(const Declaration &declaration, const Loop &loop) const
+{
+  if (loop.assigned.contains(&declaration)) { return false; }
+  if (!loop.calls) { return true; }
+  // A call may run a closure that assigns it.
+  if (declaration.var != nullptr) { return !assigned_.contains(declaration.var); }
+  if (declaration.parameter != nullptr) { return !assigned_parameters_.contains(declaration.parameter); }
+  return false;
+}
+
+bool Optimizer::IsInvariant(SymbolId global, const Loop &loop) const
+{
+  if (loop.assigned_globals.contains(global)) { return false; }
+  // A call may run a function that assigns it; one in a REPL line may even have been declared by an earlier line.
+  return !loop.calls || (whole_program_ && !assigned_globals_.contains(global));
+}
+
+void Optimizer::BeginScope() { scopes_.emplace_back(); }
+
+void Optimizer::EndScope() { scopes_.pop_back(); }
+
+auto Optimizer::operator()(expr::Assign &assign) -> ExprPtr
+{
+  if (pass_ == Pass::FIND_ASSIGNMENTS) {
+    auto number = YieldsNumber(*assign.value);
+    const auto &declared = Declared(assign.slot);
+    if (assign.slot.IsGlobal()) {
+      assigned_globals_.insert(assign.name.Symbol());
+      if (!number) { non_number_globals_.insert(assign.name.Symbol()); }
+    } else if (declared.var != nullptr) {
+      assigned_.insert(declared.var);
+      if (!number) { non_numbers_.insert(declared.var); }
+    } else if (declared.parameter != nullptr) {
+      assigned_parameters_.insert(declared.parameter);
+    }
+  } else if (pass_ == Pass::FIND_REFERENCES) {
+    Reference(assign.name, assign.slot);
+  }
+  return nullptr;
+}
+
+auto Optimizer::operator()(expr::Binary &binary) -> ExprPtr
+{
+  if (pass_ != Pass::FOLD) { return nullptr; }
+
+  const auto *left = std::get_if<expr::Literal>(binary.left);
+  const auto *right = std::get_if<expr::Literal>(binary.right);
+  if (left == nullptr || right == nullptr) { return nullptr; }
+  auto value = Fold(binary.op.Type(), left->value, right->value);
+  return value ? Literal(std::move(*value)) : nullptr;
+}
+
+auto Optimizer::operator()(expr::Call &call) -> ExprPtr
+{
+  return pass_ == Pass::FOLD ? Inline(call) : nullptr;
+}
+
+auto Optimizer::operator()(expr::Grouping &grouping) -> ExprPtr
+{
+  return pass_ == Pass::FOLD ? grouping.expression : nullptr;
+}
+
+auto Optimizer::operator()([[maybe_unused]] expr::Literal &literal) -> ExprPtr { return nullptr; }
+
+auto Optimizer::operator()(expr::Logical &logical) -> ExprPtr
+{
+  if (pass_ != Pass::FOLD) { return nullptr; }
+
+  const auto *left = std::get_if<expr::Literal>(logical.left);
+  if (left == nullptr) { return nullptr; }
+  auto short_circuits = logical.op.Type() == TokenType::OR ? IsTruthy(left->value) : !IsTruthy(left->value);
+  return short_circuits ? logical.left : logical.right;
+}
+
+auto Optimizer::operator()(expr::Unary &unary) -> ExprPtr
+{
+  if (pass_ != Pass::FOLD) { return nullptr; }
+
+  const auto *right = std::get_if<expr::Literal>(unary.right);
+  if (right == nullptr) { return nullptr; }
+  switch (unary.op.Type()) {
+  case TokenType::MINUS:
+    return right->value.IsNumber() ? Literal(Negate(right->value)) : nullptr;
+  case TokenType::BANG:
+    return Literal(!IsTruthy(right->value));
+  default:
+    return nullptr;
+  }
+}
+
+auto Optimizer::operator()(expr::Variable &variable) -> ExprPtr
+{
+  if (pass_ == Pass::FIND_REFERENCES) { Reference(variable.name, variable.slot); }
+  if (pass_ != Pass::FOLD) { return nullptr; }
+
+  // The declaration has been visited already, so its initializer is as folded as it gets.
+  const auto *var = Declared(variable.slot).var;
+  if (var == nullptr || assigned_.contains(var)) { return nullptr; }
+  if (var->initializer == nullptr) { return Literal(Nil{}); }
+  const auto *initializer = std::get_if<expr::Literal>(var->initializer);
+  return initializer != nullptr ? Literal(initializer->value) : nullptr;
+}
+
+auto Optimizer::operator()(stmt::Expression &expression) -> StmtPtr
+{
+  Optimize(expression.expression);
+  return nullptr;
+}
+
+auto Optimizer::operator()(stmt::Function &function) -> StmtPtr
+{
+  if (pass_ == Pass::REMOVE_FUNCTIONS && IsUnused(function)) {
+    removed_ += CountNodes(function.body);
+    if (scopes_.empty()) { return &empty_; }
+    // A local keeps its slot, so that the slots resolved for the ones declared after it stay right.
+    Declare({});
+    return MakeStmt<stmt::Var>(*arena_, function.name, nullptr);
+  }
+
+  auto global = scopes_.empty();
+  if (global && pass_ == Pass::FIND_ASSIGNMENTS) {
+    DeclareGlobal(function.name);
+    non_number_globals_.insert(function.name.Symbol());
+  }
+  Declare({ nullptr, &function });
+  if (function.lazy != nullptr && (pass_ == Pass::FIND_ASSIGNMENTS || pass_ == Pass::FIND_REFERENCES)) {
+    ScanLazyBody(function);
+  }
+  enclosing_.push_back(&function);
+  BeginScope();
+  for (const auto &param : function.params) { Declare({ nullptr, nullptr, &param }); }
+  function.body = Walk(function.body);
+  EndScope();
+  enclosing_.pop_back();
+
+  if (global && pass_ == Pass::FOLD && inline_budget_ > 0 && !assigned_globals_.contains(function.name.Symbol())) {
+    if (auto *value = InlineValue(function)) {
+      inline_functions_.insert_or_assign(
+        function.name.Symbol(), InlineFunction{ function.name.Pos(), function.params.size(), value });
+    }
+  }
+  return nullptr;
+}
+
+auto Optimizer::operator()(stmt::If &stmt) -> StmtPtr
+{
+  Optimize(stmt.condition);
+  Optimize(*stmt.then_branch);
+  Optimize(*stmt.else_branch);
+  if (pass_ != Pass::FOLD) { return nullptr; }
+
+  const auto *condition = std::get_if<expr::Literal>(stmt.condition);
+  if (condition == nullptr) { return nullptr; }
+  auto [taken, untaken] = IsTruthy(condition->value) ? std::pair{ stmt.then_branch, stmt.else_branch }
+                                                     : std::pair{ stmt.else_branch, stmt.then_branch };
+  removed_ += 1 + CountNodes(*stmt.condition) + CountNodes(*untaken);
+  return taken;
+}
+
+auto Optimizer::operator()(stmt::Print &print) -> StmtPtr
+{
+  Optimize(print.expression);
+  return nullptr;
+}
+
+auto Optimizer::operator()(stmt::Return &stmt) -> StmtPtr
+{
+  if (stmt.value) { Optimize(stmt.value); }
+  return nullptr;
+}
+
+auto Optimizer::operator()(stmt::Var &var) -> StmtPtr
+{
+  if (var.initializer) { Optimize(var.initializer); }
+  auto global = scopes_.empty();
+  if (pass_ == Pass::FIND_ASSIGNMENTS) {
+    auto number = var.initializer != nullptr && YieldsNumber(*var.initializer);
+    if (global) {
+      DeclareGlobal(var.name);
+      if (!number) { non_number_globals_.insert(var.name.Symbol()); }
+    } else if (!number) {
+      non_numbers_.insert(&var);
+    }
+  } else if (global && pass_ == Pass::FOLD) {
+    defined_globals_.insert(var.name.Symbol());
+  }
+  Declare({ &var, nullptr, nullptr });
+  return nullptr;
+}
+
+auto Optimizer::operator()(stmt::While &stmt) -> StmtPtr
+{
+  Optimize(stmt.condition);
+  Optimize(*stmt.body);
+  if (pass_ != Pass::FOLD) { return nullptr; }
+
+  const auto *condition = std::get_if<expr::Literal>(stmt.condition);
+  if (condition == nullptr || IsTruthy(condition->value)) { return Hoist(stmt); }
+  removed_ += CountNodes(*stmt.condition) + CountNodes(*stmt.body);
+  return &empty_;
+}
+
+auto Optimizer::operator()([[maybe_unused]] stmt::Empty &empty) -> StmtPtr { return nullptr; }
+
+auto Optimizer::operator()(stmt::Block &block) -> StmtPtr
+{
+  BeginScope();
+  block.statements = Walk(block.statements);
+  EndScope();
+  return pass_ == Pass::FOLD && block.statements.empty() ? &empty_ : nullptr;
+}
@@ -0,0 +1,179 @@
+#ifndef LOX_OPTIMIZER_H
+#define LOX_OPTIMIZER_H
+
+#include "Ast.h"
+#include "AstArena.h"
+#include "Source.h"
+#include "SymbolTable.h"
+#include "Token.h"
+
+#include <cstddef>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Static pass run on resolved statements, before either engine sees them. Folds operators whose operands are all
+// literals and short-circuits logical operators whose left operand is one, and replaces reads of a local that is
+// never assigned after being initialized with a literal by that literal. An operation that would fail at runtime is
+// left in place, so it still fails there, and on the same line. Calls to small functions that only return an
+// expression of their parameters are replaced by that expression. Then removes dead code: branches a constant
+// condition never takes, statements after a `return`, empty statements, and functions nothing refers to. Last, moves
+// the expressions a loop computes the same way on every iteration into temporaries declared just before it.
+class Optimizer
+{
+public:
+  // A top-level function whose calls can be replaced by the expression it returns.
+  struct InlineFunction
+  {
+    // Where the function is declared; calls from code that may run before that are left alone.
+    SourcePos pos;
+    std::size_t arity;
+    // Reads its parameters through slots { 0, index }, and nothing else.
+    ExprPtr value;
+  };
+  using InlineFunctions = std::unordered_map<SymbolId, InlineFunction>;
+
+  // Covers the one-line helpers generated code is full of.
+  static constexpr std::size_t kDefaultInlineBudget = 16;
+
+  // Folded expressions are made in `arena`, which must be the one the statements were parsed into or outlive them.
+  explicit Optimizer(AstArena &arena) : arena_{ &arena } {}
+
+  // Whether the statements are the whole program, so that nothing else reads or assigns the globals they declare:
+  // then functions declared at the top level and never referenced are removed, and globals only ever assigned numbers
+  // are known to hold one. Not so for a REPL line, which may declare functions for the lines after it.
+  void WholeProgram(bool whole) { whole_program_ = whole; }
+  // Calls to top-level functions returning an expression of at most `nodes` nodes are inlined; 0, the default, turns
+  // this off. Only right for the whole program too, as a later REPL line may assign the function's name.
+  void InlineFunctionsUpTo(std::size_t nodes) { inline_budget_ = nodes; }
+  // Calls to `functions` are inlined as well. They were found in the program the statements belong to, which must
+  // outlive them; for function bodies parsed after the rest of it.
+  void InlineCallsTo(const InlineFunctions &functions) { program_functions_ = &functions; }
+
+  void Optimize(std::vector<Stmt> &stmts);
+  // The number of nodes the last Optimize removed as dead code.
+  [[nodiscard]] std::size_t Removed() const { return removed_; }
+  // The number of expressions the last Optimize moved out of loops.
+  [[nodiscard]] std::size_t Hoisted() const { return hoisted_; }
+  // The functions the last Optimize found could be inlined.
+  [[nodiscard]] const InlineFunctions &Inlined() const { return inline_functions_; }
+
+  // Each visit returns what the node is to be replaced with, or nullptr to keep it. An expression's operands have been
+  // visited already, see Optimize(ExprPtr &).
+  auto operator()(expr::Assign &assign) -> ExprPtr;
+  auto operator()(expr::Binary &binary) -> ExprPtr;
+  auto operator()(expr::Call &call) -> ExprPtr;
+  auto operator()(expr::Grouping &grouping) -> ExprPtr;
+  auto operator()(expr::Literal &literal) -> ExprPtr;
+  auto operator()(expr::Logical &logical) -> ExprPtr;
+  auto operator()(expr::Unary &unary) -> ExprPtr;
+  auto operator()(expr::Variable &variable) -> ExprPtr;
+  auto operator()(stmt::Expression &expression) -> StmtPtr;
+  auto operator()(stmt::Function &function) -> StmtPtr;
+  auto operator()(stmt::If &stmt) -> StmtPtr;
+  auto operator()(stmt::Print &print) -> StmtPtr;
+  auto operator()(stmt::Return &stmt) -> StmtPtr;
+  auto operator()(stmt::Var &var) -> StmtPtr;
+  auto operator()(stmt::While &stmt) -> StmtPtr;
+  auto operator()(stmt::Empty &empty) -> StmtPtr;
+  auto operator()(stmt::Block &block) -> StmtPtr;
+
+private:
+  // Assignments and references get walks of their own, since either can come after the uses they affect, later in a
+  // loop body or in a function declared further down.
+  enum class Pass { FIND_ASSIGNMENTS, FOLD, FIND_REFERENCES, REMOVE_FUNCTIONS };
+
+  // What a local slot holds: one of a variable, a function, or a parameter.
+  struct Declaration
+  {
+    const stmt::Var *var{ nullptr };
+    const stmt::Function *function{ nullptr };
+    const Token *parameter{ nullptr };
+  };
+
+  // A loop being searched for expressions to hoist out of it.
+  struct Loop
+  {
+    // The declarations outside the loop that it assigns, and whether it makes calls, which may assign more.
+    std::unordered_set<const Declaration *> assigned{};
+    std::unordered_set<SymbolId> assigned_globals{};
+    bool calls{ false };
+    // Whether nothing evaluated so far on entering the loop can fail or has an effect. An expression hoisted from
+    // there fails at the same point if it fails at all, so it need not be one that cannot.
+    bool clean{ true };
+    // Where each expression to hoist is, and how many scopes inside the loop.
+    std::vector<std::pair<ExprPtr *, int>> invariants{};
+  };
+
+  // What is known of an expression inside a loop.
+  struct Invariance
+  {
+    // Computed the same on every iteration, without effects.
+    bool invariant;
+    // Cannot fail, nor has effects.
+    bool safe;
+    // Is a number if it does not fail.
+    bool number;
+  };
+  using Invariances = std::unordered_map<const Expr *, Invariance>;
+
+  AstArena *arena_;
+  bool whole_program_{ false };
+  std::size_t inline_budget_{ 0 };
+  InlineFunctions inline_functions_{};
+  const InlineFunctions *program_functions_{ nullptr };
+  Pass pass_{ Pass::FIND_ASSIGNMENTS };
+  // The local scopes as the Resolver saw them, so that slots index into them.
+  std::vector<std::vector<Declaration>> scopes_{};
+  // The functions whose bodies are being walked, outermost first.
+  std::vector<const stmt::Function *> enclosing_{};
+  std::unordered_set<const stmt::Var *> assigned_{};
+  std::unordered_set<const Token *> assigned_parameters_{};
+  // Variables that may be given something other than a number.
+  std::unordered_set<const stmt::Var *> non_numbers_{};
+  std::unordered_set<SymbolId> non_number_globals_{};
+  // Globals the top-level statements folded so far have defined.
+  std::unordered_set<SymbolId> defined_globals_{};
+  // Globals declared more than once, or assigned, are not known to hold the function declared under their name.
+  std::unordered_set<SymbolId> declared_globals_{};
+  std::unordered_set<SymbolId> assigned_globals_{};
+  std::unordered_set<const stmt::Function *> referenced_{};
+  std::unordered_set<SymbolId> referenced_globals_{};
+  std::size_t removed_{ 0 };
+  std::size_t hoisted_{ 0 };
+  Stmt empty_{ stmt::Empty{} };
+  // Slots of the expressions Optimize(ExprPtr &) is yet to look into, and of those it is to visit, last first.
+  std::vector<ExprPtr *> expr_pending_{};
+  std::vector<ExprPtr *> expr_order_{};
+
+  [[nodiscard]] std::span<Stmt> Walk(std::span<Stmt> stmts);
+  [[nodiscard]] std::span<Stmt> Compact(std::span<Stmt> stmts, std::size_t end);
+  void Optimize(Stmt &stmt);
+  void Optimize(ExprPtr &expr);
+  [[nodiscard]] const Declaration &Declared(const Slot &slot) const;
+  void Declare(Declaration declaration);
+  void DeclareGlobal(const Token &name);
+  void Reference(const Token &name, const Slot &slot);
+  void ScanLazyBody(const stmt::Function &function);
+  [[nodiscard]] ExprPtr InlineValue(const stmt::Function &function) const;
+  [[nodiscard]] const InlineFunction *FindInline(const expr::Call &call) const;
+  [[nodiscard]] ExprPtr Inline(const expr::Call &call);
+  [[nodiscard]] ExprPtr Substitute(const Expr &value, std::span<const ExprPtr> arguments);
+  [[nodiscard]] bool IsUnused(const stmt::Function &function) const;
+  [[nodiscard]] ExprPtr Literal(Value value);
+  [[nodiscard]] StmtPtr Hoist(stmt::While &loop);
+  void FindInvariants(ExprPtr &expr, Loop &loop, int scopes, bool unconditional);
+  void FindInvariants(Stmt &stmt, Loop &loop, int scopes);
+  // What is known of `expr` and of every expression in it.
+  [[nodiscard]] Invariances Classify(const Expr &expr, const Loop &loop, int scopes) const;
+  // What is known of `expr`, given what is known of its operands.
+  [[nodiscard]] Invariance Classify(const Expr &expr, const Invariances &operands, const Loop &loop, int scopes) const;
+  [[nodiscard]] bool IsInvariant(const Declaration &declaration, const Loop &loop) const;
+  [[nodiscard]] bool IsInvariant(SymbolId global, const Loop &loop) const;
+  void BeginScope();
+  void EndScope();
+};
+
+#endif// LOX_OPTIMIZER_H
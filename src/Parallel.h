@@ -0,0 +1,42 @@
+#ifndef LOX_PARALLEL_H
+#define LOX_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Calls fn(0) .. fn(count - 1) on up to `threads` threads, the calling thread included. Indices are handed out in
+// increasing order, one at a time, so uneven work balances itself. Returns once every call has finished and rethrows
+// the first exception any of them threw.
+template<typename Fn> void ParallelFor(std::size_t count, unsigned threads, Fn &&fn)
+{
+  std::atomic<std::size_t> next{ 0 };
+  std::exception_ptr failure{};
+  std::mutex failure_mutex{};
+
+  auto work = [&]() {
+    for (auto i = next++; i < count; i = next++) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard lock{ failure_mutex };
+        if (!failure) { failure = std::current_exception(); }
+      }
+    }
+  };
+
+  std::vector<std::jthread> workers{};
+  auto extra = count == 0 || threads == 0 ? 0 : std::min<std::size_t>(threads, count) - 1;
+  workers.reserve(extra);
+  for (std::size_t i = 0; i < extra; ++i) { workers.emplace_back(work); }
+  work();
+  workers.clear();
+
+  if (failure) { std::rethrow_exception(failure); }
+}
+
+#endif// LOX_PARALLEL_H
@@ -1,31 +1,88 @@
 #include "Parser.h"
 #include "Ast.h"
 #include "Errors.h"
+#include "Parallel.h"
 #include "Token.h"
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <fmt/core.h>
-#include <memory>
-#include <stdexcept>
+#include <magic_enum/magic_enum.hpp>
+#include <span>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
-Token Parser::Previous() const { return tokens_.at(current_ - 1); }
-
-Token Parser::Peek() const { return tokens_.at(current_); }
+namespace {
+// The part of one of the Parser's list stacks that belongs to a single list. What the list pushed is popped when it
+// goes out of scope, also when the list is abandoned because of a syntax error.
+template<typename T> class StackedList
+{
+public:
+  explicit StackedList(std::vector<T> &stack) : stack_{ stack }, base_{ stack.size() } {}
+  ~StackedList() { stack_.erase(stack_.begin() + static_cast<std::ptrdiff_t>(base_), stack_.end()); }
+
+  StackedList(const StackedList &) = delete;
+  StackedList &operator=(const StackedList &) = delete;
+
+  void Push(T item) { stack_.push_back(std::move(item)); }
+  T Pop()
+  {
+    auto item = std::move(stack_.back());
+    stack_.pop_back();
+    return item;
+  }
+  [[nodiscard]] T &Back() { return stack_.back(); }
+  [[nodiscard]] std::size_t Size() const { return stack_.size() - base_; }
+  void Truncate(std::size_t size) { stack_.resize(base_ + size); }
+  // Copies the items from `from` on.
+  [[nodiscard]] std::span<T> CopyTo(AstArena &arena, std::size_t from = 0) const
+  {
+    return arena.Copy(std::span<const T>{ stack_ }.subspan(base_ + from));
+  }
 
-Token Parser::Advance()
+private:
+  std::vector<T> &stack_;
+  std::size_t base_;
+};
+}// namespace
+
+const std::array<Parser::InfixRule, magic_enum::enum_count<TokenType>()> Parser::kInfixRules = [] {
+  std::array<InfixRule, magic_enum::enum_count<TokenType>()> rules{};
+  auto set = [&rules](TokenType type, Precedence precedence, OperatorKind kind) {
+    rules[static_cast<std::size_t>(type)] = { precedence, precedence == Precedence::ASSIGNMENT, kind };
+  };
+  set(TokenType::EQUAL, Precedence::ASSIGNMENT, OperatorKind::ASSIGN);
+  set(TokenType::OR, Precedence::OR, OperatorKind::LOGICAL);
+  set(TokenType::AND, Precedence::AND, OperatorKind::LOGICAL);
+  set(TokenType::BANG_EQUAL, Precedence::EQUALITY, OperatorKind::BINARY);
+  set(TokenType::EQUAL_EQUAL, Precedence::EQUALITY, OperatorKind::BINARY);
+  set(TokenType::GREATER, Precedence::COMPARISON, OperatorKind::BINARY);
+  set(TokenType::GREATER_EQUAL, Precedence::COMPARISON, OperatorKind::BINARY);
+  set(TokenType::LESS, Precedence::COMPARISON, OperatorKind::BINARY);
+  set(TokenType::LESS_EQUAL, Precedence::COMPARISON, OperatorKind::BINARY);
+  set(TokenType::MINUS, Precedence::TERM, OperatorKind::BINARY);
+  set(TokenType::PLUS, Precedence::TERM, OperatorKind::BINARY);
+  set(TokenType::SLASH, Precedence::FACTOR, OperatorKind::BINARY);
+  set(TokenType::STAR, Precedence::FACTOR, OperatorKind::BINARY);
+  return rules;
+}();
+
+void Parser::Advance()
 {
   if (!IsAtEnd()) { current_++; }
-  return Previous();
 }
 
-bool Parser::IsAtEnd() const { return Peek().Type() == TokenType::EOF_; }
+bool Parser::IsAtEnd() const { return PeekType() == TokenType::EOF_; }
 
 bool Parser::Check(TokenType type) const
 {
   if (IsAtEnd()) { return false; }
-  return Peek().Type() == type;
+  return PeekType() == type;
 }
 
 bool Parser::Match(TokenType type)
@@ -37,36 +94,24 @@ bool Parser::Match(TokenType type)
   return false;
 }
 
-Token Parser::Consume(TokenType type, std::string_view message)
+Parser::Parsed<Token> Parser::Consume(TokenType type, std::string_view message)
 {
-  if (Check(type)) { return Advance(); }
-  throw Error(Peek(), message);
+  if (Check(type)) {
+    Advance();
+    return Previous();
+  }
+  return Unexpected{ Error(Peek(), message) };
 }
 
 ParseError Parser::Error(const Token &token, std::string_view message)
 {
-  if (token.Type() == TokenType::EOF_) {
-    error_reporter_->Report(token.Line(), " at end", message);
+  auto where = token.Type() == TokenType::EOF_ ? std::string{ " at end" } : fmt::format(" at '{}'", token.Lexeme());
+  if (hold_diagnostics_) {
+    diagnostics_.push_back({ token.Pos(), std::move(where), std::string{ message } });
   } else {
-    error_reporter_->Report(token.Line(), fmt::format(" at '{}'", token.Lexeme()), message);
+    error_reporter_->Report(token.Pos(), where, message);
   }
-  return { "Parse error." };
-}
-
-ExprPtr Parser::FinishCall(ExprPtr callee)
-{
-  std::vector<ExprPtr> arguments{};
-
-  if (!Check(TokenType::RIGHT_PAREN)) {
-    do {
-      if (arguments.size() >= 255) { Error(Peek(), "Can't have more than 255 arguments."); }
-      arguments.push_back(ParseExpression());
-    } while (Match(TokenType::COMMA));
-  }
-
-  auto paren = Consume(TokenType::RIGHT_PAREN, "Expect ')' after arguments.");
-
-  return MakeExpr<expr::Call>(callee, paren, arguments);
+  return {};
 }
 
 void Parser::Synchronize()
@@ -74,9 +119,9 @@ void Parser::Synchronize()
   Advance();
 
   while (!IsAtEnd()) {
-    if (Previous().Type() == TokenType::SEMICOLON) { return; }
+    if (tokens_->Type(current_ - 1) == TokenType::SEMICOLON) { return; }
 
-    switch (Peek().Type()) {
+    switch (PeekType()) {
     case TokenType::CLASS:
     case TokenType::FUN:
     case TokenType::VAR:
@@ -96,293 +141,471 @@ void Parser::Synchronize()
 
 Stmt Parser::ParseDeclaration()
 {
-  try {
-    if (Match(TokenType::FUN)) { return ParseFunction("function"); }
-    if (Match(TokenType::VAR)) { return ParseVarDeclaration(); }
+  auto declaration = Match(TokenType::FUN)   ? ParseFunction("function")
+                     : Match(TokenType::VAR) ? ParseVarDeclaration()
+                                             : ParseStatement();
+  if (declaration) { return std::move(*declaration); }
 
-    return ParseStatement();
-  } catch (const ParseError &) {
-    Synchronize();
-    return stmt::Empty{};
-  }
+  Synchronize();
+  return stmt::Empty{};
 }
 
-Stmt Parser::ParseVarDeclaration()
+Parser::Parsed<Stmt> Parser::ParseVarDeclaration()
 {
   auto name = Consume(TokenType::IDENTIFIER, "Expect variable name.");
+  if (!name) { return Unexpected{ name.Error() }; }
 
   ExprPtr initializer{};
-  if (Match(TokenType::EQUAL)) { initializer = ParseExpression(); }
+  if (Match(TokenType::EQUAL)) {
+    auto value = ParseExpression();
+    if (!value) { return Unexpected{ value.Error() }; }
+    initializer = *value;
+  }
 
-  Consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
-  return stmt::Var{ name, initializer };
+  if (auto semicolon = Consume(TokenType::SEMICOLON, "Expect ';' after variable declaration."); !semicolon) {
+    return Unexpected{ semicolon.Error() };
+  }
+  return stmt::Var{ *name, initializer };
 }
 
-Stmt Parser::ParseFunction(std::string_view kind)
+Parser::Parsed<Stmt> Parser::ParseFunction(std::string_view kind)
 {
-  auto name = Consume(TokenType::IDENTIFIER, fmt::format("Expect {} name.", kind));
-  Consume(TokenType::LEFT_PAREN, fmt::format("Expect '(' after {} name.", kind));
-  std::vector<Token> parameters{};
+  auto function = static_cast<std::uint32_t>(current_);
+  auto name = Consume(TokenType::IDENTIFIER, "Expect {} name.", kind);
+  if (!name) { return Unexpected{ name.Error() }; }
+  if (auto paren = Consume(TokenType::LEFT_PAREN, "Expect '(' after {} name.", kind); !paren) {
+    return Unexpected{ paren.Error() };
+  }
+  StackedList parameters{ parameter_stack_ };
   if (!Check(TokenType::RIGHT_PAREN)) {
     do {
-      if (parameters.size() >= 255) { Error(Peek(), "Can't have more than 255 parameters."); }
-      parameters.push_back(Consume(TokenType::IDENTIFIER, "Expect parameter name,"));
+      if (parameters.Size() >= 255) { Error(Peek(), "Can't have more than 255 parameters."); }
+      auto parameter = Consume(TokenType::IDENTIFIER, "Expect parameter name,");
+      if (!parameter) { return Unexpected{ parameter.Error() }; }
+      parameters.Push(*parameter);
     } while (Match(TokenType::COMMA));
   }
 
-  Consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters.");
+  if (auto paren = Consume(TokenType::RIGHT_PAREN, "Expect ')' after parameters."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
 
-  Consume(TokenType::LEFT_BRACE, fmt::format("Expect '{{' before {} body.", kind));
+  if (auto brace = Consume(TokenType::LEFT_BRACE, "Expect '{{' before {} body.", kind); !brace) {
+    return Unexpected{ brace.Error() };
+  }
+  // A function outside every block is a global one: its body is resolved against the globals alone, so it can be
+  // parsed any time later.
+  if (lazy_functions_ && block_depth_ == 0) {
+    auto body_start = current_;
+    if (auto brace = SkipBlock(); !brace) { return Unexpected{ brace.Error() }; }
+    // The Optimizer can only inline a function that just returns a value if it has its body, and a short one costs next
+    // to nothing to parse now.
+    if (tokens_->Type(body_start) != TokenType::RETURN || current_ - body_start > kMaxEagerBodyTokens) {
+      const auto *lazy = arena_->New<LazyBody>(tokens_, function);
+      return stmt::Function{ *name, parameters.CopyTo(*arena_), {}, lazy };
+    }
+    current_ = body_start;
+  }
   auto body = ParseBlock();
-  return stmt::Function{ name, parameters, body };
+  if (!body) { return Unexpected{ body.Error() }; }
+  return stmt::Function{ *name, parameters.CopyTo(*arena_), *body, nullptr };
 }
 
-Stmt Parser::ParseStatement()
+Parser::Parsed<Stmt> Parser::ParseStatement()
 {
   if (Match(TokenType::FOR)) { return ParseFor(); }
   if (Match(TokenType::IF)) { return ParseIf(); }
   if (Match(TokenType::PRINT)) { return ParsePrint(); }
   if (Match(TokenType::RETURN)) { return ParseReturn(); }
   if (Match(TokenType::WHILE)) { return ParseWhile(); }
-  if (Match(TokenType::LEFT_BRACE)) { return stmt::Block{ ParseBlock() }; }
+  if (Match(TokenType::LEFT_BRACE)) {
+    auto block = ParseBlock();
+    if (!block) { return Unexpected{ block.Error() }; }
+    return stmt::Block{ *block };
+  }
 
   return ParseExpressionStatement();
 }
 
-Stmt Parser::ParseFor()
+Parser::Parsed<Stmt> Parser::ParseFor()
 {
-  Consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'.");
+  if (auto paren = Consume(TokenType::LEFT_PAREN, "Expect '(' after 'for'."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
 
   Stmt initializer;
   if (Match(TokenType::SEMICOLON)) {
     initializer = stmt::Empty{};
-  } else if (Match(TokenType::VAR)) {
-    initializer = ParseVarDeclaration();
   } else {
-    initializer = ParseExpressionStatement();
+    auto clause = Match(TokenType::VAR) ? ParseVarDeclaration() : ParseExpressionStatement();
+    if (!clause) { return Unexpected{ clause.Error() }; }
+    initializer = *clause;
   }
 
   ExprPtr condition{};
-  if (!Check(TokenType::SEMICOLON)) { condition = ParseExpression(); }
-  Consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
+  if (!Check(TokenType::SEMICOLON)) {
+    auto clause = ParseExpression();
+    if (!clause) { return Unexpected{ clause.Error() }; }
+    condition = *clause;
+  }
+  if (auto semicolon = Consume(TokenType::SEMICOLON, "Expect ';' after loop condition."); !semicolon) {
+    return Unexpected{ semicolon.Error() };
+  }
 
   ExprPtr increment{};
-  if (!Check(TokenType::RIGHT_PAREN)) { increment = ParseExpression(); }
-  Consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses.");
+  if (!Check(TokenType::RIGHT_PAREN)) {
+    auto clause = ParseExpression();
+    if (!clause) { return Unexpected{ clause.Error() }; }
+    increment = *clause;
+  }
+  if (auto paren = Consume(TokenType::RIGHT_PAREN, "Expect ')' after for clauses."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
 
-  auto body = ParseStatement();
+  auto parsed_body = ParseStatement();
+  if (!parsed_body) { return Unexpected{ parsed_body.Error() }; }
+  auto body = *parsed_body;
 
-  if (increment) { body = stmt::Block{ { body, stmt::Expression{ increment } } }; }
-  if (!condition) { condition = MakeExpr<expr::Literal>(true); }
-  body = stmt::While{ condition, std::make_shared<Stmt>(body) };
+  if (increment) { body = stmt::Block{ arena_->Copy<Stmt>({ body, stmt::Expression{ increment } }) }; }
+  if (!condition) { condition = MakeExpr<expr::Literal>(*arena_, true); }
+  body = stmt::While{ condition, arena_->New<Stmt>(body) };
 
-  if (!std::holds_alternative<stmt::Empty>(initializer)) { body = stmt::Block{ { initializer, body } }; }
+  if (!std::holds_alternative<stmt::Empty>(initializer)) {
+    body = stmt::Block{ arena_->Copy<Stmt>({ initializer, body }) };
+  }
 
   return body;
 }
 
-Stmt Parser::ParseIf()
+Parser::Parsed<Stmt> Parser::ParseIf()
 {
-  Consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
+  if (auto paren = Consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
   auto condition = ParseExpression();
-  Consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
+  if (!condition) { return Unexpected{ condition.Error() }; }
+  if (auto paren = Consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
 
-  auto then_branch = std::make_shared<Stmt>(ParseStatement());
-  return Match(TokenType::ELSE) ? stmt::If(condition, then_branch, std::make_shared<Stmt>(stmt::Empty{}))
-                                : stmt::If(condition, then_branch, std::make_shared<Stmt>(ParseStatement()));
+  auto then_branch = ParseStatement();
+  if (!then_branch) { return Unexpected{ then_branch.Error() }; }
+  auto else_branch = Match(TokenType::ELSE) ? Parsed<Stmt>{ stmt::Empty{} } : ParseStatement();
+  if (!else_branch) { return Unexpected{ else_branch.Error() }; }
+  return stmt::If(*condition, arena_->New<Stmt>(*then_branch), arena_->New<Stmt>(*else_branch));
 }
 
-Stmt Parser::ParsePrint()
+Parser::Parsed<Stmt> Parser::ParsePrint()
 {
+  auto keyword = Previous();
   auto value = ParseExpression();
-  Consume(TokenType::SEMICOLON, "Expect ';' after value.");
-  return stmt::Print(value);
+  if (!value) { return Unexpected{ value.Error() }; }
+  if (auto semicolon = Consume(TokenType::SEMICOLON, "Expect ';' after value."); !semicolon) {
+    return Unexpected{ semicolon.Error() };
+  }
+  return stmt::Print(keyword, *value);
 }
 
-Stmt Parser::ParseReturn()
+Parser::Parsed<Stmt> Parser::ParseReturn()
 {
   auto keyword = Previous();
   ExprPtr value{ nullptr };
-  if (!Check(TokenType::SEMICOLON)) { value = ParseExpression(); }
+  if (!Check(TokenType::SEMICOLON)) {
+    auto parsed = ParseExpression();
+    if (!parsed) { return Unexpected{ parsed.Error() }; }
+    value = *parsed;
+  }
 
-  Consume(TokenType::SEMICOLON, "Expect ';' after return value.");
+  if (auto semicolon = Consume(TokenType::SEMICOLON, "Expect ';' after return value."); !semicolon) {
+    return Unexpected{ semicolon.Error() };
+  }
   return stmt::Return{ keyword, value };
 }
 
-Stmt Parser::ParseWhile()
+Parser::Parsed<Stmt> Parser::ParseWhile()
 {
-  Consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'.");
+  if (auto paren = Consume(TokenType::LEFT_PAREN, "Expect '(' after 'while'."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
   auto condition = ParseExpression();
-  Consume(TokenType::RIGHT_PAREN, "Expect ')' after condition.");
+  if (!condition) { return Unexpected{ condition.Error() }; }
+  if (auto paren = Consume(TokenType::RIGHT_PAREN, "Expect ')' after condition."); !paren) {
+    return Unexpected{ paren.Error() };
+  }
   auto body = ParseStatement();
+  if (!body) { return Unexpected{ body.Error() }; }
 
-  return stmt::While(condition, std::make_shared<Stmt>(body));
+  return stmt::While(*condition, arena_->New<Stmt>(*body));
 }
 
-std::vector<Stmt> Parser::ParseBlock()
+Parser::Parsed<std::span<Stmt>> Parser::ParseBlock()
 {
-  std::vector<Stmt> statements{};
+  StackedList statements{ statement_stack_ };
 
-  while (!Check(TokenType::RIGHT_BRACE) && !IsAtEnd()) { statements.push_back(ParseDeclaration()); }
+  ++block_depth_;
+  while (!Check(TokenType::RIGHT_BRACE) && !IsAtEnd()) { statements.Push(ParseDeclaration()); }
+  --block_depth_;
 
-  Consume(TokenType::RIGHT_BRACE, "Expect '}' after block.");
-  return statements;
-}
-
-Stmt Parser::ParseExpressionStatement()
-{
-  auto expr = ParseExpression();
-  Consume(TokenType::SEMICOLON, "Expect ';' after expression.");
-  return stmt::Expression(expr);
+  if (auto brace = Consume(TokenType::RIGHT_BRACE, "Expect '}' after block."); !brace) {
+    return Unexpected{ brace.Error() };
+  }
+  return statements.CopyTo(*arena_);
 }
 
-ExprPtr Parser::ParseExpression() { return ParseAssign(); }
-
-ExprPtr Parser::ParseAssign()
+Parser::Parsed<Token> Parser::SkipBlock()
 {
-  auto expr = ParseOr();
-
-  if (Match(TokenType::EQUAL)) {
-    auto equals = Previous();
-    auto value = ParseAssign();
-
-    if (std::holds_alternative<expr::Variable>(*expr)) {
-      auto name = std::get<expr::Variable>(*expr).name;
-      return MakeExpr<expr::Assign>(name, value);
+  StackedList open{ bracket_stack_ };
+  open.Push(TokenType::LEFT_BRACE);
+  while (open.Size() > 0) {
+    if (IsAtEnd()) { return Unexpected{ Error(Peek(), "Expect '}' after block.") }; }
+    auto type = PeekType();
+    Advance();
+    switch (type) {
+    case TokenType::LEFT_PAREN:
+    case TokenType::LEFT_BRACE:
+      open.Push(type);
+      break;
+    case TokenType::RIGHT_PAREN:
+      if (open.Pop() != TokenType::LEFT_PAREN) { return Unexpected{ Error(Previous(), "Expect '}' before ')'.") }; }
+      break;
+    case TokenType::RIGHT_BRACE:
+      if (open.Pop() != TokenType::LEFT_BRACE) { return Unexpected{ Error(Previous(), "Expect ')' before '}'.") }; }
+      break;
+    default:
+      break;
     }
-
-    Error(equals, "Invalid assignment target.");
   }
-
-  return expr;
+  return Previous();
 }
 
-ExprPtr Parser::ParseOr()
+Parser::Parsed<Stmt> Parser::ParseExpressionStatement()
 {
-  auto expr = ParseAnd();
-
-  while (Match(TokenType::OR)) {
-    auto op = Previous();
-    auto right = ParseAnd();
-    expr = MakeExpr<expr::Logical>(expr, op, right);
+  auto expr = ParseExpression();
+  if (!expr) { return Unexpected{ expr.Error() }; }
+  if (auto semicolon = Consume(TokenType::SEMICOLON, "Expect ';' after expression."); !semicolon) {
+    return Unexpected{ semicolon.Error() };
   }
-
-  return expr;
+  return stmt::Expression(*expr);
 }
 
-ExprPtr Parser::ParseAnd()
+Parser::Parsed<ExprPtr> Parser::ParseExpression()
 {
-  auto expr = ParseEquality();
+  StackedList operators{ operator_stack_ };
+  StackedList operands{ operand_stack_ };
+  // Parentheses and argument lists opened and not closed yet.
+  std::size_t open{ 0 };
+
+  // Reduces the operators since the innermost open parenthesis that bind more tightly than one of `precedence`.
+  auto reduce = [&](Precedence precedence, bool right_associative) {
+    while (operators.Size() > 0) {
+      auto top = operators.Back().precedence;
+      if (top < precedence || (top == precedence && right_associative)) { break; }
+      Reduce();
+    }
+  };
+  auto index = [](std::size_t position) { return static_cast<std::uint32_t>(position); };
 
-  while (Match(TokenType::AND)) {
-    auto op = Previous();
-    auto right = ParseEquality();
-    expr = MakeExpr<expr::Logical>(expr, op, right);
+  while (true) {
+    // An operand: prefix operators and opening parentheses, then a primary.
+    while (true) {
+      if (Match(TokenType::BANG, TokenType::MINUS)) {
+        operators.Push({ Precedence::UNARY, OperatorKind::UNARY, index(current_ - 1), 0 });
+      } else if (Match(TokenType::LEFT_PAREN)) {
+        operators.Push({ Precedence::NONE, OperatorKind::GROUPING, index(current_ - 1), 0 });
+        ++open;
+      } else {
+        break;
+      }
+    }
+    auto primary = ParsePrimary();
+    if (!primary) { return Unexpected{ primary.Error() }; }
+    operands.Push(*primary);
+
+    // What follows it: calls and closing parentheses, then either an infix operator or the end of the expression.
+    while (true) {
+      if (Match(TokenType::LEFT_PAREN)) {
+        if (Match(TokenType::RIGHT_PAREN)) {
+          operands.Push(MakeExpr<expr::Call>(*arena_, operands.Pop(), Previous(), std::span<ExprPtr>{}));
+          continue;
+        }
+        operators.Push({ Precedence::NONE, OperatorKind::CALL, index(current_ - 1), index(operands.Size()) });
+        ++open;
+        break;
+      }
+
+      if (open > 0 && (Check(TokenType::RIGHT_PAREN) || Check(TokenType::COMMA))) {
+        reduce(Precedence::NONE, true);
+        auto parenthesis = operators.Back();
+        if (Check(TokenType::COMMA)) {
+          // Left in place for synchronization, which then starts at the comma, as it would for any other token.
+          if (parenthesis.kind == OperatorKind::GROUPING) {
+            return Unexpected{ Error(Peek(), "Expect ')' after expression.") };
+          }
+          Advance();
+          if (operands.Size() - parenthesis.operands >= 255) { Error(Peek(), "Can't have more than 255 arguments."); }
+          break;
+        }
+
+        Advance();
+        operators.Pop();
+        --open;
+        if (parenthesis.kind == OperatorKind::GROUPING) {
+          operands.Push(MakeExpr<expr::Grouping>(*arena_, operands.Pop()));
+        } else {
+          auto arguments = operands.CopyTo(*arena_, parenthesis.operands);
+          operands.Truncate(parenthesis.operands);
+          operands.Push(MakeExpr<expr::Call>(*arena_, operands.Pop(), Previous(), arguments));
+        }
+        continue;
+      }
+
+      const auto &rule = kInfixRules[static_cast<std::size_t>(PeekType())];
+      if (rule.precedence != Precedence::NONE) {
+        reduce(rule.precedence, rule.right_associative);
+        operators.Push({ rule.precedence, rule.kind, index(current_), 0 });
+        Advance();
+        break;
+      }
+
+      reduce(Precedence::NONE, true);
+      if (open > 0) {
+        return Unexpected{ Error(Peek(),
+          operators.Back().kind == OperatorKind::GROUPING ? "Expect ')' after expression."
+                                                          : "Expect ')' after arguments.") };
+      }
+      return operands.Back();
+    }
   }
-
-  return expr;
 }
 
-ExprPtr Parser::ParseEquality()
+void Parser::Reduce()
 {
-  auto expr = ParseComparison();
-
-  while (Match(TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL)) {
-    auto op = Previous();
-    auto right = ParseComparison();
-    expr = MakeExpr<expr::Binary>(expr, op, right);
+  auto op = operator_stack_.back();
+  operator_stack_.pop_back();
+  auto right = operand_stack_.back();
+  operand_stack_.pop_back();
+
+  if (op.kind == OperatorKind::UNARY) {
+    operand_stack_.push_back(MakeExpr<expr::Unary>(*arena_, tokens_->At(op.token), right));
+    return;
   }
 
-  return expr;
+  auto &left = operand_stack_.back();
+  switch (op.kind) {
+  case OperatorKind::BINARY:
+    left = MakeExpr<expr::Binary>(*arena_, left, tokens_->At(op.token), right);
+    break;
+  case OperatorKind::LOGICAL:
+    left = MakeExpr<expr::Logical>(*arena_, left, tokens_->At(op.token), right);
+    break;
+  case OperatorKind::ASSIGN:
+    // An invalid target is reported without throwing; the expression is then just the target.
+    if (std::holds_alternative<expr::Variable>(*left)) {
+      left = MakeExpr<expr::Assign>(*arena_, std::get<expr::Variable>(*left).name, right);
+    } else {
+      Error(tokens_->At(op.token), "Invalid assignment target.");
+    }
+    break;
+  default:
+    break;
+  }
 }
 
-ExprPtr Parser::ParseComparison()
+Parser::Parsed<ExprPtr> Parser::ParsePrimary()
 {
-  auto expr = ParseTerm();
+  if (Match(TokenType::FALSE)) { return MakeExpr<expr::Literal>(*arena_, false); }
+  if (Match(TokenType::TRUE)) { return MakeExpr<expr::Literal>(*arena_, true); }
+  if (Match(TokenType::NIL)) { return MakeExpr<expr::Literal>(*arena_, Nil{}); }
 
-  while (Match(TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL)) {
-    auto op = Previous();
-    auto right = ParseTerm();
-    expr = MakeExpr<expr::Binary>(expr, op, right);
+  if (Match(TokenType::NUMBER, TokenType::STRING)) {
+    return MakeExpr<expr::Literal>(*arena_, Value::FromLiteral(tokens_->Literal(current_ - 1)));
   }
 
-  return expr;
+  if (Match(TokenType::IDENTIFIER)) { return MakeExpr<expr::Variable>(*arena_, Previous()); }
+
+  return Unexpected{ Error(Peek(), "Expect expression.") };
 }
 
-ExprPtr Parser::ParseTerm()
+std::vector<Stmt> Parser::Parse()
 {
-  auto expr = ParseFactor();
-
-  while (Match(TokenType::MINUS, TokenType::PLUS)) {
-    auto op = Previous();
-    auto right = ParseFactor();
-    expr = MakeExpr<expr::Binary>(expr, op, right);
-  }
-
-  return expr;
+  std::vector<Stmt> statements{};
+  while (!IsAtEnd()) { statements.push_back(ParseDeclaration()); }
+  return statements;
 }
 
-ExprPtr Parser::ParseFactor()
+Expected<Stmt, ParseError> Parser::ParseLazyFunction(const LazyBody &lazy)
 {
-  auto expr = ParseUnary();
-
-  while (Match(TokenType::SLASH, TokenType::STAR)) {
-    auto op = Previous();
-    auto right = ParseUnary();
-    expr = MakeExpr<expr::Binary>(expr, op, right);
-  }
-
-  return expr;
+  Seek(lazy.function);
+  auto lazy_functions = std::exchange(lazy_functions_, false);
+  auto function = ParseFunction("function");
+  lazy_functions_ = lazy_functions;
+  return function;
 }
 
-ExprPtr Parser::ParseUnary()
+std::size_t Parser::ParseRange(std::size_t from, std::size_t to, std::vector<Stmt> &statements)
 {
-  if (Match(TokenType::BANG, TokenType::MINUS)) {
-    auto op = Previous();
-    auto right = ParseUnary();
-    return MakeExpr<expr::Unary>(op, right);
-  }
-
-  return ParseCall();
+  Seek(from);
+  while (!IsAtEnd() && Position() < to) { statements.push_back(ParseDeclaration()); }
+  return Position();
 }
 
-ExprPtr Parser::ParseCall()
+void Parser::ParseChunk(Chunk &chunk) const
 {
-  auto expr = ParsePrimary();
-
-  while (true) {
-    if (Match(TokenType::LEFT_PAREN)) {
-      expr = FinishCall(expr);
-    } else {
-      break;
-    }
-  }
-
-  return expr;
+  Parser parser{ *tokens_, *chunk.arena, error_reporter_ };
+  parser.hold_diagnostics_ = true;
+  parser.lazy_functions_ = lazy_functions_;
+  chunk.stop = parser.ParseRange(chunk.from, chunk.to, chunk.statements);
+  chunk.diagnostics = std::move(parser.diagnostics_);
 }
 
-ExprPtr Parser::ParsePrimary()
+std::vector<Stmt> Parser::ParseParallel(unsigned threads)
 {
-  if (Match(TokenType::FALSE)) { return MakeExpr<expr::Literal>(false); }
-  if (Match(TokenType::TRUE)) { return MakeExpr<expr::Literal>(true); }
-  if (Match(TokenType::NIL)) { return MakeExpr<expr::Literal>(Nil{}); }
-
-  if (Match(TokenType::NUMBER, TokenType::STRING)) { return MakeExpr<expr::Literal>(Previous().Literal()); }
-
-  if (Match(TokenType::IDENTIFIER)) { return MakeExpr<expr::Variable>(Previous()); }
-
-  if (Match(TokenType::LEFT_PAREN)) {
-    auto expr = ParseExpression();
-    Consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-    return MakeExpr<expr::Grouping>(expr);
+  auto size = tokens_->Size();
+  if (threads <= 1 || size < 2 * kMinChunkTokens) { return Parse(); }
+
+  // A `fun` outside any braces starts a top-level declaration in a well-formed script. Error recovery can skip past
+  // one, so each chunk is only a guess, checked below.
+  auto chunk_size = std::max(kMinChunkTokens, size / (4 * std::size_t{ threads }));
+  std::vector<Chunk> chunks{};
+  std::size_t from{ 0 };
+  int depth{ 0 };
+  for (std::size_t i = 0; i < size; ++i) {
+    switch (tokens_->Type(i)) {
+    case TokenType::LEFT_BRACE:
+      ++depth;
+      break;
+    case TokenType::RIGHT_BRACE:
+      depth = std::max(depth - 1, 0);
+      break;
+    case TokenType::FUN:
+      if (depth == 0 && i - from >= chunk_size) {
+        chunks.push_back({ from, i });
+        from = i;
+      }
+      break;
+    default:
+      break;
+    }
   }
+  chunks.push_back({ from, size });
 
-  throw Error(Peek(), "Expect expression.");
-}
+  ParallelFor(chunks.size(), threads, [this, &chunks](std::size_t i) { ParseChunk(chunks[i]); });
 
-std::vector<Stmt> Parser::Parse()
-{
+  // A chunk's guess held if the parse before it stopped exactly at its start. Where it did not, the declarations
+  // that start in the chunk are parsed again here, after where the parse before it did stop.
   std::vector<Stmt> statements{};
-  while (!IsAtEnd()) { statements.push_back(ParseDeclaration()); }
+  std::size_t position{ 0 };
+  for (auto &chunk : chunks) {
+    if (position != chunk.from) {
+      position = ParseRange(position, chunk.to, statements);
+      continue;
+    }
+    statements.insert(statements.end(), chunk.statements.begin(), chunk.statements.end());
+    for (auto &diagnostic : chunk.diagnostics) {
+      error_reporter_->Report(diagnostic.pos, diagnostic.where, diagnostic.message);
+    }
+    arena_->Absorb(*chunk.arena);
+    position = chunk.stop;
+  }
   return statements;
 }
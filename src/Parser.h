@@ -1,67 +1,169 @@
 #ifndef LOX_PARSER_H
 #define LOX_PARSER_H
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <magic_enum/magic_enum.hpp>
+#include <memory>
+#include <span>
+#include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
 
 #include "Ast.h"
+#include "AstArena.h"
 #include "ErrorReporter.h"
 #include "Token.h"
+#include "TokenStream.h"
 #include "Errors.h"
+#include "Expected.h"
 
 class Parser
 {
 public:
-  Parser() = default;
-  Parser(std::vector<Token> tokens, ErrorReporterPtr reporter)
-    : tokens_{ std::move(tokens) }, error_reporter_{ std::move(reporter) }
+  // `tokens` must outlive the parser, and `arena`, which gets every node, must outlive the statements.
+  Parser(const TokenStream &tokens, AstArena &arena, ErrorReporterPtr reporter)
+    : tokens_{ &tokens }, arena_{ &arena }, error_reporter_{ std::move(reporter) }
   {}
 
+  // Bodies of top-level functions are only skipped over (see LazyBody) and parsed by ParseLazyFunction when needed.
+  // The token stream then has to outlive the statements.
+  void ParseFunctionsLazily(bool lazy) { lazy_functions_ = lazy; }
+
   std::vector<Stmt> Parse();
+  // The same statements and diagnostics as Parse, with the work split at top-level `fun` declarations and spread over
+  // up to `threads` threads. Every node ends up in the parser's arena.
+  std::vector<Stmt> ParseParallel(unsigned threads);
+
+  // One top-level declaration at a time, for re-parsing part of a stream (see Document). The parser carries no state
+  // from one top-level declaration to the next, so it can start at any token where one began.
+  void Seek(std::size_t token) { current_ = token; }
+  [[nodiscard]] std::size_t Position() const { return current_; }
+  [[nodiscard]] bool IsAtEnd() const;
+  [[nodiscard]] Stmt ParseDeclaration();
+
+  // The whole of the function `lazy` was made for, body and all.
+  [[nodiscard]] Expected<Stmt, ParseError> ParseLazyFunction(const LazyBody &lazy);
 
 private:
-  std::vector<Token> tokens_;
+  // Diagnostics of a chunk parse are held back until the chunk is known to start where a sequential parse would.
+  struct Diagnostic
+  {
+    SourcePos pos;
+    std::string where;
+    std::string message;
+  };
+
+  // One piece of a parallel parse: the top-level declarations that start in tokens [from, to), parsed into an arena of
+  // their own on the guess that a declaration starts at `from`.
+  struct Chunk
+  {
+    std::size_t from;
+    std::size_t to;
+    std::size_t stop{ 0 };
+    std::unique_ptr<AstArena> arena{ std::make_unique<AstArena>() };
+    std::vector<Stmt> statements{};
+    std::vector<Diagnostic> diagnostics{};
+  };
+
+  static constexpr std::size_t kMinChunkTokens = 1 << 16;
+  // Top-level function bodies that start with `return` and have up to this many tokens, closing brace included, are
+  // parsed even when parsing lazily.
+  static constexpr std::size_t kMaxEagerBodyTokens = 32;
+
+  const TokenStream *tokens_;
+  AstArena *arena_;
   ErrorReporterPtr error_reporter_;
-  int current_{ 0 };
+  std::size_t current_{ 0 };
+  bool lazy_functions_{ false };
+  // Blocks, function bodies among them, that the current token is in.
+  int block_depth_{ 0 };
+  // Set while parsing a Chunk; errors are kept in diagnostics_ instead of being reported.
+  bool hold_diagnostics_{ false };
+  std::vector<Diagnostic> diagnostics_{};
+  // Lists being parsed, at every level of nesting at once. Each list is gathered on top of its stack and copied into
+  // the arena in one piece when it is complete.
+  std::vector<Token> parameter_stack_{};
+  std::vector<TokenType> bracket_stack_{};
+  std::vector<Stmt> statement_stack_{};
 
-  [[nodiscard]] Stmt ParseDeclaration();
-  [[nodiscard]] Stmt ParseFunction(std::string_view);
-  [[nodiscard]] Stmt ParseVarDeclaration();
-  [[nodiscard]] Stmt ParseStatement();
-  [[nodiscard]] Stmt ParseIf();
-  [[nodiscard]] Stmt ParseFor();
-  [[nodiscard]] Stmt ParsePrint();
-  [[nodiscard]] Stmt ParseReturn();
-  [[nodiscard]] Stmt ParseWhile();
-  [[nodiscard]] std::vector<Stmt> ParseBlock();
-  [[nodiscard]] Stmt ParseExpressionStatement();
-  [[nodiscard]] ExprPtr ParseExpression();
-  [[nodiscard]] ExprPtr ParseAssign();
-  [[nodiscard]] ExprPtr ParseOr();
-  [[nodiscard]] ExprPtr ParseAnd();
-  [[nodiscard]] ExprPtr ParseEquality();
-  [[nodiscard]] ExprPtr ParseComparison();
-  [[nodiscard]] ExprPtr ParseTerm();
-  [[nodiscard]] ExprPtr ParseFactor();
-  [[nodiscard]] ExprPtr ParseCall();
-  [[nodiscard]] ExprPtr ParseUnary();
-  [[nodiscard]] ExprPtr ParsePrimary();
+  // How tightly an operator binds; a PendingOperator with NONE is an open parenthesis.
+  enum class Precedence : std::uint8_t { NONE, ASSIGNMENT, OR, AND, EQUALITY, COMPARISON, TERM, FACTOR, UNARY };
+  enum class OperatorKind : std::uint8_t { UNARY, BINARY, LOGICAL, ASSIGN, GROUPING, CALL };
+  struct PendingOperator
+  {
+    Precedence precedence;
+    OperatorKind kind;
+    // Index of the operator token.
+    std::uint32_t token;
+    // For a CALL, how many operands there were before its first argument; the callee is the last of them.
+    std::uint32_t operands;
+  };
+  // How each token type behaves between two operands; NONE for the ones that end an expression there.
+  struct InfixRule
+  {
+    Precedence precedence;
+    bool right_associative;
+    OperatorKind kind;
+  };
+  static const std::array<InfixRule, magic_enum::enum_count<TokenType>()> kInfixRules;
+  // Expressions are parsed without recursion. An operator waits on operator_stack_ until everything after it that
+  // binds more tightly has been reduced, and finished operands, call arguments among them, wait on operand_stack_.
+  std::vector<PendingOperator> operator_stack_{};
+  std::vector<ExprPtr> operand_stack_{};
+
+  // Syntax errors are reported where they are found and then passed up, without throwing, to the ParseDeclaration
+  // that synchronizes past them.
+  template<typename T> using Parsed = Expected<T, ParseError>;
+
+  [[nodiscard]] Parsed<Stmt> ParseFunction(std::string_view);
+  [[nodiscard]] Parsed<Stmt> ParseVarDeclaration();
+  [[nodiscard]] Parsed<Stmt> ParseStatement();
+  [[nodiscard]] Parsed<Stmt> ParseIf();
+  [[nodiscard]] Parsed<Stmt> ParseFor();
+  [[nodiscard]] Parsed<Stmt> ParsePrint();
+  [[nodiscard]] Parsed<Stmt> ParseReturn();
+  [[nodiscard]] Parsed<Stmt> ParseWhile();
+  [[nodiscard]] Parsed<std::span<Stmt>> ParseBlock();
+  // Moves past the rest of a block whose `{` has been consumed, checking only that its brackets pair up.
+  [[nodiscard]] Parsed<Token> SkipBlock();
+  [[nodiscard]] Parsed<Stmt> ParseExpressionStatement();
+  [[nodiscard]] Parsed<ExprPtr> ParseExpression();
+  [[nodiscard]] Parsed<ExprPtr> ParsePrimary();
+  // Pops the operator on top of operator_stack_ and replaces its operands with the expression it makes.
+  void Reduce();
 
   template<typename... TokenTypes> bool Match(TokenTypes... types) { return (... || Match(types)); };
   [[nodiscard]] bool Match(TokenType type);
   [[nodiscard]] bool Check(TokenType type) const;
-  [[nodiscard]] bool IsAtEnd() const;
-  [[nodiscard]] Token Peek() const;
-  [[nodiscard]] Token Previous() const;
-  Token Advance();
-  Token Consume(TokenType, std::string_view message);
+  // Tokens are read by index; Peek and Previous build a Token only for callers that keep one.
+  [[nodiscard]] TokenType PeekType() const { return tokens_->Type(current_); }
+  [[nodiscard]] Token Peek() const { return tokens_->At(current_); }
+  [[nodiscard]] Token Previous() const { return tokens_->At(current_ - 1); }
+  void Advance();
+  [[nodiscard]] Parsed<Token> Consume(TokenType, std::string_view message);
+  // The message is only formatted when there is an error to report.
+  template<typename... Args>
+  [[nodiscard]] Parsed<Token> Consume(TokenType type, fmt::format_string<Args...> message, Args &&...args)
+  {
+    if (Check(type)) {
+      Advance();
+      return Previous();
+    }
+    return Unexpected{ Error(Peek(), fmt::format(message, std::forward<Args>(args)...)) };
+  }
 
+  // Reports an error at `token`. Callers that cannot go on return the result as the Unexpected half of a Parsed.
   ParseError Error(const Token &token, std::string_view message);
 
-  [[nodiscard]] ExprPtr FinishCall(ExprPtr);
-
   void Synchronize();
+
+  // Parses top-level declarations from `from` on until one starts at or after `to`, and returns where that is.
+  std::size_t ParseRange(std::size_t from, std::size_t to, std::vector<Stmt> &statements);
+  void ParseChunk(Chunk &chunk) const;
 };
 
 
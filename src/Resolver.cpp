@@ -0,0 +1,126 @@
+#include "Resolver.h"
+#include "Ast.h"
+#include "Token.h"
+
+#include <span>
+#include <variant>
+#include <vector>
+
+void Resolver::Resolve(std::span<Stmt> stmts)
+{
+  for (auto &stmt : stmts) { Resolve(stmt); }
+}
+
+void Resolver::Resolve(Stmt &stmt) { std::visit(*this, stmt); }
+
+void Resolver::Resolve(Expr &expr) { std::visit(*this, expr); }
+
+void Resolver::ResolveFunction(stmt::Function &function)
+{
+  // Parameters and body share a single environment at runtime, see LoxFunction::Call.
+  BeginScope();
+  for (const auto &param : function.params) { Declare(param); }
+  Resolve(function.body);
+  EndScope();
+}
+
+void Resolver::ResolveLocal(const Token &name, Slot &slot) const
+{
+  slot = Slot{};
+  for (auto i = static_cast<int>(scopes_.size()) - 1; i >= 0; --i) {
+    auto binding = scopes_[i].slots.find(name.Symbol());
+    if (binding != scopes_[i].slots.end()) {
+      slot = Slot{ static_cast<int>(scopes_.size()) - 1 - i, binding->second };
+      return;
+    }
+  }
+}
+
+void Resolver::BeginScope() { scopes_.emplace_back(); }
+
+void Resolver::EndScope() { scopes_.pop_back(); }
+
+void Resolver::Declare(const Token &name)
+{
+  if (scopes_.empty()) { return; }
+
+  auto &scope = scopes_.back();
+  scope.slots.insert_or_assign(name.Symbol(), scope.size++);
+}
+
+auto Resolver::operator()(expr::Assign &assign) -> void
+{
+  Resolve(*assign.value);
+  ResolveLocal(assign.name, assign.slot);
+}
+
+auto Resolver::operator()(expr::Binary &binary) -> void
+{
+  Resolve(*binary.left);
+  Resolve(*binary.right);
+}
+
+auto Resolver::operator()(expr::Call &call) -> void
+{
+  Resolve(*call.callee);
+  for (auto &argument : call.arguments) { Resolve(*argument); }
+}
+
+auto Resolver::operator()(expr::Grouping &grouping) -> void { Resolve(*grouping.expression); }
+
+auto Resolver::operator()([[maybe_unused]] expr::Literal &literal) -> void {}
+
+auto Resolver::operator()(expr::Logical &logical) -> void
+{
+  Resolve(*logical.left);
+  Resolve(*logical.right);
+}
+
+auto Resolver::operator()(expr::Unary &unary) -> void { Resolve(*unary.right); }
+
+auto Resolver::operator()(expr::Variable &variable) -> void { ResolveLocal(variable.name, variable.slot); }
+
+auto Resolver::operator()(stmt::Expression &expression) -> void { Resolve(*expression.expression); }
+
+auto Resolver::operator()(stmt::Function &function) -> void
+{
+  // Declared first, so the body can call the function.
+  Declare(function.name);
+  ResolveFunction(function);
+}
+
+auto Resolver::operator()(stmt::If &stmt) -> void
+{
+  Resolve(*stmt.condition);
+  Resolve(*stmt.then_branch);
+  Resolve(*stmt.else_branch);
+}
+
+auto Resolver::operator()(stmt::Print &print) -> void { Resolve(*print.expression); }
+
+auto Resolver::operator()(stmt::Return &stmt) -> void
+{
+  if (stmt.value) { Resolve(*stmt.value); }
+}
+
+auto Resolver::operator()(stmt::Var &var) -> void
+{
+  // The initializer runs before the name is bound, so a name it reads is one from outside.
+  if (var.initializer) { Resolve(*var.initializer); }
+  Declare(var.name);
+}
+
+auto Resolver::operator()(stmt::While &stmt) -> void
+{
+  Resolve(*stmt.condition);
+  Resolve(*stmt.body);
+}
+
+auto Resolver::operator()([[maybe_unused]] stmt::Empty &empty) -> void {}
+
+auto Resolver::operator()(stmt::Block &block) -> void
+{
+  BeginScope();
+  Resolve(block.statements);
+  EndScope();
+}
@@ -0,0 +1,62 @@
+#ifndef LOX_RESOLVER_H
+#define LOX_RESOLVER_H
+
+#include "Ast.h"
+#include "ErrorReporter.h"
+#include "SymbolTable.h"
+#include "Token.h"
+
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Static pass run between parsing and interpretation. Annotates every expr::Variable and expr::Assign with the
+// Slot its name resolves to, so the interpreter can reach locals by index instead of by name.
+class Resolver
+{
+public:
+  explicit Resolver(ErrorReporterPtr error_reporter) : error_reporter_{ std::move(error_reporter) } {}
+
+  void Resolve(std::span<Stmt> stmts);
+  auto operator()(expr::Assign &assign) -> void;
+  auto operator()(expr::Binary &binary) -> void;
+  auto operator()(expr::Call &call) -> void;
+  auto operator()(expr::Grouping &grouping) -> void;
+  auto operator()(expr::Literal &literal) -> void;
+  auto operator()(expr::Logical &logical) -> void;
+  auto operator()(expr::Unary &unary) -> void;
+  auto operator()(expr::Variable &variable) -> void;
+  auto operator()(stmt::Expression &expression) -> void;
+  auto operator()(stmt::Function &function) -> void;
+  auto operator()(stmt::If &stmt) -> void;
+  auto operator()(stmt::Print &print) -> void;
+  auto operator()(stmt::Return &stmt) -> void;
+  auto operator()(stmt::Var &var) -> void;
+  auto operator()(stmt::While &stmt) -> void;
+  auto operator()(stmt::Empty &empty) -> void;
+  auto operator()(stmt::Block &block) -> void;
+
+private:
+  // The slot of each name declared in a local scope so far. Every declaration takes the next slot, as the interpreter
+  // hands them out, so one that repeats a name shadows the earlier one from there on.
+  struct Scope
+  {
+    std::unordered_map<SymbolId, int> slots{};
+    int size{ 0 };
+  };
+
+  ErrorReporterPtr error_reporter_;
+  std::vector<Scope> scopes_{};
+
+  void Resolve(Stmt &stmt);
+  void Resolve(Expr &expr);
+  void ResolveFunction(stmt::Function &function);
+  void ResolveLocal(const Token &name, Slot &slot) const;
+  void BeginScope();
+  void EndScope();
+  void Declare(const Token &name);
+};
+
+
+#endif// LOX_RESOLVER_H
@@ -1,19 +1,19 @@
 #ifndef LOX_RETURN_H
 #define LOX_RETURN_H
 
-#include "Common.h"
+#include "Value.h"
 #include <exception>
 #include <utility>
 
 class Return : public std::exception
 {
 public:
-  explicit Return(ObjectT value) : value_{ std::move(value) } {}
+  explicit Return(Value value) : value_{ std::move(value) } {}
 
-  [[nodiscard]] auto GetValue() const -> const ObjectT & { return value_; }
+  [[nodiscard]] auto GetValue() const -> const Value & { return value_; }
 
 private:
-  ObjectT value_;
+  Value value_;
 };
 
 #endif// LOX_RETURN_H
@@ -0,0 +1,382 @@
+#include "ScanKernels.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define LOX_SCAN_SSE2 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define LOX_SCAN_AVX2 1
+#endif
+#endif
+
+namespace scan {
+namespace {
+
+  using SkipWhitespaceFn = const char *(*)(const char *, const char *);
+  using FindFn = const char *(*)(const char *, const char *, char);
+  using SkipIdentifierFn = const char *(*)(const char *, const char *);
+  using SkipAsciiFn = const char *(*)(const char *, const char *);
+  using ValidateUtf8Fn = const char *(*)(const char *, const char *, const char *);
+
+  struct Kernels
+  {
+    SkipWhitespaceFn skip_whitespace;
+    FindFn find;
+    SkipIdentifierFn skip_identifier;
+    ValidateUtf8Fn validate_utf8;
+    std::string_view name;
+  };
+
+  constexpr bool IsWhitespace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+  constexpr bool IsIdentifierChar(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+  }
+
+  const char *SkipWhitespaceScalar(const char *p, const char *end)
+  {
+    while (p != end && IsWhitespace(*p)) { ++p; }
+    return p;
+  }
+
+  const char *FindScalar(const char *p, const char *end, char c)
+  {
+    while (p != end && *p != c) { ++p; }
+    return p;
+  }
+
+  const char *SkipIdentifierScalar(const char *p, const char *end)
+  {
+    while (p != end && IsIdentifierChar(*p)) { ++p; }
+    return p;
+  }
+
+  const char *SkipAsciiScalar(const char *p, const char *end)
+  {
+    while (p != end && static_cast<unsigned char>(*p) < 0x80) { ++p; }
+    return p;
+  }
+
+  // Length of the well-formed UTF-8 sequence that starts at the non-ASCII byte `p`, or 0 if it is malformed.
+  std::size_t SequenceLength(const char *p, const char *end)
+  {
+    auto byte = [&](std::ptrdiff_t i) { return p + i < end ? static_cast<unsigned char>(p[i]) : 0U; };
+    auto continuation = [](unsigned c) { return (c & 0xC0U) == 0x80U; };
+
+    auto lead = byte(0);
+    auto second = byte(1);
+    if (lead >= 0xC2 && lead <= 0xDF) { return continuation(second) ? 2 : 0; }
+
+    // The second byte's range rules out overlong forms (E0, F0), surrogates (ED) and code points past U+10FFFF (F4).
+    auto second_low = lead == 0xE0 ? 0xA0U : lead == 0xF0 ? 0x90U : 0x80U;
+    auto second_high = lead == 0xED ? 0x9FU : lead == 0xF4 ? 0x8FU : 0xBFU;
+    if (second < second_low || second > second_high) { return 0; }
+    if (lead >= 0xE0 && lead <= 0xEF) { return continuation(byte(2)) ? 3 : 0; }
+    if (lead >= 0xF0 && lead <= 0xF4) { return continuation(byte(2)) && continuation(byte(3)) ? 4 : 0; }
+    return 0;
+  }
+
+  // Checks the sequences that start in [p, stop), skipping runs of ASCII with `skip_ascii`. Returns the first byte that
+  // is not well-formed, or where the last sequence ended.
+  const char *ValidateRuns(const char *p, const char *stop, const char *end, SkipAsciiFn skip_ascii)
+  {
+    while (p < stop && (p = skip_ascii(p, stop)) != stop) {
+      while (p < stop && static_cast<unsigned char>(*p) >= 0x80) {
+        auto length = SequenceLength(p, end);
+        if (length == 0) { return p; }
+        p += length;
+      }
+    }
+    return std::max(p, stop);
+  }
+
+#ifndef LOX_SCAN_SSE2
+  // The vector validators run ValidateRuns themselves, so this is only needed where there are none.
+  const char *ValidateUtf8Scalar(const char *p, const char *stop, const char *end)
+  {
+    return ValidateRuns(p, stop, end, SkipAsciiScalar);
+  }
+#endif
+
+  // The vector kernels build a bit mask per block, one bit per byte, then use the lowest set bit to find where the run
+  // stops. Whatever is left once a full block no longer fits is handed to the scalar kernel.
+
+#ifdef LOX_SCAN_SSE2
+  // Bytes of `chunk` that fall in [lo, lo + span], compared as unsigned.
+  __m128i InRangeSse2(__m128i chunk, char lo, char span)
+  {
+    auto shifted = _mm_sub_epi8(chunk, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+  }
+
+  const char *SkipWhitespaceSse2(const char *p, const char *end)
+  {
+    for (; end - p >= 16; p += 16) {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      auto blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                  _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))));
+      auto stop_mask = ~static_cast<unsigned>(_mm_movemask_epi8(blank)) & 0xFFFFU;
+      if (stop_mask != 0) { return p + std::countr_zero(stop_mask); }
+    }
+    return SkipWhitespaceScalar(p, end);
+  }
+
+  const char *FindSse2(const char *p, const char *end, char c)
+  {
+    for (; end - p >= 16; p += 16) {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(c))));
+      if (mask != 0) { return p + std::countr_zero(mask); }
+    }
+    return FindScalar(p, end, c);
+  }
+
+  const char *SkipIdentifierSse2(const char *p, const char *end)
+  {
+    for (; end - p >= 16; p += 16) {
+      auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      auto letter = InRangeSse2(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+      auto digit = InRangeSse2(chunk, '0', '9' - '0');
+      auto underscore = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_'));
+      auto word = _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+      auto stop_mask = ~static_cast<unsigned>(_mm_movemask_epi8(word)) & 0xFFFFU;
+      if (stop_mask != 0) { return p + std::countr_zero(stop_mask); }
+    }
+    return SkipIdentifierScalar(p, end);
+  }
+
+  const char *SkipAsciiSse2(const char *p, const char *end)
+  {
+    for (; end - p >= 16; p += 16) {
+      auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));
+      if (mask != 0) { return p + std::countr_zero(mask); }
+    }
+    return SkipAsciiScalar(p, end);
+  }
+
+  // SSE2 has no byte shuffle to run the table lookups of the AVX2 validator on, so it only skips ASCII a vector at a
+  // time.
+  const char *ValidateUtf8Sse2(const char *p, const char *stop, const char *end)
+  {
+    return ValidateRuns(p, stop, end, SkipAsciiSse2);
+  }
+#endif
+
+#ifdef LOX_SCAN_AVX2
+#define LOX_TARGET_AVX2 __attribute__((target("avx2")))
+
+  LOX_TARGET_AVX2 __m256i InRangeAvx2(__m256i chunk, char lo, char span)
+  {
+    auto shifted = _mm256_sub_epi8(chunk, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)), shifted);
+  }
+
+  LOX_TARGET_AVX2 const char *SkipWhitespaceAvx2(const char *p, const char *end)
+  {
+    for (; end - p >= 32; p += 32) {
+      auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+      auto blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                                     _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(
+          _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n'))));
+      auto stop_mask = ~static_cast<unsigned>(_mm256_movemask_epi8(blank));
+      if (stop_mask != 0) { return p + std::countr_zero(stop_mask); }
+    }
+    return SkipWhitespaceSse2(p, end);
+  }
+
+  LOX_TARGET_AVX2 const char *FindAvx2(const char *p, const char *end, char c)
+  {
+    for (; end - p >= 32; p += 32) {
+      auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+      auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c))));
+      if (mask != 0) { return p + std::countr_zero(mask); }
+    }
+    return FindSse2(p, end, c);
+  }
+
+  LOX_TARGET_AVX2 const char *SkipIdentifierAvx2(const char *p, const char *end)
+  {
+    for (; end - p >= 32; p += 32) {
+      auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+      auto letter = InRangeAvx2(_mm256_or_si256(chunk, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+      auto digit = InRangeAvx2(chunk, '0', '9' - '0');
+      auto underscore = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_'));
+      auto word = _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+      auto stop_mask = ~static_cast<unsigned>(_mm256_movemask_epi8(word));
+      if (stop_mask != 0) { return p + std::countr_zero(stop_mask); }
+    }
+    return SkipIdentifierSse2(p, end);
+  }
+
+  LOX_TARGET_AVX2 const char *SkipAsciiAvx2(const char *p, const char *end)
+  {
+    for (; end - p >= 32; p += 32) {
+      auto mask =
+        static_cast<unsigned>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))));
+      if (mask != 0) { return p + std::countr_zero(mask); }
+    }
+    return SkipAsciiSse2(p, end);
+  }
+
+  // Keiser and Lemire's lookup validator. Every byte is classified together with the one before it by three 16-entry
+  // tables, indexed by the high and low nibble of the previous byte and the high nibble of the current one; each bit
+  // of an entry stands for one kind of error, and a pair is malformed when all three lookups agree on a bit. Third and
+  // fourth bytes of a sequence are checked separately against the lead two and three bytes back.
+  constexpr char kTooShort = 1 << 0;// Lead byte followed by ASCII or another lead.
+  constexpr char kTooLong = 1 << 1;// ASCII followed by a continuation byte.
+  constexpr char kOverlong3 = 1 << 2;// E0 80..9F
+  constexpr char kTooLarge = 1 << 3;// F4 90..BF, or F5..FF followed by 90..BF.
+  constexpr char kSurrogate = 1 << 4;// ED A0..BF
+  constexpr char kOverlong2 = 1 << 5;// C0 or C1 as a lead.
+  constexpr char kTooLarge1000 = 1 << 6;// F5..FF followed by 80..8F.
+  constexpr char kOverlong4 = 1 << 6;// F0 80..8F
+  constexpr char kTwoContinuations = static_cast<char>(1 << 7);
+  constexpr char kCarry = kTooShort | kTooLong | kTwoContinuations;// Errors that don't depend on the low nibble.
+
+  LOX_TARGET_AVX2 __m256i Table16(char c0, char c1, char c2, char c3, char c4, char c5, char c6, char c7, char c8,
+    char c9, char c10, char c11, char c12, char c13, char c14, char c15)
+  {
+    return _mm256_setr_epi8(c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12, c13, c14, c15,
+      c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12, c13, c14, c15);
+  }
+
+  LOX_TARGET_AVX2 __m256i HighNibbles(__m256i bytes)
+  {
+    return _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F));
+  }
+
+  // `input` shifted up by N bytes, with the last N bytes of `previous` shifted in.
+  template<int N> LOX_TARGET_AVX2 __m256i PreviousAvx2(__m256i input, __m256i previous)
+  {
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
+  }
+
+  LOX_TARGET_AVX2 __m256i Utf8ErrorsAvx2(__m256i input, __m256i previous)
+  {
+    const auto byte_1_high_table = Table16(kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+      kTooLong, kTwoContinuations, kTwoContinuations, kTwoContinuations, kTwoContinuations,
+      kTooShort | kOverlong2, kTooShort, kTooShort | kOverlong3 | kSurrogate,
+      kTooShort | kTooLarge | kTooLarge1000 | kOverlong4);
+    constexpr char kCarryLarge = kCarry | kTooLarge | kTooLarge1000;
+    const auto byte_1_low_table = Table16(kCarry | kOverlong3 | kOverlong2 | kOverlong4, kCarry | kOverlong2, kCarry,
+      kCarry, kCarry | kTooLarge, kCarryLarge, kCarryLarge, kCarryLarge, kCarryLarge, kCarryLarge, kCarryLarge,
+      kCarryLarge, kCarryLarge, kCarryLarge | kSurrogate, kCarryLarge, kCarryLarge);
+    constexpr char kContinuation = kTooLong | kOverlong2 | kTwoContinuations;
+    const auto byte_2_high_table = Table16(kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+      kTooShort, kTooShort, kContinuation | kOverlong3 | kTooLarge1000 | kOverlong4,
+      kContinuation | kOverlong3 | kTooLarge, kContinuation | kSurrogate | kTooLarge,
+      kContinuation | kSurrogate | kTooLarge, kTooShort, kTooShort, kTooShort, kTooShort);
+
+    auto previous_1 = PreviousAvx2<1>(input, previous);
+    auto byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, HighNibbles(previous_1));
+    auto byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(previous_1, _mm256_set1_epi8(0x0F)));
+    auto byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, HighNibbles(input));
+    auto special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Bytes two after a three or four byte lead, or three after a four byte lead, have their top bit set here.
+    auto third = _mm256_subs_epu8(PreviousAvx2<2>(input, previous), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    auto fourth = _mm256_subs_epu8(PreviousAvx2<3>(input, previous), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    auto must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must_continue, special_cases);
+  }
+
+  LOX_TARGET_AVX2 const char *ValidateUtf8Avx2(const char *p, const char *stop, const char *end)
+  {
+    const auto *begin = p;
+    // Bytes of the last block that would need more bytes after them to finish a sequence.
+    const auto incomplete_limit = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1),
+      static_cast<char>(0xC0 - 1));
+    auto previous = _mm256_setzero_si256();
+    auto incomplete = _mm256_setzero_si256();
+    while (stop - p >= 32) {
+      auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+      if (_mm256_movemask_epi8(input) == 0) {
+        // An ASCII block is only wrong if the one before left a sequence open. The rest of the run needs no tables,
+        // and zeroes stand in for the ASCII before the next block as far as the lookups are concerned.
+        if (_mm256_testz_si256(incomplete, incomplete) == 0) { break; }
+        p = SkipAsciiAvx2(p + 32, stop);
+        previous = _mm256_setzero_si256();
+        continue;
+      }
+      auto errors = Utf8ErrorsAvx2(input, previous);
+      if (_mm256_testz_si256(errors, errors) == 0) { break; }
+      incomplete = _mm256_subs_epu8(input, incomplete_limit);
+      previous = input;
+      p += 32;
+    }
+
+    // Whatever is left, and the block with an error in it if there is one, goes to the scalar check so the error gets
+    // an exact position. It starts over at the lead byte of any sequence the blocks before left open.
+    const auto *restart = p;
+    for (auto back = 1; back <= 3 && p - back >= begin; ++back) {
+      auto c = static_cast<unsigned char>(p[-back]);
+      if (c < 0x80) { break; }
+      if (c >= 0xC0) {
+        restart = p - back;
+        break;
+      }
+    }
+    return ValidateRuns(restart, stop, end, SkipAsciiSse2);
+  }
+
+#undef LOX_TARGET_AVX2
+#endif
+
+  Kernels Select()
+  {
+#ifdef LOX_SCAN_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+      return { SkipWhitespaceAvx2, FindAvx2, SkipIdentifierAvx2, ValidateUtf8Avx2, "avx2" };
+    }
+#endif
+#ifdef LOX_SCAN_SSE2
+    return { SkipWhitespaceSse2, FindSse2, SkipIdentifierSse2, ValidateUtf8Sse2, "sse2" };
+#else
+    return { SkipWhitespaceScalar, FindScalar, SkipIdentifierScalar, ValidateUtf8Scalar, "scalar" };
+#endif
+  }
+
+  const Kernels &Selected()
+  {
+    static const Kernels kernels = Select();
+    return kernels;
+  }
+
+}// namespace
+
+std::size_t SkipWhitespace(std::string_view text, std::size_t pos)
+{
+  // Most runs between tokens are a single space or nothing at all; don't pay for a vector load on those.
+  if (pos >= text.size() || !IsWhitespace(text[pos])) { return pos; }
+  if (pos + 1 < text.size() && !IsWhitespace(text[pos + 1])) { return pos + 1; }
+  return Selected().skip_whitespace(text.data() + pos, text.data() + text.size()) - text.data();
+}
+
+std::size_t Find(std::string_view text, std::size_t pos, char c)
+{
+  if (pos >= text.size()) { return text.size(); }
+  return Selected().find(text.data() + pos, text.data() + text.size(), c) - text.data();
+}
+
+std::size_t SkipIdentifier(std::string_view text, std::size_t pos)
+{
+  if (pos >= text.size()) { return text.size(); }
+  return Selected().skip_identifier(text.data() + pos, text.data() + text.size()) - text.data();
+}
+
+std::size_t ValidateUtf8(std::string_view text, std::size_t pos, std::size_t to)
+{
+  if (pos >= to) { return pos; }
+  return Selected().validate_utf8(text.data() + pos, text.data() + to, text.data() + text.size()) - text.data();
+}
+
+std::string_view KernelName() { return Selected().name; }
+
+}// namespace scan
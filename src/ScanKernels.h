@@ -0,0 +1,31 @@
+#ifndef LOX_SCAN_KERNELS_H
+#define LOX_SCAN_KERNELS_H
+
+#include <cstddef>
+#include <string_view>
+
+// Character-run primitives for the Scanner. Each one has an AVX2, an SSE2 and a scalar implementation; the widest one
+// the CPU supports is picked on first use. All of them return a position in `text` and never read past its end.
+namespace scan {
+
+// Position of the first character at or after `pos` that is not a space, tab, carriage return or newline.
+[[nodiscard]] std::size_t SkipWhitespace(std::string_view text, std::size_t pos);
+
+// Position of the first `c` at or after `pos`, or `text.size()` if there is none.
+[[nodiscard]] std::size_t Find(std::string_view text, std::size_t pos, char c);
+
+// Position of the first character at or after `pos` that cannot continue an identifier.
+[[nodiscard]] std::size_t SkipIdentifier(std::string_view text, std::size_t pos);
+
+// Checks the UTF-8 sequences that start in [pos, to), reading past `to` to finish the last one. Returns the position of
+// the first byte that is not part of well-formed UTF-8 if there is one, and otherwise where the last sequence ended,
+// which is at least `to`. Overlong forms, surrogates and code points above U+10FFFF are rejected. The AVX2 version
+// checks a whole vector of any text at a time; the others only skip runs of ASCII that way.
+[[nodiscard]] std::size_t ValidateUtf8(std::string_view text, std::size_t pos, std::size_t to);
+
+// Name of the implementation in use: "avx2", "sse2" or "scalar".
+[[nodiscard]] std::string_view KernelName();
+
+}// namespace scan
+
+#endif// LOX_SCAN_KERNELS_H
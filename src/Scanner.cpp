@@ -1,9 +1,21 @@
 #include "Scanner.h"
+#include "Keywords.h"
+#include "Parallel.h"
+#include "ScanKernels.h"
+#include "SymbolTable.h"
 #include "Token.h"
+#include "TokenStream.h"
+#include "Unicode.h"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <fmt/core.h>
+#include <iterator>
+#include <limits>
 #include <string>
-#include <unordered_map>
-#include <variant>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 
@@ -11,16 +23,18 @@ bool Scanner::IsAtEnd() const { return current_ >= source_.size(); }
 
 bool Scanner::IsDigit(char c) { return c >= '0' && c <= '9'; }
 
-bool Scanner::IsAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+bool Scanner::IsHexDigit(char c) { return IsDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f'); }
+
+bool Scanner::IsBinaryDigit(char c) { return c == '0' || c == '1'; }
 
-bool Scanner::IsAlphaNumeric(char c) { return IsAlpha(c) || IsDigit(c); }
+bool Scanner::IsAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
 
-char Scanner::Advance() { return source_.at(current_++); }
+char Scanner::Advance() { return source_[current_++]; }
 
 bool Scanner::Match(char expected)
 {
   if (IsAtEnd()) { return false; }
-  if (source_.at(current_) != expected) { return false; }
+  if (source_[current_] != expected) { return false; }
 
   ++current_;
   return true;
@@ -29,56 +43,107 @@ bool Scanner::Match(char expected)
 char Scanner::Peek() const
 {
   if (IsAtEnd()) { return '\0'; }
-  return source_.at(current_);
+  return source_[current_];
 }
 
 char Scanner::PeekNext() const
 {
   if (current_ + 1 >= source_.size()) { return '\0'; }
-  return source_.at(current_ + 1);
+  return source_[current_ + 1];
 }
 
 void Scanner::String()
 {
-  while (Peek() != '"' && !IsAtEnd()) {
-    if (Peek() == '\n') { ++line_; }
-    Advance();
-  }
+  current_ = static_cast<int>(scan::Find(source_, current_, '"'));
 
   if (IsAtEnd()) {
-    error_reporter_->Report(line_, "", "Unterminated string.");
+    Error(base_ + current_, "Unterminated string.");
     return;
   }
 
   Advance();
+  AddToken(TokenType::STRING);
+}
 
-  auto value = source_.substr(start_ + 1, current_ - start_ - 2);
-  AddToken(TokenType::STRING, value);
+template<typename IsDigitFn> bool Scanner::Digits(IsDigitFn is_digit)
+{
+  auto separated = false;
+  while (is_digit(Peek()) || Peek() == '_') {
+    if (Peek() == '_') {
+      separated = true;
+      if (!is_digit(PeekNext())) { Error(base_ + current_, "A '_' in a number must be between two digits."); }
+    }
+    Advance();
+  }
+  return separated;
 }
 
 void Scanner::Number()
 {
-  while (IsDigit(Peek())) { Advance(); }
+  // 0x and 0b prefixes only count when a digit of that base follows; otherwise the 0 ends the number as before.
+  auto base = 10;
+  auto prefix = source_[start_] == '0' ? static_cast<char>(Peek() | 0x20) : '\0';
+  if (prefix == 'x' && IsHexDigit(PeekNext())) {
+    base = 16;
+  } else if (prefix == 'b' && IsBinaryDigit(PeekNext())) {
+    base = 2;
+  }
 
-  // Look for a fractional part.
-  if (Peek() == '.' && IsDigit(PeekNext())) {
-    // Consume the "."
+  auto separated = false;
+  auto fractional = false;
+  if (base == 10) {
+    separated = Digits(IsDigit);
+    if (Peek() == '.' && IsDigit(PeekNext())) {
+      Advance();
+      separated = Digits(IsDigit) || separated;
+      fractional = true;
+    }
+  } else {
     Advance();
+    separated = base == 16 ? Digits(IsHexDigit) : Digits(IsBinaryDigit);
+  }
 
-    while (IsDigit(Peek())) { Advance(); }
+  auto digits = source_.substr(start_, current_ - start_);
+  if (base != 10) { digits.remove_prefix(2); }
+  // The common case is parsed in place; only grouped literals need their separators taken out first.
+  std::string ungrouped{};
+  if (separated) {
+    std::copy_if(digits.begin(), digits.end(), std::back_inserter(ungrouped), [](char c) { return c != '_'; });
+    digits = ungrouped;
+  }
+
+  if (!fractional) {
+    std::uint64_t value{};
+    auto [rest, error] = std::from_chars(digits.data(), digits.data() + digits.size(), value, base);
+    if (error == std::errc{}) {
+      if (value <= static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
+        AddToken(TokenType::NUMBER, static_cast<int>(value));
+      } else {
+        AddToken(TokenType::NUMBER, static_cast<double>(value));
+      }
+      return;
+    }
+    if (base != 10) {
+      Error(base_ + start_, "Number literal is too large.");
+      AddToken(TokenType::NUMBER, 0);
+      return;
+    }
   }
 
-  AddToken(TokenType::NUMBER, std::stod(source_.substr(start_, current_ - start_)));
+  double value{};
+  std::from_chars(digits.data(), digits.data() + digits.size(), value);
+  AddToken(TokenType::NUMBER, value);
 }
 
 void Scanner::BlockComment()
 {
-  while (Peek() != '*' && PeekNext() != '/' && !IsAtEnd()) {
-    if (Peek() == '\n') { ++line_; }
+  while (true) {
+    current_ = static_cast<int>(scan::Find(source_, current_, '*'));
+    if (IsAtEnd() || PeekNext() == '/') { break; }
     Advance();
   }
   if (IsAtEnd()) {
-    error_reporter_->Report(line_, "", "Unterminated comment.");
+    Error(base_ + current_, "Unterminated comment.");
     return;
   }
   Advance();
@@ -87,44 +152,35 @@ void Scanner::BlockComment()
 
 void Scanner::Identifier()
 {
-  while (IsAlphaNumeric(Peek())) { Advance(); }
-
-  static std::unordered_map<std::string, TokenType> keywords_{
-    { "and", TokenType::AND },
-    { "class", TokenType::CLASS },
-    { "else", TokenType::ELSE },
-    { "false", TokenType::FALSE },
-    { "for", TokenType::FOR },
-    { "fun", TokenType::FUN },
-    { "if", TokenType::IF },
-    { "nil", TokenType::NIL },
-    { "or", TokenType::OR },
-    { "print", TokenType::PRINT },
-    { "return", TokenType::RETURN },
-    { "super", TokenType::SUPER },
-    { "this", TokenType::THIS },
-    { "true", TokenType::TRUE },
-    { "var", TokenType::VAR },
-    { "while", TokenType::WHILE },
-  };
-
+  current_ = static_cast<int>(scan::SkipIdentifier(source_, current_));
+  // The kernel stops at any non-ASCII byte; step over characters that may continue an identifier and carry on.
+  while (!IsAtEnd() && static_cast<unsigned char>(Peek()) >= 0x80) {
+    auto [code_point, length] = unicode::Decode(source_, current_);
+    if (!unicode::IsIdentifierContinue(code_point)) { break; }
+    current_ = static_cast<int>(scan::SkipIdentifier(source_, current_ + length));
+  }
 
   // See if the identifier is a reserved word.
   auto text = source_.substr(start_, current_ - start_);
-  auto type = keywords_.find(text);
-  if (type == keywords_.end()) {
-    AddToken(TokenType::IDENTIFIER);
+  auto type = keywords::Lookup(text);
+  if (type == TokenType::IDENTIFIER) {
+    if (speculative_) {
+      auto [local, inserted] = local_symbols_.try_emplace(text, static_cast<std::uint32_t>(local_names_.size()));
+      if (inserted) { local_names_.push_back(text); }
+      tokens_.Add(type, start_, current_ - start_, static_cast<SymbolId>(local->second));
+    } else {
+      tokens_.Add(type, start_, current_ - start_, SymbolTable::Global().Intern(text));
+    }
   } else {
-    AddToken(type->second);
+    AddToken(type);
   }
 }
 
-void Scanner::AddToken(TokenType type) { AddToken(type, std::monostate{}); }
+void Scanner::AddToken(TokenType type) { tokens_.Add(type, start_, current_ - start_); }
 
 void Scanner::AddToken(TokenType type, const LiteralT &literal)
 {
-  const std::string text = source_.substr(start_, current_ - start_);
-  tokens_.emplace_back(type, text, literal, line_);
+  tokens_.Add(type, start_, current_ - start_, literal);
 }
 
 void Scanner::ScanToken()
@@ -176,20 +232,13 @@ void Scanner::ScanToken()
   case '/':
     if (Match('/')) {
       // A comment goes until the end of the line.
-      while (Peek() != '\n' && !IsAtEnd()) { Advance(); }
+      current_ = static_cast<int>(scan::Find(source_, current_, '\n'));
     } else if (Match('*')) {
       BlockComment();
     } else {
       AddToken(TokenType::SLASH);
     }
     break;
-  case ' ':
-  case '\r':
-  case '\t':
-    break;
-  case '\n':
-    line_++;
-    break;
   case '"':
     String();
     break;
@@ -198,21 +247,187 @@ void Scanner::ScanToken()
       Number();
     } else if (IsAlpha(c)) {
       Identifier();
+    } else if (static_cast<unsigned char>(c) >= 0x80) {
+      // Non-ASCII characters are taken whole, so a stray one gets one error rather than one per byte.
+      auto [code_point, length] = unicode::Decode(source_, start_);
+      current_ = start_ + static_cast<int>(length);
+      if (unicode::IsIdentifierStart(code_point)) {
+        Identifier();
+      } else {
+        Error(base_ + start_, fmt::format("Unexpected character: {}", source_.substr(start_, length)));
+      }
     } else {
-      error_reporter_->Report(line_, "", fmt::format("Unexpected character: {}", c));
+      Error(base_ + start_, fmt::format("Unexpected character: {}", c));
     }
     break;
   }
 }
 
-std::vector<Token> Scanner::ScanTokens()
+void Scanner::Error(SourcePos pos, std::string message)
 {
-  while (!IsAtEnd()) {
-    start_ = current_;
+  if (hold_diagnostics_) {
+    diagnostics_.push_back({ pos, std::move(message) });
+  } else {
+    error_reporter_->Report(pos, "", message);
+  }
+}
+
+std::size_t Scanner::ScanRange(std::size_t from, std::size_t to)
+{
+  current_ = static_cast<int>(from);
+  while (true) {
+    auto next = scan::SkipWhitespace(source_, current_);
+    // Whatever is skipped here is whitespace, so stopping before it leaves the next range's start position valid.
+    if (next >= to || next >= source_.size()) { break; }
+    current_ = start_ = static_cast<int>(next);
     ScanToken();
   }
+  return static_cast<std::size_t>(current_);
+}
+
+TokenStream Scanner::Rejected(std::size_t invalid)
+{
+  hold_diagnostics_ = false;
+  diagnostics_.clear();
+  Error(base_ + static_cast<SourcePos>(invalid), "Source is not valid UTF-8.");
+  tokens_ = TokenStream{ source_, base_ };
+  tokens_.Add(TokenType::EOF_, static_cast<std::uint32_t>(source_.size()), 0);
+  return std::move(tokens_);
+}
+
+TokenStream Scanner::ScanTokens()
+{
+  // Typical scripts average a little over five bytes per token; guessing up front avoids most regrowth copies.
+  tokens_.Reserve(source_.size() / 5 + 1);
 
-  tokens_.emplace_back(TokenType::EOF_, "", std::monostate{}, line_);
+  // Validation runs one block ahead of scanning, so the scanner reads text that was just brought into cache. A token
+  // may run past the end of its block before that part is checked; what it scanned there is dropped if it was not
+  // valid, along with every error found on the way, as if validation had come first.
+  hold_diagnostics_ = true;
+  std::size_t checked{ 0 };
+  for (std::size_t scanned = 0; scanned < source_.size();) {
+    auto block_end = std::min(scanned + kValidationBlockSize, source_.size());
+    checked = scan::ValidateUtf8(source_, checked, std::max(checked, block_end));
+    if (checked < block_end) { return Rejected(checked); }
+    // Anything between where the range stopped and the block end is whitespace.
+    scanned = std::max(ScanRange(scanned, block_end), block_end);
+  }
+  hold_diagnostics_ = false;
+  for (auto &diagnostic : diagnostics_) { error_reporter_->Report(diagnostic.pos, "", diagnostic.message); }
+  diagnostics_.clear();
+  tokens_.Add(TokenType::EOF_, static_cast<std::uint32_t>(source_.size()), 0);
+
+  return std::move(tokens_);
+}
+
+void Scanner::ScanChunk(Chunk &chunk) const
+{
+  Scanner scanner{ source_, error_reporter_, base_ };
+  scanner.speculative_ = true;
+  scanner.hold_diagnostics_ = true;
+  scanner.tokens_.Reserve((chunk.to - std::min(chunk.from, chunk.to)) / 5 + 1);
+  chunk.stop = scanner.ScanRange(chunk.from, chunk.to);
+  chunk.tokens = std::move(scanner.tokens_);
+  chunk.names = std::move(scanner.local_names_);
+  chunk.diagnostics = std::move(scanner.diagnostics_);
+}
+
+TokenStream Scanner::ScanTokensParallel(unsigned threads)
+{
+  if (threads <= 1 || source_.size() < 2 * kMinChunkSize) { return ScanTokens(); }
+
+  // A few chunks per thread, so one slow chunk does not hold everything up.
+  auto chunk_size = std::max(kMinChunkSize, source_.size() / (4 * std::size_t{ threads }));
+  std::vector<Chunk> chunks{};
+  for (std::size_t from = 0; from < source_.size();) {
+    auto to = std::min(scan::Find(source_, std::min(from + chunk_size, source_.size()), '\n') + 1, source_.size());
+    chunks.push_back({ from, to });
+    from = to;
+  }
+
+  std::vector<std::size_t> invalid(chunks.size());
+  ParallelFor(chunks.size(), threads, [this, &chunks, &invalid](std::size_t i) {
+    invalid[i] = scan::ValidateUtf8(source_, chunks[i].from, chunks[i].to);
+  });
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    if (invalid[i] < chunks[i].to) { return Rejected(invalid[i]); }
+  }
+
+  ParallelFor(chunks.size(), threads, [this, &chunks](std::size_t i) { ScanChunk(chunks[i]); });
+
+  // A chunk's guess held if its predecessor stopped at or before its start, since the gap can only be whitespace.
+  for (std::size_t i = 1; i < chunks.size(); ++i) {
+    if (chunks[i - 1].stop > chunks[i].from) {
+      chunks[i].from = chunks[i - 1].stop;
+      ScanChunk(chunks[i]);
+    }
+  }
+
+  std::size_t token_count{ 0 };
+  std::size_t literal_count{ 0 };
+  std::vector<std::size_t> token_at{};
+  std::vector<std::size_t> literal_at{};
+  std::vector<std::vector<SymbolId>> symbols{};
+  for (auto &chunk : chunks) {
+    token_at.push_back(token_count);
+    literal_at.push_back(literal_count);
+    token_count += chunk.tokens.Size();
+    literal_count += chunk.tokens.LiteralCount();
+
+    auto &ids = symbols.emplace_back();
+    ids.reserve(chunk.names.size());
+    for (auto name : chunk.names) { ids.push_back(SymbolTable::Global().Intern(name)); }
+
+    for (auto &diagnostic : chunk.diagnostics) { error_reporter_->Report(diagnostic.pos, "", diagnostic.message); }
+  }
+
+  tokens_.Reserve(token_count + 1);
+  tokens_.Resize(token_count, literal_count);
+  ParallelFor(chunks.size(), threads, [&](std::size_t i) {
+    tokens_.Place(chunks[i].tokens, token_at[i], literal_at[i], symbols[i]);
+  });
+  tokens_.Add(TokenType::EOF_, static_cast<std::uint32_t>(source_.size()), 0);
+
+  return std::move(tokens_);
+}
+
+Scanner::Rescanned Scanner::Rescan(TokenStream previous, const TextEdit &edit)
+{
+  auto shift = static_cast<std::ptrdiff_t>(edit.inserted.size()) - static_cast<std::ptrdiff_t>(edit.removed);
+  auto edit_end = edit.offset + edit.inserted.size();
+  auto previous_eof = previous.Size() - 1;
+
+  if (auto invalid = scan::ValidateUtf8(source_, 0, source_.size()); invalid < source_.size()) {
+    return { Rejected(invalid), 0, previous.Size(), 1 };
+  }
+
+  // A token start is always scanned at the top level, never inside a string or comment, and the text before the edit
+  // is unchanged, so scanning can resume at any token that starts before it. It must also start after a gap: tokens
+  // that touch can merge into one once the edit lands, as `1` `.` `5` does into `1.5` and `0` `x1` into `0x1`.
+  auto first = previous.FindOffset(edit.offset);
+  if (first > 0) { --first; }
+  while (first > 0 && previous.Offset(first - 1) + previous.Lexeme(first - 1).size() == previous.Offset(first)) {
+    --first;
+  }
+
+  auto old_end = first;
+  current_ = first == 0 ? 0 : static_cast<int>(previous.Offset(first));
+  while (true) {
+    auto next = scan::SkipWhitespace(source_, current_);
+    if (next >= source_.size()) {
+      old_end = previous_eof;
+      break;
+    }
+    if (next >= edit_end) {
+      auto old_offset = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(next) - shift);
+      while (old_end < previous_eof && previous.Offset(old_end) < old_offset) { ++old_end; }
+      if (old_end < previous_eof && previous.Offset(old_end) == old_offset) { break; }
+    }
+    current_ = start_ = static_cast<int>(next);
+    ScanToken();
+  }
 
-  return tokens_;
+  auto new_end = first + tokens_.Size();
+  previous.Splice(first, old_end, tokens_, shift);
+  return { std::move(previous), first, old_end, new_end };
 }
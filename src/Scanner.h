@@ -3,31 +3,100 @@
 
 #include "Common.h"
 #include "ErrorReporter.h"
+#include "Source.h"
 #include "Token.h"
+#include "TokenStream.h"
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+// Splits source text into tokens. Lexemes and string literals are views into `source`, which must outlive the tokens.
+// Token positions start at `base`, the position SourceMap gave the text. The text must be UTF-8; identifiers may use
+// letters of any script, and string literals and comments may hold any character.
 class Scanner
 {
 public:
-  explicit Scanner(std::string_view source, ErrorReporterPtr reporter)
-    : source_{ source }, error_reporter_{ std::move(reporter) }
+  explicit Scanner(std::string_view source, ErrorReporterPtr reporter, SourcePos base = 0)
+    : source_{ source }, base_{ base }, error_reporter_{ std::move(reporter) }, tokens_{ source, base }
   {}
 
-  [[nodiscard]] std::vector<Token> ScanTokens();
+  [[nodiscard]] TokenStream ScanTokens();
+
+  // Scans with up to `threads` threads and returns exactly what ScanTokens would. The text is cut into chunks at line
+  // breaks and every chunk is scanned on the guess that it does not start inside a string or block comment. A chunk
+  // whose predecessor turns out to end past its start is scanned again, serially, from where the predecessor ended.
+  [[nodiscard]] TokenStream ScanTokensParallel(unsigned threads);
+
+  // Result of Rescan: tokens [first, old_end) of the previous stream were replaced by [first, new_end) of `tokens`;
+  // the tokens after them are the same as before, moved.
+  struct Rescanned
+  {
+    TokenStream tokens;
+    std::size_t first;
+    std::size_t old_end;
+    std::size_t new_end;
+  };
+
+  // Updates `previous`, scanned from this text before `edit` was applied, scanning again only the tokens the edit could
+  // have changed. Scanning restarts at the last token before the edit that does not touch the token before it, and
+  // stops at the first token after the edit that begins where a previous token began; from there on both texts are the
+  // same, so the rest of `previous` is only moved. Errors are reported for the rescanned part only.
+  [[nodiscard]] Rescanned Rescan(TokenStream previous, const TextEdit &edit);
 
 private:
-  std::string source_;
+  // Diagnostics of a chunk scan are held back until the chunk is known to be valid.
+  struct Diagnostic
+  {
+    SourcePos pos;
+    std::string message;
+  };
+
+  // One piece of a parallel scan. Identifiers are numbered locally, in order of first appearance, and only interned
+  // once all chunks are done, so SymbolIds come out the same as in a sequential scan.
+  struct Chunk
+  {
+    std::size_t from;
+    std::size_t to;
+    std::size_t stop{ 0 };
+    TokenStream tokens{};
+    std::vector<std::string_view> names{};
+    std::vector<Diagnostic> diagnostics{};
+  };
+
+  static constexpr std::size_t kMinChunkSize = 1 << 20;
+  // Small enough that a validated block is still in L2 cache when the scanner gets to it.
+  static constexpr std::size_t kValidationBlockSize = 64 << 10;
+
+  std::string_view source_;
+  SourcePos base_;
   ErrorReporterPtr error_reporter_;
-  std::vector<Token> tokens_{};
+  TokenStream tokens_;
   int start_{ 0 };
   int current_{ 0 };
-  int line_{ 1 };
+  // Set while scanning a Chunk.
+  bool speculative_{ false };
+  std::unordered_map<std::string_view, std::uint32_t> local_symbols_{};
+  std::vector<std::string_view> local_names_{};
+  // Set while scanning a Chunk, and while ScanTokens has not seen all of the text is valid yet. Errors found meanwhile
+  // are kept here instead of being reported.
+  bool hold_diagnostics_{ false };
+  std::vector<Diagnostic> diagnostics_{};
+
+  // Scans the tokens that start in [from, to); the last one may run past `to`. Returns where scanning stopped.
+  std::size_t ScanRange(std::size_t from, std::size_t to);
+  void ScanChunk(Chunk &chunk) const;
+
+  void Error(SourcePos pos, std::string message);
+  // The stream for text that is not valid UTF-8: one error at the first bad byte, and no tokens but EOF.
+  TokenStream Rejected(std::size_t invalid);
 
   [[nodiscard]] bool IsAtEnd() const;
 
+  // Scans one token starting at a character that is not whitespace.
   void ScanToken();
 
   char Advance();
@@ -39,13 +108,17 @@ private:
   void AddToken(TokenType type, const LiteralT &literal);
 
   void String();
+  // Consumes digits accepted by `is_digit`, optionally grouped with underscores; returns whether any were.
+  template<typename IsDigitFn> bool Digits(IsDigitFn is_digit);
+  // Decimal, 0x hexadecimal and 0b binary literals. Literals without a fractional part that fit become ints.
   void Number();
   void Identifier();
   void BlockComment();
 
   [[nodiscard]] static bool IsDigit(char c);
+  [[nodiscard]] static bool IsHexDigit(char c);
+  [[nodiscard]] static bool IsBinaryDigit(char c);
   [[nodiscard]] static bool IsAlpha(char c);
-  [[nodiscard]] static bool IsAlphaNumeric(char c);
 };
 
 
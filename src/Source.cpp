@@ -0,0 +1,113 @@
+#include "Source.h"
+#include "ScanKernels.h"
+#include "fmt/core.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LOX_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Source::Source(void *mapping, std::size_t size, SourcePos base)
+  : mapping_{ mapping }, text_{ static_cast<const char *>(mapping), size }, base_{ base }
+{}
+
+Source::~Source()
+{
+#ifdef LOX_HAVE_MMAP
+  if (mapping_ != nullptr) { munmap(mapping_, text_.size()); }
+#endif
+}
+
+std::unique_ptr<Source> Source::Load(std::string_view path, SourcePos base)
+{
+  if (path == "-") {
+    return std::make_unique<Source>(
+      std::string{ std::istreambuf_iterator<char>{ std::cin }, std::istreambuf_iterator<char>{} }, base);
+  }
+
+  std::string name{ path };
+#ifdef LOX_HAVE_MMAP
+  // Regular, non-empty files are mapped; the scanner and every token then read straight from the page cache.
+  if (auto fd = open(name.c_str(), O_RDONLY); fd != -1) {
+    struct stat info{};
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+      mapping = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+      return std::unique_ptr<Source>{ new Source{ mapping, static_cast<std::size_t>(info.st_size), base } };
+    }
+  }
+#endif
+
+  // Pipes, devices, empty files, and platforms without mmap.
+  std::ifstream file{ name, std::ios::binary };
+  if (!file) { throw std::runtime_error(fmt::format("File not found: {}", path)); }
+  return std::make_unique<Source>(
+    std::string{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} }, base);
+}
+
+int Source::Line(SourcePos pos) const
+{
+  std::call_once(line_starts_built_, [this]() {
+    line_starts_.push_back(0);
+    for (auto newline = scan::Find(text_, 0, '\n'); newline < text_.size();
+         newline = scan::Find(text_, newline + 1, '\n')) {
+      line_starts_.push_back(static_cast<std::uint32_t>(newline + 1));
+    }
+  });
+
+  auto line = std::upper_bound(line_starts_.begin(), line_starts_.end(), pos - base_) - line_starts_.begin();
+  return static_cast<int>(line);
+}
+
+const Source &SourceMap::Add(std::string text) { return Insert(std::make_unique<Source>(std::move(text), next_base_)); }
+
+const Source &SourceMap::AddFile(std::string_view path) { return Insert(Source::Load(path, next_base_)); }
+
+const Source &SourceMap::Insert(std::unique_ptr<Source> source)
+{
+  // One extra position so the end-of-file token of each source has a position of its own.
+  next_base_ += static_cast<SourcePos>(source->Text().size()) + 1;
+  return *sources_.emplace_back(std::move(source));
+}
+
+std::shared_ptr<const Source> SourceMap::Replace(std::string text)
+{
+  if (sources_.empty()) {
+    Add(std::move(text));
+    return sources_.back();
+  }
+
+  auto base = sources_.back()->Base();
+  auto source = std::make_shared<const Source>(std::move(text), base);
+  next_base_ = base + static_cast<SourcePos>(source->Text().size()) + 1;
+  sources_.back() = source;
+  return source;
+}
+
+int SourceMap::Line(SourcePos pos) const
+{
+  auto source = std::upper_bound(
+    sources_.begin(), sources_.end(), pos, [](SourcePos pos, const auto &source) { return pos < source->Base(); });
+  if (source == sources_.begin()) { return 0; }
+  return (*std::prev(source))->Line(pos);
+}
@@ -0,0 +1,80 @@
+#ifndef LOX_SOURCE_H
+#define LOX_SOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Byte position in the combined text of every Source in a SourceMap. Tokens and bytecode carry positions rather than
+// line numbers; lines are worked out from a position only when something has to be shown to the user.
+using SourcePos = std::uint32_t;
+
+// Text of one program. Tokens, and the AST nodes that embed them, refer into this buffer instead of owning copies,
+// so a Source has to outlive everything scanned from it. The buffer is either an owned string or a read-only mapping
+// of the script file.
+class Source
+{
+public:
+  explicit Source(std::string text, SourcePos base = 0) : owned_{ std::move(text) }, text_{ owned_ }, base_{ base } {}
+  ~Source();
+
+  Source(const Source &) = delete;
+  Source &operator=(const Source &) = delete;
+
+  // Maps `path` when it is a regular file and reads it otherwise, so pipes and devices work too; "-" reads standard
+  // input. Throws std::runtime_error if the file cannot be opened.
+  [[nodiscard]] static std::unique_ptr<Source> Load(std::string_view path, SourcePos base = 0);
+
+  [[nodiscard]] std::string_view Text() const { return text_; }
+  // Position of the first byte; the source covers [Base(), Base() + Text().size()], end included.
+  [[nodiscard]] SourcePos Base() const { return base_; }
+
+  // 1-based line of `pos`. The line-start index is built on the first call.
+  [[nodiscard]] int Line(SourcePos pos) const;
+
+private:
+  Source(void *mapping, std::size_t size, SourcePos base);
+
+  std::string owned_;
+  void *mapping_{ nullptr };
+  std::string_view text_;
+  SourcePos base_;
+  mutable std::once_flag line_starts_built_;
+  mutable std::vector<std::uint32_t> line_starts_;
+};
+
+// Replacement of `removed` bytes at `offset` by `inserted`.
+struct TextEdit
+{
+  std::size_t offset;
+  std::size_t removed;
+  std::string inserted;
+};
+
+// Owns every Source loaded into one Lox instance and gives each its own range of positions.
+class SourceMap
+{
+public:
+  const Source &Add(std::string text);
+  const Source &AddFile(std::string_view path);
+
+  // Swaps the last source for a new version of its text at the same base, so positions before an edit keep their
+  // meaning; adds `text` if there is no source yet. The old version lives on for as long as something holds it.
+  std::shared_ptr<const Source> Replace(std::string text);
+
+  // 1-based line of `pos` within whichever source it falls in.
+  [[nodiscard]] int Line(SourcePos pos) const;
+
+private:
+  std::vector<std::shared_ptr<const Source>> sources_;
+  SourcePos next_base_{ 0 };
+
+  const Source &Insert(std::unique_ptr<Source> source);
+};
+
+#endif// LOX_SOURCE_H
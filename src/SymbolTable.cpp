@@ -0,0 +1,28 @@
+#include "SymbolTable.h"
+
+#include <mutex>
+#include <string>
+#include <string_view>
+
+SymbolTable &SymbolTable::Global()
+{
+  static SymbolTable table{};
+  return table;
+}
+
+SymbolId SymbolTable::Intern(std::string_view name)
+{
+  std::lock_guard lock{ mutex_ };
+  if (auto existing = ids_.find(name); existing != ids_.end()) { return existing->second; }
+
+  auto id = static_cast<SymbolId>(names_.size());
+  const auto &stored = names_.emplace_back(name);
+  ids_.emplace(stored, id);
+  return id;
+}
+
+std::string_view SymbolTable::Name(SymbolId id) const
+{
+  std::lock_guard lock{ mutex_ };
+  return names_.at(Index(id));
+}
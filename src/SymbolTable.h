@@ -0,0 +1,63 @@
+#ifndef LOX_SYMBOL_TABLE_H
+#define LOX_SYMBOL_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Interned identifier. Ids are handed out densely from zero, so they index vectors directly and serve as their own
+// hash; the name's string hash is computed once, when it is first interned.
+enum class SymbolId : std::uint32_t {};
+
+inline constexpr SymbolId kNoSymbol{ std::numeric_limits<std::uint32_t>::max() };
+
+[[nodiscard]] constexpr std::size_t Index(SymbolId id) { return static_cast<std::size_t>(id); }
+
+// Process-wide table of identifier names. Interning is thread-safe; names are never removed, so a string_view
+// returned by Name stays valid for the life of the program.
+class SymbolTable
+{
+public:
+  [[nodiscard]] static SymbolTable &Global();
+
+  [[nodiscard]] SymbolId Intern(std::string_view name);
+  [[nodiscard]] std::string_view Name(SymbolId id) const;
+
+private:
+  mutable std::mutex mutex_;
+  std::deque<std::string> names_;
+  std::unordered_map<std::string_view, SymbolId> ids_;
+};
+
+// Values keyed by symbol, stored in a vector indexed by id.
+template<typename T> class SymbolMap
+{
+public:
+  [[nodiscard]] T *Find(SymbolId id)
+  {
+    auto index = Index(id);
+    return index < slots_.size() && slots_[index] ? &*slots_[index] : nullptr;
+  }
+
+  [[nodiscard]] const T *Find(SymbolId id) const { return const_cast<SymbolMap *>(this)->Find(id); }
+
+  void InsertOrAssign(SymbolId id, T value)
+  {
+    auto index = Index(id);
+    if (index >= slots_.size()) { slots_.resize(index + 1); }
+    slots_[index] = std::move(value);
+  }
+
+private:
+  std::vector<std::optional<T>> slots_;
+};
+
+#endif// LOX_SYMBOL_TABLE_H
@@ -2,10 +2,13 @@
 #define LOX_TOKEN_H
 
 #include "Common.h"
+#include "Source.h"
+#include "SymbolTable.h"
+#include <cstddef>
 #include <cstdint>
 #include <fmt/format.h>
 #include <magic_enum/magic_enum.hpp>
-#include <string>
+#include <string_view>
 #include <utility>
 
 enum class TokenType : std::uint8_t {
@@ -67,20 +70,35 @@ template<> struct fmt::formatter<TokenType>
 class Token
 {
 public:
-  Token(TokenType type, std::string lexeme, LiteralT literal, int line)
-    : type_{ type }, lexeme_{ std::move(lexeme) }, literal_{ std::move(literal) }, line_{ line }
+  Token(TokenType type, std::string_view lexeme, LiteralT literal, SourcePos pos, SymbolId symbol = kNoSymbol)
+    : lexeme_data_{ lexeme.data() }, literal_{ literal }, lexeme_length_{ static_cast<std::uint32_t>(lexeme.size()) },
+      pos_{ pos }, symbol_{ symbol }, type_{ type }
   {}
 
   [[nodiscard]] TokenType Type() const { return type_; }
-  [[nodiscard]] const std::string &Lexeme() const { return lexeme_; }
+  [[nodiscard]] std::string_view Lexeme() const { return { lexeme_data_, lexeme_length_ }; }
   [[nodiscard]] const LiteralT &Literal() const { return literal_; }
-  [[nodiscard]] int Line() const { return line_; }
+  // Position of the first character; see SourceMap::Line.
+  [[nodiscard]] SourcePos Pos() const { return pos_; }
+  // Interned name of an IDENTIFIER token; kNoSymbol for every other type.
+  [[nodiscard]] SymbolId Symbol() const { return symbol_; }
+
+  // The same token `delta` bytes away, for text that moved in an edit. The lexeme keeps pointing at the old text.
+  [[nodiscard]] Token Shifted(std::ptrdiff_t delta) const
+  {
+    auto token = *this;
+    token.pos_ = static_cast<SourcePos>(pos_ + delta);
+    return token;
+  }
 
 private:
-  TokenType type_;
-  std::string lexeme_;
+  // Ordered largest first so the padding is all at the end.
+  const char *lexeme_data_;
   LiteralT literal_;
-  int line_;
+  std::uint32_t lexeme_length_;
+  SourcePos pos_;
+  SymbolId symbol_;
+  TokenType type_;
 };
 
 template<> struct fmt::formatter<Token>
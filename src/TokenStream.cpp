@@ -0,0 +1,117 @@
+#include "TokenStream.h"
+#include "Token.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <variant>
+
+void TokenStream::Reserve(std::size_t count)
+{
+  types_.reserve(count);
+  offsets_.reserve(count);
+  lengths_.reserve(count);
+  aux_.reserve(count);
+}
+
+void TokenStream::Resize(std::size_t tokens, std::size_t literals)
+{
+  types_.resize(tokens);
+  offsets_.resize(tokens);
+  lengths_.resize(tokens);
+  aux_.resize(tokens);
+  literals_.resize(literals);
+}
+
+void TokenStream::Place(const TokenStream &part,
+  std::size_t token_at,
+  std::size_t literal_at,
+  std::span<const SymbolId> symbols)
+{
+  std::copy(part.types_.begin(), part.types_.end(), types_.begin() + token_at);
+  std::copy(part.offsets_.begin(), part.offsets_.end(), offsets_.begin() + token_at);
+  std::copy(part.lengths_.begin(), part.lengths_.end(), lengths_.begin() + token_at);
+  std::copy(part.literals_.begin(), part.literals_.end(), literals_.begin() + literal_at);
+
+  for (std::size_t i = 0; i < part.Size(); ++i) {
+    auto aux = part.aux_[i];
+    switch (part.types_[i]) {
+    case TokenType::IDENTIFIER:
+      aux = static_cast<std::uint32_t>(symbols[aux]);
+      break;
+    case TokenType::NUMBER:
+      aux += static_cast<std::uint32_t>(literal_at);
+      break;
+    default:
+      break;
+    }
+    aux_[token_at + i] = aux;
+  }
+}
+
+namespace {
+// Overwrites elements [first, last) of `column` with `with`, moving the elements after them only once.
+template<typename T>
+void ReplaceRange(std::vector<T> &column, std::size_t first, std::size_t last, const std::vector<T> &with)
+{
+  auto removed = last - first;
+  if (with.size() > removed) {
+    column.insert(column.begin() + static_cast<std::ptrdiff_t>(last), with.size() - removed, T{});
+  } else {
+    column.erase(column.begin() + static_cast<std::ptrdiff_t>(first + with.size()),
+      column.begin() + static_cast<std::ptrdiff_t>(last));
+  }
+  std::copy(with.begin(), with.end(), column.begin() + static_cast<std::ptrdiff_t>(first));
+}
+}// namespace
+
+std::size_t TokenStream::LiteralsBefore(std::size_t index) const
+{
+  // Literals are stored in row order, so this is one past the literal of the closest NUMBER row before `index`.
+  for (auto i = index; i > 0; --i) {
+    if (types_[i - 1] == TokenType::NUMBER) { return aux_[i - 1] + 1; }
+  }
+  return 0;
+}
+
+void TokenStream::Splice(std::size_t first, std::size_t last, const TokenStream &part, std::ptrdiff_t shift)
+{
+  auto literal_first = LiteralsBefore(first);
+  auto literal_last = LiteralsBefore(last);
+  auto literal_shift = static_cast<std::ptrdiff_t>(part.literals_.size() + literal_first)
+                       - static_cast<std::ptrdiff_t>(literal_last);
+
+  source_ = part.source_;
+  ReplaceRange(types_, first, last, part.types_);
+  ReplaceRange(offsets_, first, last, part.offsets_);
+  ReplaceRange(lengths_, first, last, part.lengths_);
+  ReplaceRange(aux_, first, last, part.aux_);
+  ReplaceRange(literals_, literal_first, literal_last, part.literals_);
+
+  auto part_end = first + part.Size();
+  for (auto i = first; i < part_end; ++i) {
+    if (types_[i] == TokenType::NUMBER) { aux_[i] += static_cast<std::uint32_t>(literal_first); }
+  }
+  for (auto i = part_end; i < Size(); ++i) { offsets_[i] = static_cast<std::uint32_t>(offsets_[i] + shift); }
+  if (literal_shift != 0) {
+    for (auto i = part_end; i < Size(); ++i) {
+      if (types_[i] == TokenType::NUMBER) { aux_[i] = static_cast<std::uint32_t>(aux_[i] + literal_shift); }
+    }
+  }
+}
+
+Token TokenStream::At(std::size_t index) const
+{
+  auto type = Type(index);
+  if (type == TokenType::NUMBER || type == TokenType::STRING) {
+    return { type, Lexeme(index), Literal(index), Pos(index) };
+  }
+  return { type, Lexeme(index), std::monostate{}, Pos(index), Symbol(index) };
+}
+
+std::size_t TokenStream::MemoryUsage() const
+{
+  return types_.capacity() * sizeof(TokenType) + offsets_.capacity() * sizeof(std::uint32_t)
+         + lengths_.capacity() * sizeof(std::uint32_t) + aux_.capacity() * sizeof(std::uint32_t)
+         + literals_.capacity() * sizeof(LiteralT);
+}
@@ -0,0 +1,105 @@
+#ifndef LOX_TOKEN_STREAM_H
+#define LOX_TOKEN_STREAM_H
+
+#include "Common.h"
+#include "Source.h"
+#include "SymbolTable.h"
+#include "Token.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Scanner output stored as parallel arrays, one entry per token, so the parser's type checks walk a dense byte array
+// instead of striding over full Token objects. The `aux` column is an index into `literals_` for NUMBER tokens and the
+// SymbolId for IDENTIFIER tokens; a STRING token's value is its lexeme without the quotes, so no row points into the
+// text. Token objects are only built, through At(), for the tokens an AST node or a diagnostic keeps.
+class TokenStream
+{
+public:
+  TokenStream() = default;
+  explicit TokenStream(std::string_view source, SourcePos base = 0) : source_{ source }, base_{ base } {}
+
+  void Reserve(std::size_t count);
+
+  // Assembly of one stream out of parts scanned separately over the same text. Resize makes room for every part, then
+  // each part is copied to its place; parts may be placed concurrently. A part's IDENTIFIER rows hold indices into
+  // `symbols` instead of SymbolIds.
+  void Resize(std::size_t tokens, std::size_t literals);
+  void Place(const TokenStream &part, std::size_t token_at, std::size_t literal_at, std::span<const SymbolId> symbols);
+
+  // Moves the stream onto an edited version of its text: rows [first, last) are replaced by `part`, which was scanned
+  // from the new text, and the offsets of the rows after them move by `shift`.
+  void Splice(std::size_t first, std::size_t last, const TokenStream &part, std::ptrdiff_t shift);
+
+  // `offset` is relative to the start of the scanned text.
+  void Add(TokenType type, std::uint32_t offset, std::uint32_t length) { AddRow(type, offset, length, 0); }
+  void Add(TokenType type, std::uint32_t offset, std::uint32_t length, const LiteralT &literal)
+  {
+    AddRow(type, offset, length, static_cast<std::uint32_t>(literals_.size()));
+    literals_.push_back(literal);
+  }
+  void Add(TokenType type, std::uint32_t offset, std::uint32_t length, SymbolId symbol)
+  {
+    AddRow(type, offset, length, static_cast<std::uint32_t>(symbol));
+  }
+
+  // The scanned text, and the position of its first byte.
+  [[nodiscard]] std::string_view Text() const { return source_; }
+  [[nodiscard]] SourcePos Base() const { return base_; }
+
+  [[nodiscard]] std::size_t Size() const { return types_.size(); }
+  [[nodiscard]] std::size_t LiteralCount() const { return literals_.size(); }
+  [[nodiscard]] TokenType Type(std::size_t index) const { return types_[index]; }
+  [[nodiscard]] std::string_view Lexeme(std::size_t index) const
+  {
+    return source_.substr(offsets_[index], lengths_[index]);
+  }
+  [[nodiscard]] SourcePos Pos(std::size_t index) const { return base_ + offsets_[index]; }
+  // Offset of the token's first character from the start of the scanned text.
+  [[nodiscard]] std::uint32_t Offset(std::size_t index) const { return offsets_[index]; }
+  // Index of the first token that starts at or after `offset`.
+  [[nodiscard]] std::size_t FindOffset(std::size_t offset) const
+  {
+    return std::lower_bound(offsets_.begin(), offsets_.end(), offset) - offsets_.begin();
+  }
+  [[nodiscard]] LiteralT Literal(std::size_t index) const
+  {
+    if (types_[index] == TokenType::STRING) { return source_.substr(offsets_[index] + 1, lengths_[index] - 2); }
+    return literals_[aux_[index]];
+  }
+  [[nodiscard]] SymbolId Symbol(std::size_t index) const
+  {
+    return types_[index] == TokenType::IDENTIFIER ? static_cast<SymbolId>(aux_[index]) : kNoSymbol;
+  }
+
+  [[nodiscard]] Token At(std::size_t index) const;
+
+  // Heap bytes held by the stream.
+  [[nodiscard]] std::size_t MemoryUsage() const;
+
+private:
+  std::string_view source_;
+  SourcePos base_{ 0 };
+  std::vector<TokenType> types_;
+  std::vector<std::uint32_t> offsets_;
+  std::vector<std::uint32_t> lengths_;
+  std::vector<std::uint32_t> aux_;
+  std::vector<LiteralT> literals_;
+
+  // Index in `literals_` of the first literal of row `index` or later.
+  [[nodiscard]] std::size_t LiteralsBefore(std::size_t index) const;
+
+  void AddRow(TokenType type, std::uint32_t offset, std::uint32_t length, std::uint32_t aux)
+  {
+    types_.push_back(type);
+    offsets_.push_back(offset);
+    lengths_.push_back(length);
+    aux_.push_back(aux);
+  }
+};
+
+#endif// LOX_TOKEN_STREAM_H
@@ -0,0 +1,54 @@
+#ifndef LOX_UNICODE_H
+#define LOX_UNICODE_H
+
+#include "UnicodeTables.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+// Decoding and identifier classes for non-ASCII text. Decoding trusts the text to be well-formed UTF-8; the Scanner
+// checks that with scan::ValidateUtf8 and throws away whatever it scanned if it is not.
+namespace unicode {
+
+struct Decoded
+{
+  char32_t code_point;
+  std::size_t length;
+};
+
+// The character whose first byte is at `pos`. Bytes past the end of `text` read as zero, so a truncated sequence in
+// text that has not been validated yet decodes to some character instead of reading out of bounds.
+[[nodiscard]] inline Decoded Decode(std::string_view text, std::size_t pos)
+{
+  auto byte = [&](std::size_t i) {
+    return pos + i < text.size() ? static_cast<char32_t>(static_cast<unsigned char>(text[pos + i])) : char32_t{ 0 };
+  };
+  auto lead = byte(0);
+  if (lead < 0x80) { return { lead, 1 }; }
+  if (lead < 0xE0) { return { ((lead & 0x1F) << 6) | (byte(1) & 0x3F), 2 }; }
+  if (lead < 0xF0) { return { ((lead & 0x0F) << 12) | ((byte(1) & 0x3F) << 6) | (byte(2) & 0x3F), 3 }; }
+  return { ((lead & 0x07) << 18) | ((byte(1) & 0x3F) << 12) | ((byte(2) & 0x3F) << 6) | (byte(3) & 0x3F), 4 };
+}
+
+template<std::size_t N> [[nodiscard]] bool InRanges(const std::array<CodePointRange, N> &ranges, char32_t code_point)
+{
+  auto after = std::upper_bound(ranges.begin(), ranges.end(), code_point, [](char32_t c, const CodePointRange &range) {
+    return c < range.first;
+  });
+  return after != ranges.begin() && code_point <= std::prev(after)->last;
+}
+
+// Whether a non-ASCII character may begin, or continue, an identifier. These are the XID classes Unicode recommends
+// for identifiers, so letters of any script qualify and punctuation, symbols and spaces do not.
+[[nodiscard]] inline bool IsIdentifierStart(char32_t code_point) { return InRanges(kIdentifierStart, code_point); }
+[[nodiscard]] inline bool IsIdentifierContinue(char32_t code_point)
+{
+  return InRanges(kIdentifierContinue, code_point);
+}
+
+}// namespace unicode
+
+#endif// LOX_UNICODE_H
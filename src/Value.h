@@ -0,0 +1,217 @@
+#ifndef LOX_VALUE_H
+#define LOX_VALUE_H
+
+#include "Common.h"
+#include "Object.h"
+
+#include <bit>
+#include <cstdint>
+#include <fmt/format.h>
+#include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+class LoxCallable;
+
+// A Lox value in eight bytes. Doubles are stored as themselves; every other value is encoded in the payload of a
+// quiet NaN that arithmetic never produces:
+//
+//   nil, false, true   kQuietNan | kImmediateTag | 1..3
+//   int                kQuietNan | kIntTag | 32 bit payload
+//   Obj *              kSignBit | kQuietNan | 48 bit pointer
+class Value
+{
+public:
+  Value() = default;
+  Value([[maybe_unused]] Nil nil) {}
+  Value(bool boolean) : bits_{ boolean ? kTrue : kFalse } {}
+  Value(int integer) : bits_{ kQuietNan | kIntTag | static_cast<std::uint32_t>(integer) } {}
+  Value(double number) : bits_{ std::bit_cast<std::uint64_t>(number) }
+  {
+    if (number != number) { bits_ = (bits_ & kSignBit) | kCanonicalNan; }
+  }
+  template<typename T> Value(T *) = delete;
+
+  Value(const Value &other) : bits_{ other.bits_ } { Retain(); }
+  Value(Value &&other) noexcept : bits_{ std::exchange(other.bits_, kNil) } {}
+  Value &operator=(const Value &other)
+  {
+    other.Retain();
+    Release();
+    bits_ = other.bits_;
+    return *this;
+  }
+  Value &operator=(Value &&other) noexcept
+  {
+    if (this != &other) {
+      Release();
+      bits_ = std::exchange(other.bits_, kNil);
+    }
+    return *this;
+  }
+  ~Value() { Release(); }
+
+  // Takes a reference to `object`, which must have been freshly allocated with new.
+  [[nodiscard]] static Value Object(Obj *object)
+  {
+    Value value{};
+    value.bits_ = kSignBit | kQuietNan | reinterpret_cast<std::uintptr_t>(object);
+    value.Retain();
+    return value;
+  }
+  [[nodiscard]] static Value String(std::string string) { return Object(new ObjString{ std::move(string) }); }
+  [[nodiscard]] static Value FromLiteral(const LiteralT &literal)
+  {
+    return std::visit(
+      [](auto &&arg) -> Value {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (std::is_same_v<T, std::string_view>) {
+          return String(std::string{ arg });
+        } else {
+          return arg;
+        }
+      },
+      literal);
+  }
+
+  [[nodiscard]] bool IsNil() const { return bits_ == kNil; }
+  [[nodiscard]] bool IsBool() const { return (bits_ | 1) == kTrue; }
+  [[nodiscard]] bool IsDouble() const { return (bits_ & kQuietNan) != kQuietNan; }
+  [[nodiscard]] bool IsInt() const { return (bits_ & (kSignBit | kQuietNan | kTagMask)) == (kQuietNan | kIntTag); }
+  // Evaluated without short-circuiting: ints would otherwise pay for a second, mispredicted branch.
+  [[nodiscard]] bool IsNumber() const { return IsDouble() | IsInt(); }
+  [[nodiscard]] bool IsObj() const { return (bits_ & (kSignBit | kQuietNan)) == (kSignBit | kQuietNan); }
+  [[nodiscard]] bool IsString() const { return IsObj() && AsObj()->Type() == ObjType::STRING; }
+  [[nodiscard]] bool IsCallable() const { return IsObj() && AsObj()->Type() != ObjType::STRING; }
+
+  [[nodiscard]] bool AsBool() const { return bits_ == kTrue; }
+  [[nodiscard]] double AsDouble() const { return std::bit_cast<double>(bits_); }
+  [[nodiscard]] int AsInt() const { return static_cast<int>(static_cast<std::uint32_t>(bits_)); }
+  [[nodiscard]] double AsNumber() const { return IsInt() ? AsInt() : AsDouble(); }
+  [[nodiscard]] Obj *AsObj() const { return reinterpret_cast<Obj *>(bits_ & kPointerMask); }
+  [[nodiscard]] const std::string &AsString() const { return static_cast<ObjString *>(AsObj())->Get(); }
+  // Defined in LoxCallable.h, where the class is complete.
+  [[nodiscard]] LoxCallable *AsCallable() const;
+
+private:
+  static constexpr std::uint64_t kSignBit = 0x8000'0000'0000'0000;
+  static constexpr std::uint64_t kQuietNan = 0x7ffc'0000'0000'0000;
+  static constexpr std::uint64_t kTagMask = 0x0003'0000'0000'0000;
+  static constexpr std::uint64_t kIntTag = 0x0001'0000'0000'0000;
+  static constexpr std::uint64_t kImmediateTag = 0x0002'0000'0000'0000;
+  static constexpr std::uint64_t kPointerMask = 0x0000'ffff'ffff'ffff;
+  static constexpr std::uint64_t kNil = kQuietNan | kImmediateTag | 1;
+  static constexpr std::uint64_t kFalse = kQuietNan | kImmediateTag | 2;
+  static constexpr std::uint64_t kTrue = kQuietNan | kImmediateTag | 3;
+  // NaNs produced at runtime keep their sign but are folded onto a payload that cannot collide with the tags above.
+  static constexpr std::uint64_t kCanonicalNan = 0x7ff8'0000'0000'0000;
+
+  std::uint64_t bits_{ kNil };
+
+  void Retain() const
+  {
+    if (IsObj()) { AsObj()->Retain(); }
+  }
+  void Release() const
+  {
+    if (IsObj()) { AsObj()->Release(); }
+  }
+
+  friend bool IsIdentical(const Value &left, const Value &right) { return left.bits_ == right.bits_; }
+  // IsInt() of both, tested with one branch for the arithmetic fast paths.
+  friend bool AreInts(const Value &left, const Value &right)
+  {
+    constexpr auto mask = kSignBit | kQuietNan | kTagMask;
+    return (((left.bits_ & mask) ^ (kQuietNan | kIntTag)) | ((right.bits_ & mask) ^ (kQuietNan | kIntTag))) == 0;
+  }
+};
+
+static_assert(sizeof(Value) == sizeof(std::uint64_t));
+
+// Truthiness and equality rules shared by every execution engine.
+[[nodiscard]] inline bool IsTruthy(const Value &value)
+{
+  if (value.IsNil()) { return false; }
+  if (value.IsBool()) { return value.AsBool(); }
+  return true;
+}
+
+[[nodiscard]] inline bool IsEqual(const Value &left, const Value &right)
+{
+  if (left.IsNumber() && right.IsNumber()) { return left.AsNumber() == right.AsNumber(); }
+  if (left.IsString() && right.IsString()) { return left.AsString() == right.AsString(); }
+  return IsIdentical(left, right);
+}
+
+// Arithmetic shared by every execution engine, for operands already checked to be numbers. Two ints give an int as
+// long as the exact result fits and cannot be negative zero; anything else is computed in doubles, so results print
+// the same as with doubles throughout. `int_op` returns false when it cannot produce the int result.
+template<typename IntOp, typename DoubleOp>
+[[nodiscard]] Value Arithmetic(const Value &left, const Value &right, IntOp int_op, DoubleOp double_op)
+{
+  if (AreInts(left, right)) {
+    if (int result{}; int_op(left.AsInt(), right.AsInt(), result)) { return result; }
+  } else if (left.IsDouble() & right.IsDouble()) {
+    return double_op(left.AsDouble(), right.AsDouble());
+  }
+  return double_op(left.AsNumber(), right.AsNumber());
+}
+
+[[nodiscard]] inline Value Add(const Value &left, const Value &right)
+{
+  return Arithmetic(
+    left, right, [](int a, int b, int &sum) { return !__builtin_add_overflow(a, b, &sum); }, std::plus{});
+}
+
+[[nodiscard]] inline Value Subtract(const Value &left, const Value &right)
+{
+  return Arithmetic(
+    left, right, [](int a, int b, int &difference) { return !__builtin_sub_overflow(a, b, &difference); }, std::minus{});
+}
+
+[[nodiscard]] inline Value Multiply(const Value &left, const Value &right)
+{
+  // A zero product may be -0, which only a double can hold.
+  return Arithmetic(
+    left,
+    right,
+    [](int a, int b, int &product) { return !__builtin_mul_overflow(a, b, &product) && product != 0; },
+    std::multiplies{});
+}
+
+[[nodiscard]] inline Value Divide(const Value &left, const Value &right) { return left.AsNumber() / right.AsNumber(); }
+
+[[nodiscard]] inline Value Negate(const Value &operand)
+{
+  if (operand.IsInt() && operand.AsInt() != 0 && operand.AsInt() != std::numeric_limits<int>::min()) {
+    return -operand.AsInt();
+  }
+  return -operand.AsNumber();
+}
+
+// Orders two numbers with `compare`, without converting when both are ints.
+template<typename Compare> [[nodiscard]] bool CompareNumbers(const Value &left, const Value &right, Compare compare)
+{
+  if (AreInts(left, right)) { return compare(left.AsInt(), right.AsInt()); }
+  return compare(left.AsNumber(), right.AsNumber());
+}
+
+template<> struct fmt::formatter<Value>
+{
+  template<typename ParseContext> constexpr auto parse(ParseContext &ctx) { return ctx.begin(); }
+
+  template<typename FormatContext> auto format(const Value &value, FormatContext &ctx)
+  {
+    if (value.IsNil()) { return fmt::format_to(ctx.out(), "nil"); }
+    if (value.IsBool()) { return fmt::format_to(ctx.out(), "{}", value.AsBool()); }
+    if (value.IsInt()) { return fmt::format_to(ctx.out(), "{}", value.AsInt()); }
+    if (value.IsDouble()) { return fmt::format_to(ctx.out(), "{}", value.AsDouble()); }
+    if (value.IsString()) { return fmt::format_to(ctx.out(), "{}", value.AsString()); }
+    return fmt::format_to(ctx.out(), "<Callable>");
+  }
+};
+
+#endif// LOX_VALUE_H
@@ -0,0 +1,338 @@
+#include "Vm.h"
+#include "Chunk.h"
+#include "Object.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include "VmObjects.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+Vm::Vm(ErrorReporterPtr error_reporter) : error_reporter_{ std::move(error_reporter) }, stack_(kStackInitial)
+{
+  ResetStack();
+  globals_.InsertOrAssign(SymbolTable::Global().Intern("clock"), Value::Object(new ClockCallable{}));
+}
+
+void Vm::Interpret(const std::shared_ptr<VmFunction> &script)
+{
+  auto *closure = new VmClosure{ script };
+  Push(Value::Object(closure));
+  Call(closure, 0);
+
+  try {
+    Run();
+  } catch (const Error &error) {
+    const auto &frame = frames_.back();
+    const auto &chunk = frame.closure->Function().chunk;
+    // The instruction pointer has already moved past the opcode that failed.
+    auto offset = static_cast<std::size_t>(frame.ip - chunk.Code().data()) - 1;
+    error_reporter_->ReportRuntime(chunk.PosAt(offset), error.what());
+    ResetStack();
+  }
+}
+
+void Vm::ResetStack()
+{
+  while (stack_top_ != nullptr && stack_top_ != stack_.data()) { Pop(); }
+  stack_top_ = stack_.data();
+  frames_.clear();
+  open_upvalues_ = nullptr;
+}
+
+void Vm::CheckNumberOperand()
+{
+  if (Peek(0).IsNumber()) { return; }
+  throw Error{ "Operand must be a number: -" };
+}
+
+void Vm::CheckNumberOperands()
+{
+  if (Peek(1).IsNumber() & Peek(0).IsNumber()) { return; }
+  throw Error{ fmt::format("Operands must be numbers: {} {}", Peek(1), Peek(0)) };
+}
+
+void Vm::CallValue(const Value &callee, int argument_count)
+{
+  if (!callee.IsCallable()) { throw Error{ "Can only call functions and classes." }; }
+
+  auto *callable = callee.AsCallable();
+  if (argument_count != callable->Arity()) {
+    throw Error{ fmt::format("Expected {} arguments but got {}.", callable->Arity(), argument_count) };
+  }
+
+  if (callable->Type() == ObjType::VM_CLOSURE) {
+    Call(static_cast<VmClosure *>(callable), argument_count);
+    return;
+  }
+
+  // Native function: hand it the arguments and replace callee and arguments with the result.
+  std::vector<Value> arguments(stack_top_ - argument_count, stack_top_);
+  auto result = callable->Call(nullptr, arguments);
+  for (int i = 0; i <= argument_count; ++i) { Pop(); }
+  Push(std::move(result));
+}
+
+void Vm::Call(VmClosure *closure, int argument_count)
+{
+  if (frames_.size() == kFramesMax) { throw Error{ "Stack overflow." }; }
+
+  // The callee and its arguments are already on the stack; make room for the rest of its frame up front so the
+  // unchecked Push in Run never writes past the end.
+  auto base = static_cast<std::size_t>(stack_top_ - stack_.data()) - static_cast<std::size_t>(argument_count) - 1;
+  auto needed = base + static_cast<std::size_t>(closure->Function().max_stack);
+  if (needed > stack_.size()) { GrowStack(needed); }
+
+  const auto &code = closure->Function().chunk.Code();
+  frames_.push_back({ closure, code.data(), stack_.data() + base });
+}
+
+void Vm::GrowStack(std::size_t needed)
+{
+  if (needed > kStackMax) { throw Error{ "Stack overflow." }; }
+
+  std::vector<Value> grown(std::min(std::max(needed, stack_.size() * 2), kStackMax));
+  auto *old_base = stack_.data();
+  std::move(old_base, stack_top_, grown.data());
+
+  // Frames and open upvalues point into the old buffer.
+  auto rebase = [&](Value *slot) { return grown.data() + (slot - old_base); };
+  for (auto &frame : frames_) { frame.slots = rebase(frame.slots); }
+  for (auto *upvalue = open_upvalues_.get(); upvalue != nullptr; upvalue = upvalue->next.get()) {
+    upvalue->location = rebase(upvalue->location);
+  }
+  stack_top_ = rebase(stack_top_);
+  stack_ = std::move(grown);
+}
+
+std::shared_ptr<Upvalue> Vm::CaptureUpvalue(Value *local)
+{
+  std::shared_ptr<Upvalue> previous{ nullptr };
+  auto upvalue = open_upvalues_;
+  while (upvalue != nullptr && upvalue->location > local) {
+    previous = upvalue;
+    upvalue = upvalue->next;
+  }
+
+  if (upvalue != nullptr && upvalue->location == local) { return upvalue; }
+
+  auto created = std::make_shared<Upvalue>(local);
+  created->next = upvalue;
+  if (previous == nullptr) {
+    open_upvalues_ = created;
+  } else {
+    previous->next = created;
+  }
+  return created;
+}
+
+void Vm::CloseUpvalues(const Value *last)
+{
+  while (open_upvalues_ != nullptr && open_upvalues_->location >= last) {
+    auto &upvalue = *open_upvalues_;
+    upvalue.closed = *upvalue.location;
+    upvalue.location = &upvalue.closed;
+    open_upvalues_ = std::move(upvalue.next);
+  }
+}
+
+void Vm::Run()
+{
+  auto *frame = &frames_.back();
+
+  auto read_byte = [&frame]() { return *frame->ip++; };
+  auto read_short = [&frame]() {
+    frame->ip += 2;
+    return static_cast<std::uint16_t>((frame->ip[-2] << 8) | frame->ip[-1]);
+  };
+  auto read_constant = [&frame, &read_short]() -> const Value & {
+    return frame->closure->Function().chunk.Constants()[read_short()];
+  };
+  auto read_name = [&read_constant]() { return static_cast<SymbolId>(read_constant().AsInt()); };
+
+  while (true) {
+    switch (static_cast<OpCode>(read_byte())) {
+    case OpCode::CONSTANT:
+      Push(read_constant());
+      break;
+    case OpCode::NIL:
+      Push(Nil{});
+      break;
+    case OpCode::TRUE:
+      Push(true);
+      break;
+    case OpCode::FALSE:
+      Push(false);
+      break;
+    case OpCode::POP:
+      Pop();
+      break;
+    case OpCode::GET_LOCAL:
+      Push(frame->slots[read_byte()]);
+      break;
+    case OpCode::SET_LOCAL:
+      frame->slots[read_byte()] = Peek(0);
+      break;
+    case OpCode::GET_GLOBAL: {
+      auto name = read_name();
+      const auto *global = globals_.Find(name);
+      if (global == nullptr) { throw Error{ fmt::format("Undefined variable '{}'.", SymbolTable::Global().Name(name)) }; }
+      Push(*global);
+      break;
+    }
+    case OpCode::DEFINE_GLOBAL:
+      globals_.InsertOrAssign(read_name(), Pop());
+      break;
+    case OpCode::SET_GLOBAL: {
+      auto name = read_name();
+      auto *global = globals_.Find(name);
+      if (global == nullptr) { throw Error{ fmt::format("Undefined variable '{}'.", SymbolTable::Global().Name(name)) }; }
+      *global = Peek(0);
+      break;
+    }
+    case OpCode::GET_UPVALUE:
+      Push(*frame->closure->Upvalues()[read_byte()]->location);
+      break;
+    case OpCode::SET_UPVALUE:
+      *frame->closure->Upvalues()[read_byte()]->location = Peek(0);
+      break;
+    case OpCode::EQUAL: {
+      auto right = Pop();
+      auto left = Pop();
+      Push(IsEqual(left, right));
+      break;
+    }
+    case OpCode::NOT_EQUAL: {
+      auto right = Pop();
+      auto left = Pop();
+      Push(!IsEqual(left, right));
+      break;
+    }
+    case OpCode::GREATER: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = CompareNumbers(left, Peek(0), std::greater{});
+      Pop();
+      break;
+    }
+    case OpCode::GREATER_EQUAL: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = CompareNumbers(left, Peek(0), std::greater_equal{});
+      Pop();
+      break;
+    }
+    case OpCode::LESS: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = CompareNumbers(left, Peek(0), std::less{});
+      Pop();
+      break;
+    }
+    case OpCode::LESS_EQUAL: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = CompareNumbers(left, Peek(0), std::less_equal{});
+      Pop();
+      break;
+    }
+    case OpCode::ADD: {
+      auto &left = Peek(1);
+      const auto &right = Peek(0);
+      if (left.IsNumber() && right.IsNumber()) {
+        left = Add(left, right);
+      } else if (left.IsString() && right.IsString()) {
+        left = Value::String(left.AsString() + right.AsString());
+      } else {
+        throw Error{ fmt::format("Operands must be two numbers or two strings: {} {}", left, right) };
+      }
+      Pop();
+      break;
+    }
+    case OpCode::SUBTRACT: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = Subtract(left, Peek(0));
+      Pop();
+      break;
+    }
+    case OpCode::MULTIPLY: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = Multiply(left, Peek(0));
+      Pop();
+      break;
+    }
+    case OpCode::DIVIDE: {
+      CheckNumberOperands();
+      auto &left = Peek(1);
+      left = Divide(left, Peek(0));
+      Pop();
+      break;
+    }
+    case OpCode::NOT:
+      Push(!IsTruthy(Pop()));
+      break;
+    case OpCode::NEGATE:
+      CheckNumberOperand();
+      Peek(0) = Negate(Peek(0));
+      break;
+    case OpCode::PRINT:
+      fmt::print("{}\n", Pop());
+      break;
+    case OpCode::JUMP:
+      frame->ip += read_short();
+      break;
+    case OpCode::JUMP_IF_FALSE: {
+      auto offset = read_short();
+      if (!IsTruthy(Peek(0))) { frame->ip += offset; }
+      break;
+    }
+    case OpCode::LOOP: {
+      auto offset = read_short();
+      frame->ip -= offset;
+      break;
+    }
+    case OpCode::CALL: {
+      auto argument_count = read_byte();
+      CallValue(Peek(argument_count), argument_count);
+      frame = &frames_.back();
+      break;
+    }
+    case OpCode::CLOSURE: {
+      const auto &function = frame->closure->Function().chunk.Functions()[read_short()];
+      auto *closure = new VmClosure{ function };
+      Push(Value::Object(closure));
+      for (auto &upvalue : closure->Upvalues()) {
+        auto is_local = read_byte() == 1;
+        auto index = read_byte();
+        upvalue = is_local ? CaptureUpvalue(frame->slots + index) : frame->closure->Upvalues()[index];
+      }
+      break;
+    }
+    case OpCode::CLOSE_UPVALUE:
+      CloseUpvalues(stack_top_ - 1);
+      Pop();
+      break;
+    case OpCode::RETURN: {
+      auto result = Pop();
+      CloseUpvalues(frame->slots);
+      auto *slots = frame->slots;
+      frames_.pop_back();
+      while (stack_top_ != slots) { Pop(); }
+      if (frames_.empty()) { return; }
+
+      Push(std::move(result));
+      frame = &frames_.back();
+      break;
+    }
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef LOX_VM_H
+#define LOX_VM_H
+
+#include "ClockCallable.h"
+#include "ErrorReporter.h"
+#include "SymbolTable.h"
+#include "Value.h"
+#include "VmObjects.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Stack-based virtual machine executing the bytecode produced by the Compiler.
+class Vm
+{
+public:
+  explicit Vm(ErrorReporterPtr error_reporter);
+
+  void Interpret(const std::shared_ptr<VmFunction> &script);
+
+private:
+  // Deep enough for ordinary recursion; the value stack starts small and grows on demand up to its own cap.
+  static constexpr std::size_t kFramesMax = 1 << 16;
+  static constexpr std::size_t kStackInitial = 1 << 14;
+  static constexpr std::size_t kStackMax = 1 << 24;
+
+  struct CallFrame
+  {
+    VmClosure *closure;
+    const std::uint8_t *ip;
+    Value *slots;
+  };
+
+  class Error : public std::runtime_error
+  {
+  public:
+    explicit Error(const std::string &message) : std::runtime_error{ message } {}
+  };
+
+  ErrorReporterPtr error_reporter_;
+  std::vector<Value> stack_;
+  Value *stack_top_{ nullptr };
+  std::vector<CallFrame> frames_;
+  SymbolMap<Value> globals_;
+  std::shared_ptr<Upvalue> open_upvalues_{ nullptr };
+
+  void Run();
+  void ResetStack();
+
+  void Push(Value value) { *stack_top_++ = std::move(value); }
+  Value Pop() { return std::move(*--stack_top_); }
+  [[nodiscard]] Value &Peek(std::size_t distance) { return stack_top_[-1 - static_cast<std::ptrdiff_t>(distance)]; }
+
+  void CallValue(const Value &callee, int argument_count);
+  void Call(VmClosure *closure, int argument_count);
+  void GrowStack(std::size_t needed);
+  [[nodiscard]] std::shared_ptr<Upvalue> CaptureUpvalue(Value *local);
+  void CloseUpvalues(const Value *last);
+
+  void CheckNumberOperand();
+  void CheckNumberOperands();
+};
+
+
+#endif// LOX_VM_H
@@ -0,0 +1,63 @@
+#ifndef LOX_VMOBJECTS_H
+#define LOX_VMOBJECTS_H
+
+#include "Chunk.h"
+#include "LoxCallable.h"
+#include "Value.h"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+class AstInterpreter;
+
+// A compiled function body. Immutable once the Compiler is done with it.
+struct VmFunction
+{
+  std::string name;
+  int arity{ 0 };
+  int upvalue_count{ 0 };
+  // Stack slots a call needs, from the callee slot up to the deepest point of the body.
+  int max_stack{ 0 };
+  Chunk chunk;
+};
+
+// A captured variable. While open it points at a live stack slot; once the slot goes out of scope the value is
+// moved into `closed` and `location` is redirected to it.
+struct Upvalue
+{
+  explicit Upvalue(Value *slot) : location{ slot } {}
+
+  Value *location;
+  Value closed{};
+  std::shared_ptr<Upvalue> next{ nullptr };
+};
+
+// Runtime function value of the VM: a VmFunction plus the variables it captured.
+class VmClosure final : public LoxCallable
+{
+public:
+  explicit VmClosure(std::shared_ptr<const VmFunction> function)
+    : LoxCallable{ ObjType::VM_CLOSURE }, function_{ std::move(function) }, upvalues_(function_->upvalue_count)
+  {}
+
+  // Closures are invoked by the VM itself through call frames, never by the tree-walking interpreter.
+  Value Call([[maybe_unused]] AstInterpreter *interpreter,
+    [[maybe_unused]] const std::vector<Value> &arguments) override
+  {
+    throw std::logic_error("VM closures can only be called from the VM.");
+  }
+
+  [[nodiscard]] int Arity() const override { return function_->arity; }
+
+  [[nodiscard]] const VmFunction &Function() const { return *function_; }
+  [[nodiscard]] std::vector<std::shared_ptr<Upvalue>> &Upvalues() { return upvalues_; }
+
+private:
+  std::shared_ptr<const VmFunction> function_;
+  std::vector<std::shared_ptr<Upvalue>> upvalues_;
+};
+
+#endif// LOX_VMOBJECTS_H
@@ -1,9 +1,13 @@
+#include "AstCache.h"
 #include "Lox.h"
+#include "Optimizer.h"
 #include "fmt/core.h"
+#include <cstddef>
 #include <cstdlib>
 #include <exception>
 #include <iostream>
 #include <lyra/lyra.hpp>
+#include <memory>
 #include <string>
 
 
@@ -11,12 +15,29 @@ int main(int argc, char **argv)
 {
   try {
     std::string script{};
+    std::string engine{ "ast" };
+    std::string cache{};
+    std::size_t inline_budget{ Optimizer::kDefaultInlineBudget };
+    bool lazy_functions{ false };
 
     // clang-format off
     auto cli
       = lyra::cli()
+      | lyra::opt( engine, "ast|vm" )
+          ["--engine"]
+          ("Execution engine: the tree-walking interpreter or the bytecode VM.")
+          .choices("ast", "vm")
+      | lyra::opt( cache, "directory" )
+          ["--ast-cache"]
+          ("Keep parsed scripts in this directory, and run them from there when they have not changed.")
+      | lyra::opt( inline_budget, "nodes" )
+          ["--inline-budget"]
+          ("Inline calls to functions returning an expression of at most this many nodes; 0 turns inlining off.")
+      | lyra::opt( lazy_functions )
+          ["--lazy-functions"]
+          ("Parse top-level function bodies on their first call. Errors in a body are only reported then.")
       | lyra::arg( script, "script" )
-          ("Script to run.");
+          ("Script to run, or - to read it from standard input.");
     // clang-format on
 
     auto result = cli.parse({ argc, argv });
@@ -26,7 +47,9 @@ int main(int argc, char **argv)
       return EXIT_FAILURE;
     }
 
-    Lox lox{};
+    Lox lox{ engine == "vm" ? Engine::VM : Engine::AST, cache.empty() ? nullptr : std::make_unique<AstCache>(cache) };
+    lox.InlineFunctionsUpTo(inline_budget);
+    lox.ParseFunctionsLazily(lazy_functions);
     if (script.empty()) {
       // REPL
       lox.RunPrompt();
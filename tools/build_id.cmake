@@ -0,0 +1,12 @@
+# Writes OUTPUT, defining LOX_BUILD_ID as a hash of the sources in SOURCE_DIR. The file is only rewritten when the hash
+# changes, so a build that leaves the sources alone does not recompile what includes it.
+file(GLOB sources ${SOURCE_DIR}/*.cpp ${SOURCE_DIR}/*.h)
+list(SORT sources)
+set(digest "")
+foreach(source IN LISTS sources)
+    file(SHA256 ${source} hash)
+    string(APPEND digest ${hash})
+endforeach()
+string(SHA256 id "${digest}")
+string(SUBSTRING ${id} 0 16 id)
+file(CONFIGURE OUTPUT ${OUTPUT} CONTENT "#define LOX_BUILD_ID \"${id}\"\n")
@@ -2,7 +2,7 @@ import argparse
 import sys
 from enum import Enum
 from io import StringIO
-from typing import Union
+from typing import Optional, Union
 
 
 class ExpressionType(Enum):
@@ -34,8 +34,10 @@ class FieldType(Enum):
     STATEMENT_PTR = "StmtPtr"
     STATEMENT = "Stmt"
     TOKEN = "Token"
-    LITERAL = "LiteralT"
-    VECTOR = "std::vector"
+    VALUE = "Value"
+    SLOT = "Slot"
+    LAZY_BODY = "const LazyBody *"
+    SPAN = "std::span"
 
 
 class SimpleField:
@@ -44,7 +46,8 @@ class SimpleField:
         self.name = name
 
     def __str__(self):
-        return f"{self.field_type.value} {self.name}"
+        separator = "" if self.field_type.value.endswith("*") else " "
+        return f"{self.field_type.value}{separator}{self.name}"
 
 
 class NestedField:
@@ -62,7 +65,8 @@ Ast = dict[Union[ExpressionType, StatementType], list[Union[SimpleField, NestedF
 EXPR_AST: Ast = {
     ExpressionType.ASSIGN: [
         SimpleField(FieldType.TOKEN, "name"),
-        SimpleField(FieldType.EXPRESSION_PTR, "value")
+        SimpleField(FieldType.EXPRESSION_PTR, "value"),
+        SimpleField(FieldType.SLOT, "slot"),
     ],
     ExpressionType.BINARY: [
         SimpleField(FieldType.EXPRESSION_PTR, "left"),
@@ -72,13 +76,13 @@ EXPR_AST: Ast = {
     ExpressionType.CALL: [
         SimpleField(FieldType.EXPRESSION_PTR, "callee"),
         SimpleField(FieldType.TOKEN, "paren"),
-        NestedField(FieldType.VECTOR, FieldType.EXPRESSION, "arguments")
+        NestedField(FieldType.SPAN, FieldType.EXPRESSION, "arguments")
     ],
     ExpressionType.GROUPING: [
         SimpleField(FieldType.EXPRESSION_PTR, "expression"),
     ],
     ExpressionType.LITERAL: [
-        SimpleField(FieldType.LITERAL, "value"),
+        SimpleField(FieldType.VALUE, "value"),
     ],
     ExpressionType.LOGICAL: [
         SimpleField(FieldType.EXPRESSION_PTR, "left"), SimpleField(FieldType.TOKEN, "op"),
@@ -86,24 +90,25 @@ EXPR_AST: Ast = {
     ],
     ExpressionType.UNARY: [SimpleField(FieldType.TOKEN, "op"), SimpleField(FieldType.EXPRESSION_PTR, "right"),
                            ],
-    ExpressionType.VARIABLE: [SimpleField(FieldType.TOKEN, "name")],
+    ExpressionType.VARIABLE: [SimpleField(FieldType.TOKEN, "name"), SimpleField(FieldType.SLOT, "slot")],
 }
 STMT_AST: Ast = {
     StatementType.EXPRESSION: [SimpleField(FieldType.EXPRESSION_PTR, "expression")],
     StatementType.FUNCTION: [SimpleField(FieldType.TOKEN, "name"),
-                             NestedField(FieldType.VECTOR, FieldType.TOKEN, "params"),
-                             NestedField(FieldType.VECTOR, FieldType.STATEMENT, "body")],
+                             NestedField(FieldType.SPAN, FieldType.TOKEN, "params"),
+                             NestedField(FieldType.SPAN, FieldType.STATEMENT, "body"),
+                             SimpleField(FieldType.LAZY_BODY, "lazy")],
     StatementType.IF: [SimpleField(FieldType.EXPRESSION_PTR, "condition"),
                        SimpleField(FieldType.STATEMENT_PTR, "then_branch"),
                        SimpleField(FieldType.STATEMENT_PTR, "else_branch")],
-    StatementType.PRINT: [SimpleField(FieldType.EXPRESSION_PTR, "expression")],
+    StatementType.PRINT: [SimpleField(FieldType.TOKEN, "keyword"), SimpleField(FieldType.EXPRESSION_PTR, "expression")],
     StatementType.RETURN: [SimpleField(FieldType.TOKEN, "keyword"),
                            SimpleField(FieldType.EXPRESSION_PTR, "value")],
     StatementType.VAR: [SimpleField(FieldType.TOKEN, "name"), SimpleField(FieldType.EXPRESSION_PTR, "initializer")],
     StatementType.WHILE: [SimpleField(FieldType.EXPRESSION_PTR, "condition"),
                           SimpleField(FieldType.STATEMENT_PTR, "body")],
     StatementType.EMPTY: [],
-    StatementType.BLOCK: [NestedField(FieldType.VECTOR, FieldType.STATEMENT, "statements")],
+    StatementType.BLOCK: [NestedField(FieldType.SPAN, FieldType.STATEMENT, "statements")],
 }
 
 
@@ -129,11 +134,14 @@ def generate_header() -> str:
 
 def generate_includes() -> str:
     includes = StringIO()
-    includes.write("#include <memory>\n")
+    includes.write("#include <span>\n")
+    includes.write("#include <type_traits>\n")
+    includes.write("#include <utility>\n")
     includes.write("#include <variant>\n")
-    includes.write("#include <vector>\n")
+    includes.write("#include \"AstArena.h\"\n")
     includes.write("#include \"Common.h\"\n")
     includes.write("#include \"Token.h\"\n")
+    includes.write("#include \"Value.h\"\n")
     includes.write("\n")
     return includes.getvalue()
 
@@ -155,7 +163,7 @@ def generate_types(ast: Ast, name: str) -> str:
     expr_types = StringIO()
     names = ', '.join([f"{name.lower()}::{str(key.value)}" for key in ast.keys()])
     expr_types.write(f"using {name} = std::variant<{names}>;\n")
-    expr_types.write(f"using {name}Ptr = std::shared_ptr<{name}>;\n")
+    expr_types.write(f"using {name}Ptr = {name} *;\n")
     expr_types.write("\n")
     return expr_types.getvalue()
 
@@ -166,19 +174,46 @@ def generate_structs(ast: Ast, name: str) -> str:
     for key, fields in ast.items():
         structs.write(f"struct {key.value} {{\n")
         for field in fields:
-            structs.write(f"    {generate_type(field)};\n")
+            # A node made before resolving leaves the slot out, which makes it a global until the Resolver says otherwise.
+            initializer = "{}" if isinstance(field, SimpleField) and field.field_type == FieldType.SLOT else ""
+            structs.write(f"    {generate_type(field)}{initializer};\n")
         structs.write("};\n")
         structs.write("\n")
     structs.write(f"}} // namespace {name.lower()}\n")
     return structs.getvalue()
 
 
+def owns_objects(fields: list[Field]) -> list[str]:
+    return [field.name for field in fields if isinstance(field, SimpleField) and field.field_type == FieldType.VALUE]
+
+
+def generate_ownership(ast: Ast, name: str) -> str:
+    ownership = StringIO()
+    ownership.write(f"namespace {name.lower()} {{\n")
+    ownership.write("// Whether a node holds a reference to an object outside the arena, which has to be released with it. "
+                    "Every other\n")
+    ownership.write("// node is trivially destructible and is never destroyed.\n")
+    ownership.write("constexpr bool OwnsObjects(const auto &) { return false; }\n")
+    for key, fields in ast.items():
+        values = owns_objects(fields)
+        if values:
+            checks = " || ".join(f"node.{value}.IsObj()" for value in values)
+            ownership.write(f"inline bool OwnsObjects(const {key.value} &node) {{ return {checks}; }}\n")
+        else:
+            ownership.write(f"static_assert(std::is_trivially_destructible_v<{key.value}>);\n")
+    ownership.write(f"}} // namespace {name.lower()}\n")
+    ownership.write("\n")
+    return ownership.getvalue()
+
+
 def generate_helpers(name: str) -> str:
     helpers = StringIO()
     helpers.write(f"template <typename {name}Type, typename... Args>\n")
-    helpers.write(f"auto Make{name}(Args&&... args) -> {name}Ptr\n")
+    helpers.write(f"auto Make{name}(AstArena &arena, Args&&... args) -> {name}Ptr\n")
     helpers.write(f"{{\n")
-    helpers.write(f"    return std::make_shared<{name}>({name}Type{{std::forward<Args>(args)...}});\n")
+    helpers.write(f"    auto *node = arena.New<{name}>({name}Type{{std::forward<Args>(args)...}});\n")
+    helpers.write(f"    if ({name.lower()}::OwnsObjects(std::get<{name}Type>(*node))) {{ arena.DestroyWithArena(node); }}\n")
+    helpers.write(f"    return node;\n")
     helpers.write(f"}}\n")
     helpers.write("\n")
     return helpers.getvalue()
@@ -189,11 +224,396 @@ def generate(ast: Ast, name: str) -> str:
     buffer.write(generate_declarations(ast, name))
     buffer.write(generate_types(ast, name))
     buffer.write(generate_structs(ast, name))
+    buffer.write(generate_ownership(ast, name))
     buffer.write(generate_helpers(name))
     return buffer.getvalue()
 
 
-def main(output: str) -> None:
+FLAT_FIELD_TYPES = {
+    FieldType.EXPRESSION_PTR: "Offset",
+    FieldType.STATEMENT_PTR: "Offset",
+    FieldType.TOKEN: "TokenRef",
+    FieldType.VALUE: "Constant",
+    FieldType.SLOT: "Slot",
+    FieldType.LAZY_BODY: "Lazy",
+}
+
+
+def flat_type(field: Field) -> str:
+    if isinstance(field, NestedField):
+        return "TokenList" if field.subtype == FieldType.TOKEN else "NodeList"
+    return FLAT_FIELD_TYPES[field.field_type]
+
+
+def kind_name(key: Union[ExpressionType, StatementType]) -> str:
+    return key.name
+
+
+def flat_names() -> list[tuple[str, Union[ExpressionType, StatementType]]]:
+    return [("expr", key) for key in EXPR_AST.keys()] + [("stmt", key) for key in STMT_AST.keys()]
+
+
+def generate_flat_header() -> str:
+    header = StringIO()
+    header.write("#ifndef LOX_FLAT_AST_H\n")
+    header.write("#define LOX_FLAT_AST_H\n")
+    header.write("\n")
+    header.write("#include <algorithm>\n")
+    header.write("#include <cstddef>\n")
+    header.write("#include <cstdint>\n")
+    header.write("#include <memory>\n")
+    header.write("#include <new>\n")
+    header.write("#include <span>\n")
+    header.write("#include <stdexcept>\n")
+    header.write("#include <string_view>\n")
+    header.write("#include <type_traits>\n")
+    header.write("#include <variant>\n")
+    header.write("#include <vector>\n")
+    header.write("#include \"Ast.h\"\n")
+    header.write("#include \"Common.h\"\n")
+    header.write("#include \"Source.h\"\n")
+    header.write("#include \"SymbolTable.h\"\n")
+    header.write("#include \"Token.h\"\n")
+    header.write("#include \"Value.h\"\n")
+    header.write("\n")
+    header.write("// The same AST laid out in one buffer: every node is a fixed-size Node, written after all of its children (post-order),\n")
+    header.write("// so the nodes of a function body are one contiguous run ending at the function. Children are found by counting back\n")
+    header.write("// from their parent instead of following a pointer; lists go through a run of Link nodes placed just before it.\n")
+    header.write("namespace flat {\n")
+    header.write("// Distance back from a node to one of its children; 0 means there is none.\n")
+    header.write("using Offset = std::uint32_t;\n")
+    header.write("// Index of a value, see FlatAst::ConstantAt.\n")
+    header.write("using Constant = std::uint32_t;\n")
+    header.write("// A token, kept for error messages and global names (see FlatAst::TokenAt), with the one thing evaluation needs from it\n")
+    header.write("// inline.\n")
+    header.write("struct TokenRef {\n")
+    header.write("    std::uint32_t index;\n")
+    header.write("    TokenType type;\n")
+    header.write("    // What would otherwise be padding, spelled out so that every byte of a node written to disk is determined.\n")
+    header.write("    std::uint8_t reserved[3]{};\n")
+    header.write("};\n")
+    header.write("// `count` tokens kept from index `first` on.\n")
+    header.write("struct TokenList {\n    std::uint32_t first;\n    std::uint32_t count;\n};\n")
+    header.write("// One more than the index of a function body that was skipped, see FlatAst::LazyAt; 0 means it was parsed.\n")
+    header.write("using Lazy = std::uint32_t;\n")
+    header.write("// `count` consecutive Links, the first of them `first` nodes back.\n")
+    header.write("struct NodeList {\n    Offset first;\n    std::uint32_t count;\n};\n")
+    header.write("\n")
+    header.write("inline constexpr std::uint32_t kNoSymbolIndex = ~std::uint32_t{0};\n")
+    header.write("// How a FlatAst keeps a token: where its lexeme is, counted from the start of the program's text, and which of the\n")
+    header.write("// program's symbols it names, if any. Nothing in it depends on where the program was loaded.\n")
+    header.write("struct TokenRecord {\n")
+    header.write("    std::uint32_t offset;\n")
+    header.write("    std::uint32_t length;\n")
+    header.write("    std::uint32_t symbol;\n")
+    header.write("    TokenType type;\n")
+    header.write("    std::uint8_t reserved[3]{};\n")
+    header.write("};\n")
+    header.write("static_assert(std::has_unique_object_representations_v<TokenRecord>);\n")
+    header.write("\n")
+    return header.getvalue()
+
+
+def generate_flat_kinds() -> str:
+    kinds = StringIO()
+    names = ", ".join([kind_name(key) for _, key in flat_names()] + ["LINK"])
+    kinds.write(f"enum class Kind : std::uint8_t {{ {names} }};\n")
+    kinds.write("\n")
+    return kinds.getvalue()
+
+
+def generate_flat_structs(ast: Ast, name: str) -> str:
+    structs = StringIO()
+    structs.write(f"namespace {name} {{\n")
+    for key, fields in ast.items():
+        structs.write(f"struct {key.value} {{\n")
+        for field in fields:
+            structs.write(f"    {flat_type(field)} {field.name};\n")
+        structs.write("};\n")
+        structs.write("\n")
+    structs.write(f"}} // namespace {name}\n")
+    return structs.getvalue()
+
+
+def generate_flat_node() -> str:
+    node = StringIO()
+    node.write("// One item of a NodeList.\n")
+    node.write("struct Link {\n    Offset node;\n};\n")
+    node.write("\n")
+    node.write("template <typename T> inline constexpr Kind kKindOf = Kind::LINK;\n")
+    for namespace, key in flat_names():
+        node.write(f"template <> inline constexpr Kind kKindOf<{namespace}::{key.value}> = Kind::{kind_name(key)};\n")
+    node.write("\n")
+    types = [f"{namespace}::{key.value}" for namespace, key in flat_names()] + ["Link"]
+    sizes = ", ".join(f"sizeof({type_name})" for type_name in types)
+    node.write(f"inline constexpr std::size_t kPayloadSize = std::max({{ {sizes} }});\n")
+    # Unique object representations rule out padding, whose bytes would be indeterminate in a cache file. A node with no
+    # fields copies no bytes at all, leaving the zeroes Node::Of starts from.
+    fieldless = {f"{namespace}::{key.value}" for namespace, key in flat_names()
+                 if not (EXPR_AST if namespace == "expr" else STMT_AST)[key]}
+    for type_name in types:
+        layout = "is_empty_v" if type_name in fieldless else "has_unique_object_representations_v"
+        node.write(f"static_assert(std::{layout}<{type_name}> && alignof({type_name}) <= 4);\n")
+    node.write("\n")
+    node.write("struct Node {\n")
+    node.write("    Kind kind;\n")
+    node.write("    std::uint8_t reserved[3];\n")
+    node.write("    alignas(4) std::byte payload[kPayloadSize];\n")
+    node.write("\n")
+    node.write("    template <typename T> static Node Of(const T &fields)\n")
+    node.write("    {\n")
+    node.write("        // Zeroed first, so the bytes of a payload shorter than the largest are determined too.\n")
+    node.write("        Node node{};\n")
+    node.write("        node.kind = kKindOf<T>;\n")
+    node.write("        new (node.payload) T(fields);\n")
+    node.write("        return node;\n")
+    node.write("    }\n")
+    node.write("\n")
+    node.write("    template <typename T> [[nodiscard]] const T &As() const\n")
+    node.write("    {\n")
+    node.write("        return *std::launder(reinterpret_cast<const T *>(payload));\n")
+    node.write("    }\n")
+    node.write("};\n")
+    node.write("static_assert(std::has_unique_object_representations_v<Node>);\n")
+    node.write("\n")
+    node.write("// The child `offset` nodes back from `node`, or nullptr for offset 0.\n")
+    node.write("inline const Node *Child(const Node *node, Offset offset) { return offset == 0 ? nullptr : node - offset; }\n")
+    node.write("\n")
+    node.write("// Every table a program in flat form is made of. Nodes and tokens hold offsets and indices only, so they can be used\n")
+    node.write("// wherever they lie in memory (see AstCache); constants, symbols and lazy bodies belong to the running process.\n")
+    node.write("struct Tables {\n")
+    node.write("    std::span<const Node> nodes;\n")
+    node.write("    NodeList roots;\n")
+    node.write("    std::span<const Value> constants;\n")
+    node.write("    std::span<const TokenRecord> tokens;\n")
+    node.write("    // The SymbolId of each symbol a TokenRecord can name.\n")
+    node.write("    std::span<const SymbolId> symbols;\n")
+    node.write("    std::span<const LazyBody> lazy_bodies;\n")
+    node.write("};\n")
+    node.write("\n")
+    node.write("// Changes whenever the node definitions do, so encodings from an older build are not mistaken for current ones.\n")
+    node.write(f"inline constexpr std::uint64_t kLayoutHash = 0x{layout_hash():016x};\n")
+    node.write("\n")
+    node.write("// Item `i` of `list`, which belongs to `node`.\n")
+    node.write("inline const Node *Item(const Node *node, NodeList list, std::size_t i)\n")
+    node.write("{\n")
+    node.write("    const auto *link = node - list.first + i;\n")
+    node.write("    return link - link->As<Link>().node;\n")
+    node.write("}\n")
+    node.write("\n")
+    return node.getvalue()
+
+
+def layout_hash() -> int:
+    description = ";".join(f"{namespace}::{key.value}(" + ",".join(f"{flat_type(field)} {field.name}" for field in
+                                                                    (EXPR_AST if namespace == "expr" else STMT_AST)[key]) + ")"
+                           for namespace, key in flat_names())
+    value = 0xcbf29ce484222325
+    for byte in description.encode():
+        value = ((value ^ byte) * 0x100000001b3) & 0xffffffffffffffff
+    return value
+
+
+def generate_flat_visit(ast: Ast, namespace: str, name: str) -> str:
+    visit = StringIO()
+    visit.write(f"// Calls `visitor` with the fields of `node`, which must be {'an' if name == 'Expr' else 'a'} {name}, and `node` itself.\n")
+    visit.write(f"template <typename Visitor> decltype(auto) Visit{name}(const Node *node, Visitor &&visitor)\n")
+    visit.write("{\n")
+    visit.write("    switch (node->kind) {\n")
+    for key in ast.keys():
+        visit.write(f"    case Kind::{kind_name(key)}:\n")
+        visit.write(f"        return visitor(node->As<{namespace}::{key.value}>(), node);\n")
+    visit.write("    default:\n")
+    visit.write("        break;\n")
+    visit.write("    }\n")
+    visit.write(f"    throw std::logic_error{{\"not {'an' if name == 'Expr' else 'a'} {name}\"}};\n")
+    visit.write("}\n")
+    visit.write("\n")
+    return visit.getvalue()
+
+
+def flat_field_value(field: Field) -> str:
+    if isinstance(field, NestedField):
+        if field.subtype == FieldType.TOKEN:
+            return f"Tokens(node.{field.name})"
+        return f"List({field.name}, node.{field.name}.size())"
+    if field.field_type in (FieldType.EXPRESSION_PTR, FieldType.STATEMENT_PTR):
+        return f"Back({field.name})"
+    if field.field_type == FieldType.TOKEN:
+        return f"Ref(node.{field.name})"
+    if field.field_type == FieldType.VALUE:
+        return f"Intern(node.{field.name})"
+    if field.field_type == FieldType.LAZY_BODY:
+        return f"Defer(node.{field.name})"
+    return f"node.{field.name}"
+
+
+def generate_flattener() -> str:
+    flattener = StringIO()
+    flattener.write("// A program in flat form. Functions defined by it keep it alive, see LoxFunction.\n")
+    flattener.write("class FlatAst : public std::enable_shared_from_this<FlatAst>\n")
+    flattener.write("{\n")
+    flattener.write("public:\n")
+    flattener.write("    // Flattens `stmts`, whose tokens all lie in `text`, the text of a Source that starts at `base`.\n")
+    flattener.write("    FlatAst(std::string_view text, SourcePos base, std::span<const Stmt> stmts) : text_{ text }, base_{ base }\n")
+    flattener.write("    {\n")
+    flattener.write("        auto first = EmitList(stmts);\n")
+    flattener.write("        auto roots = List(first, stmts.size());\n")
+    flattener.write("        pending_ = {};\n")
+    flattener.write("        symbol_indices_ = {};\n")
+    flattener.write("        tables_ = { nodes_, roots, constants_, tokens_, symbols_, lazy_bodies_ };\n")
+    flattener.write("    }\n")
+    flattener.write("    // A program flattened from `text` before, whose tables lie in memory that `storage` keeps alive.\n")
+    flattener.write("    FlatAst(std::string_view text, SourcePos base, const flat::Tables &tables, std::shared_ptr<const void> storage)\n")
+    flattener.write("        : text_{ text }, base_{ base }, tables_{ tables }, storage_{ std::move(storage) }\n")
+    flattener.write("    {}\n")
+    flattener.write("\n")
+    flattener.write("    FlatAst(const FlatAst &) = delete;\n")
+    flattener.write("    FlatAst &operator=(const FlatAst &) = delete;\n")
+    flattener.write("\n")
+    flattener.write("    [[nodiscard]] const flat::Tables &Tables() const { return tables_; }\n")
+    flattener.write("    [[nodiscard]] std::span<const flat::Node> Nodes() const { return tables_.nodes; }\n")
+    flattener.write("    // The top-level statements, as a list belonging to the end of Nodes.\n")
+    flattener.write("    [[nodiscard]] flat::NodeList Roots() const { return tables_.roots; }\n")
+    flattener.write("    [[nodiscard]] const flat::Node *End() const { return tables_.nodes.data() + tables_.nodes.size(); }\n")
+    flattener.write("    [[nodiscard]] const Value &ConstantAt(flat::Constant constant) const { return tables_.constants[constant]; }\n")
+    flattener.write("    [[nodiscard]] Token TokenAt(flat::TokenRef ref) const\n")
+    flattener.write("    {\n")
+    flattener.write("        const auto &record = tables_.tokens[ref.index];\n")
+    flattener.write("        auto symbol = record.symbol == flat::kNoSymbolIndex ? kNoSymbol : tables_.symbols[record.symbol];\n")
+    flattener.write("        return { record.type, text_.substr(record.offset, record.length), Nil{}, base_ + record.offset, symbol };\n")
+    flattener.write("    }\n")
+    flattener.write("    [[nodiscard]] const LazyBody &LazyAt(flat::Lazy lazy) const { return tables_.lazy_bodies[lazy - 1]; }\n")
+    flattener.write("\n")
+    for namespace, key in flat_names():
+        fields = (EXPR_AST if namespace == "expr" else STMT_AST)[key]
+        parameter = " &node" if fields else " &"
+        flattener.write(f"    std::uint32_t operator()(const ::{namespace}::{key.value}{parameter})\n")
+        flattener.write("    {\n")
+        for field in fields:
+            if isinstance(field, NestedField) and field.subtype != FieldType.TOKEN:
+                flattener.write(f"        auto {field.name} = EmitList(node.{field.name});\n")
+            elif isinstance(field, SimpleField) and field.field_type in (FieldType.EXPRESSION_PTR,
+                                                                           FieldType.STATEMENT_PTR):
+                flattener.write(f"        auto {field.name} = Emit(node.{field.name});\n")
+        values = ", ".join(flat_field_value(field) for field in fields)
+        flattener.write(f"        return Push(flat::{namespace}::{key.value}{{{f' {values} ' if values else ''}}});\n")
+        flattener.write("    }\n")
+    flattener.write("\n")
+    flattener.write("private:\n")
+    flattener.write("    static constexpr std::uint32_t kNone = ~std::uint32_t{0};\n")
+    flattener.write("\n")
+    flattener.write("    std::string_view text_;\n")
+    flattener.write("    SourcePos base_;\n")
+    flattener.write("    flat::Tables tables_{};\n")
+    flattener.write("    std::shared_ptr<const void> storage_;\n")
+    flattener.write("    // The tables of a program flattened here, while it is being flattened and after.\n")
+    flattener.write("    std::vector<flat::Node> nodes_;\n")
+    flattener.write("    std::vector<Value> constants_;\n")
+    flattener.write("    std::vector<flat::TokenRecord> tokens_;\n")
+    flattener.write("    std::vector<SymbolId> symbols_;\n")
+    flattener.write("    std::vector<LazyBody> lazy_bodies_;\n")
+    flattener.write("    // Index in symbols_ of each SymbolId met so far.\n")
+    flattener.write("    std::vector<std::uint32_t> symbol_indices_;\n")
+    flattener.write("    // Roots of the lists being emitted, innermost last.\n")
+    flattener.write("    std::vector<std::uint32_t> pending_;\n")
+    flattener.write("\n")
+    flattener.write("    [[nodiscard]] std::uint32_t Size() const { return static_cast<std::uint32_t>(nodes_.size()); }\n")
+    flattener.write("\n")
+    flattener.write("    std::uint32_t Emit(ExprPtr expr) { return expr ? std::visit(*this, *expr) : kNone; }\n")
+    flattener.write("    std::uint32_t Emit(StmtPtr stmt) { return stmt ? std::visit(*this, *stmt) : kNone; }\n")
+    flattener.write("    std::uint32_t Emit(const Stmt &stmt) { return std::visit(*this, stmt); }\n")
+    flattener.write("\n")
+    flattener.write("    // Emits every item and then their Links; returns the index of the first Link.\n")
+    flattener.write("    template <typename T> std::uint32_t EmitList(std::span<T> items)\n")
+    flattener.write("    {\n")
+    flattener.write("        auto base = pending_.size();\n")
+    flattener.write("        for (auto &item : items) { pending_.push_back(Emit(item)); }\n")
+    flattener.write("        auto first = Size();\n")
+    flattener.write("        for (auto i = base; i < pending_.size(); ++i) { Push(flat::Link{ Size() - pending_[i] }); }\n")
+    flattener.write("        pending_.resize(base);\n")
+    flattener.write("        return items.empty() ? kNone : first;\n")
+    flattener.write("    }\n")
+    flattener.write("\n")
+    flattener.write("    template <typename T> std::uint32_t Push(const T &fields)\n")
+    flattener.write("    {\n")
+    flattener.write("        nodes_.push_back(flat::Node::Of(fields));\n")
+    flattener.write("        return Size() - 1;\n")
+    flattener.write("    }\n")
+    flattener.write("\n")
+    flattener.write("    // Offset from the node about to be pushed back to `index`.\n")
+    flattener.write("    [[nodiscard]] flat::Offset Back(std::uint32_t index) const { return index == kNone ? 0 : Size() - index; }\n")
+    flattener.write("    [[nodiscard]] flat::NodeList List(std::uint32_t first, std::size_t count) const\n")
+    flattener.write("    {\n")
+    flattener.write("        return { Back(first), static_cast<std::uint32_t>(count) };\n")
+    flattener.write("    }\n")
+    flattener.write("    void Record(const Token &token)\n")
+    flattener.write("    {\n")
+    flattener.write("        auto symbol = flat::kNoSymbolIndex;\n")
+    flattener.write("        if (token.Symbol() != kNoSymbol) {\n")
+    flattener.write("            auto id = Index(token.Symbol());\n")
+    flattener.write("            if (id >= symbol_indices_.size()) { symbol_indices_.resize(id + 1, flat::kNoSymbolIndex); }\n")
+    flattener.write("            if (symbol_indices_[id] == flat::kNoSymbolIndex) {\n")
+    flattener.write("                symbol_indices_[id] = static_cast<std::uint32_t>(symbols_.size());\n")
+    flattener.write("                symbols_.push_back(token.Symbol());\n")
+    flattener.write("            }\n")
+    flattener.write("            symbol = symbol_indices_[id];\n")
+    flattener.write("        }\n")
+    flattener.write("        auto length = static_cast<std::uint32_t>(token.Lexeme().size());\n")
+    flattener.write("        tokens_.push_back({ token.Pos() - base_, length, symbol, token.Type() });\n")
+    flattener.write("    }\n")
+    flattener.write("    flat::TokenRef Ref(const Token &token)\n")
+    flattener.write("    {\n")
+    flattener.write("        Record(token);\n")
+    flattener.write("        return { static_cast<std::uint32_t>(tokens_.size() - 1), token.Type() };\n")
+    flattener.write("    }\n")
+    flattener.write("    flat::TokenList Tokens(std::span<const Token> tokens)\n")
+    flattener.write("    {\n")
+    flattener.write("        auto first = static_cast<std::uint32_t>(tokens_.size());\n")
+    flattener.write("        for (const auto &token : tokens) { Record(token); }\n")
+    flattener.write("        return { first, static_cast<std::uint32_t>(tokens.size()) };\n")
+    flattener.write("    }\n")
+    flattener.write("    flat::Constant Intern(const Value &value)\n")
+    flattener.write("    {\n")
+    flattener.write("        constants_.push_back(value);\n")
+    flattener.write("        return static_cast<flat::Constant>(constants_.size() - 1);\n")
+    flattener.write("    }\n")
+    flattener.write("    flat::Lazy Defer(const LazyBody *lazy)\n")
+    flattener.write("    {\n")
+    flattener.write("        if (lazy == nullptr) { return 0; }\n")
+    flattener.write("        lazy_bodies_.push_back(*lazy);\n")
+    flattener.write("        return static_cast<flat::Lazy>(lazy_bodies_.size());\n")
+    flattener.write("    }\n")
+    flattener.write("};\n")
+    flattener.write("\n")
+    return flattener.getvalue()
+
+
+def generate_flat() -> str:
+    flat = StringIO()
+    flat.write(generate_flat_header())
+    flat.write(generate_flat_kinds())
+    flat.write(generate_flat_structs(EXPR_AST, "expr"))
+    flat.write(generate_flat_structs(STMT_AST, "stmt"))
+    flat.write(generate_flat_node())
+    flat.write(generate_flat_visit(EXPR_AST, "expr", "Expr"))
+    flat.write(generate_flat_visit(STMT_AST, "stmt", "Stmt"))
+    flat.write("} // namespace flat\n")
+    flat.write("\n")
+    flat.write(generate_flattener())
+    flat.write("#endif // LOX_FLAT_AST_H\n")
+    return flat.getvalue()
+
+
+def write(output: str, text: str) -> None:
+    if output == "-":
+        sys.stdout.write(text)
+    else:
+        with open(output, "w") as f:
+            f.write(text)
+
+
+def main(output: str, flat_output: Optional[str]) -> None:
     ast = StringIO()
 
     ast.write(generate_header())
@@ -202,11 +622,9 @@ def main(output: str) -> None:
     ast.write(generate(STMT_AST, "Stmt"))
     ast.write(generate_footer())
 
-    if output == "-":
-        sys.stdout.write(ast.getvalue())
-    else:
-        with open(output, "w") as f:
-            f.write(ast.getvalue())
+    write(output, ast.getvalue())
+    if flat_output is not None:
+        write(flat_output, generate_flat())
 
 
 if __name__ == '__main__':
@@ -214,5 +632,6 @@ if __name__ == '__main__':
         prog="Lox AST generator",
     )
     parser.add_argument("output_path", nargs='?', default="-")
+    parser.add_argument("flat_output_path", nargs='?', default=None)
     args = parser.parse_args()
-    main(args.output_path)
+    main(args.output_path, args.flat_output_path)
@@ -0,0 +1,91 @@
+import argparse
+import sys
+import unicodedata
+from io import StringIO
+from typing import Callable, List, Tuple
+
+Ranges = List[Tuple[int, int]]
+
+# ASCII is handled by the scanner itself; the tables only cover what comes after it.
+FIRST_NON_ASCII = 0x80
+LAST_CODE_POINT = 0x10FFFF
+
+
+def is_identifier_start(code_point: int) -> bool:
+    return chr(code_point).isidentifier()
+
+
+def is_identifier_continue(code_point: int) -> bool:
+    return ("a" + chr(code_point)).isidentifier()
+
+
+def collect_ranges(predicate: Callable[[int], bool]) -> Ranges:
+    ranges: Ranges = []
+    for code_point in range(FIRST_NON_ASCII, LAST_CODE_POINT + 1):
+        if not predicate(code_point):
+            continue
+        if ranges and ranges[-1][1] == code_point - 1:
+            ranges[-1] = (ranges[-1][0], code_point)
+        else:
+            ranges.append((code_point, code_point))
+    return ranges
+
+
+def generate_header() -> str:
+    header = StringIO()
+    header.write(f"// Generated by tools/generate_unicode.py from Unicode {unicodedata.unidata_version}; do not edit.\n")
+    header.write("#ifndef LOX_UNICODE_TABLES_H\n")
+    header.write("#define LOX_UNICODE_TABLES_H\n")
+    header.write("\n")
+    header.write("#include <array>\n")
+    header.write("\n")
+    return header.getvalue()
+
+
+def generate_footer() -> str:
+    return "#endif// LOX_UNICODE_TABLES_H\n"
+
+
+def generate_table(name: str, ranges: Ranges) -> str:
+    table = StringIO()
+    table.write(f"inline constexpr std::array<CodePointRange, {len(ranges)}> {name}{{ {{\n")
+    for first, last in ranges:
+        table.write(f"  {{ 0x{first:X}, 0x{last:X} }},\n")
+    table.write("} };\n")
+    table.write("\n")
+    return table.getvalue()
+
+
+def main(output: str) -> None:
+    tables = StringIO()
+
+    tables.write(generate_header())
+    tables.write("namespace unicode {\n")
+    tables.write("\n")
+    tables.write("struct CodePointRange\n")
+    tables.write("{\n")
+    tables.write("  char32_t first;\n")
+    tables.write("  char32_t last;\n")
+    tables.write("};\n")
+    tables.write("\n")
+    tables.write("// Non-ASCII code points with the XID_Start and XID_Continue properties, as sorted inclusive ranges.\n")
+    tables.write(generate_table("kIdentifierStart", collect_ranges(is_identifier_start)))
+    tables.write(generate_table("kIdentifierContinue", collect_ranges(is_identifier_continue)))
+    tables.write("}// namespace unicode\n")
+    tables.write("\n")
+    tables.write(generate_footer())
+
+    if output == "-":
+        sys.stdout.write(tables.getvalue())
+    else:
+        with open(output, "w") as f:
+            f.write(tables.getvalue())
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        prog="Lox Unicode table generator",
+    )
+    parser.add_argument("output_path", nargs='?', default="-")
+    args = parser.parse_args()
+    main(args.output_path)